@@ -30,16 +30,18 @@ void drawInfoMessage(DrawTarget *draw, uint32_t frame, uint32_t frameTime) {
     auto line = StringNewFormat("Frame rate:  \x02; Frame count: \x02.", 1000 / frameTime, frame);
     writeString(draw, line, 16, 40, 10, 0x7755ff);
 
-    size_t allocBytes, freeBytes, largestBlock;
-    int allocZones, freeZones, refCount;
-    ArenaGetState(MMCurrent(), &allocBytes, &freeBytes, &allocZones, &freeZones, &refCount, &largestBlock);
-
-    StringAppendFormat(line, "Area use: alloc \x02 bytes; free \x02 bytes; largest free block \x02 bytes.",
-                       allocBytes, freeBytes, largestBlock);
+    size_t allocBytes, freeBytes, peakBytes, frameBytes;
+    int arenaCount, refCount;
+    uint32_t frameAllocations;
+    MMGetState(&allocBytes, &freeBytes, &peakBytes, &arenaCount, &refCount); // running totals, no zone scan
+    MMGetAllocationRate(&frameAllocations, &frameBytes);
+
+    StringAppendFormat(line, "Area use: alloc \x02 bytes; free \x02 bytes; peak \x02 bytes.",
+                       (int)allocBytes, (int)freeBytes, (int)peakBytes);
     writeString(draw, line, 16, 100, 10, 0x77ffaa);
 
-    StringAppendFormat(line, "alloc \x02 zones; free \x02 zones; total \x02 objects referenced.",
-                       allocZones, freeZones, refCount);
+    StringAppendFormat(line, "\x02 arenas; total \x02 objects referenced; last frame \x02 allocations, \x02 bytes.",
+                       arenaCount, refCount, (int)frameAllocations, (int)frameBytes);
     writeString(draw, line, 16, 120, 10, 0x77ffaa);
 
     for (int i = 0; i < 350; ++i) {
@@ -68,6 +70,7 @@ void drawMouseHalo(DrawTarget *draw){
 }
 
 void DrawToScanBuffer(DrawTarget *draw, uint32_t frame, uint32_t frameTime) {
+    MMFrameStart(); // allocation accounting, if enabled
     MMPush(1 MEGABYTE); // prepare a per-frame bump allocator
 
     ResetTextureAtlas(draw->textures); // really wasteful. Move this away
@@ -96,6 +99,7 @@ void DrawToScanBuffer(DrawTarget *draw, uint32_t frame, uint32_t frameTime) {
 
 
     MMPop(); // wipe out anything we allocated in this frame.
+    MMFrameEnd(); // complain if we touched the system allocator after warm-up
 }
 
 void StartUp() {
@@ -1,7 +1,15 @@
 #include <types/MathBits.h>
 #include <types/String.h>
+#include <types/ArenaAllocator.h>
+#include <types/Vector.h>
+#include <types/VectorSort.h>
+#include <types/TypedContainers.h>
+#include <types/ConcurrentHashMap.h>
 #include <gui_core/ScanBufferFont.h>
 #include "demo.h"
+#include <SDL_thread.h>
+#include <SDL_atomic.h>
+#include <iostream>
 
 void log(DrawTarget *draw, String *line, int x, int y, int z, uint32_t color) {
     auto objectId = AddSingleColorMaterial(draw->textures, z, color);
@@ -17,9 +25,856 @@ bool RandomNumberTest(DrawTarget *draw) {
     return false;
 }
 
+typedef struct BenchAllocation {
+    void* ptr;
+    uint32_t size;
+} BenchAllocation;
+
+// Allocation latency with an arena held at a fixed fill level.
+// Oldest allocations are freed as new ones are made, so zones empty out in a scattered order.
+bool ArenaFillBenchmark() {
+    const int fills[] = {10, 50, 95};
+    const int rounds = 500000;
+    auto frequency = (double)SDL_GetPerformanceFrequency();
+
+    for (auto fill : fills) {
+        auto a = NewArena(64 MEGABYTES);
+        auto qa = NewArena(16 MEGABYTES);
+        auto queue = VectorAllocateArena(qa, sizeof(BenchAllocation));
+
+        size_t capacity = 0;
+        ArenaGetState(a, nullptr, &capacity, nullptr, nullptr, nullptr, nullptr);
+        size_t target = (capacity / 100) * fill;
+        size_t live = 0;
+        BenchAllocation item = {};
+
+        while (live < target) {
+            item.size = 16 + random_at_most(1008);
+            item.ptr = ArenaAllocate(a, item.size);
+            if (item.ptr == nullptr) break;
+            VectorPush(queue, &item);
+            live += item.size;
+        }
+
+        uint64_t total = 0, worst = 0;
+        int fails = 0;
+        for (int i = 0; i < rounds; i++) {
+            if (VectorDequeue(queue, &item)) {
+                ArenaDereference(a, item.ptr);
+                live -= item.size;
+            }
+
+            item.size = 16 + random_at_most(1008);
+            auto start = SDL_GetPerformanceCounter();
+            item.ptr = ArenaAllocate(a, item.size);
+            auto time = SDL_GetPerformanceCounter() - start;
+
+            total += time;
+            if (time > worst) worst = time;
+            if (item.ptr == nullptr) { fails++; continue; }
+            VectorPush(queue, &item);
+            live += item.size;
+        }
+
+        std::cout << "Arena fill " << fill << "%: mean " << (total * 1.0e9 / frequency / rounds)
+                  << "ns, worst " << (worst * 1.0e9 / frequency) << "ns, failed " << fails << "\n";
+
+        DropArena(&qa);
+        DropArena(&a);
+    }
+    return true;
+}
+
+#define STRESS_THREADS 4
+#define STRESS_RING 64
+#define STRESS_HANDOFF 256
+
+typedef struct StressWorker {
+    Arena* arena;
+    uint32_t seed;
+    int rounds;
+    int errors;
+    uint64_t ticks;
+} StressWorker;
+
+// allocations passed between threads, to be freed by whichever thread picks them up
+static BenchAllocation STRESS_HANDOFF_ITEMS[STRESS_HANDOFF];
+static int STRESS_HANDOFF_COUNT = 0;
+static SDL_SpinLock STRESS_HANDOFF_LOCK = 0;
+
+// Fill an allocation with a pattern based on its address, or check the pattern is intact
+bool StressPattern(BenchAllocation* item, bool write) {
+    auto bytes = (uint8_t*)item->ptr;
+    auto mark = (uint8_t)((size_t)item->ptr >> 4);
+    for (uint32_t i = 0; i < item->size; i++) {
+        if (write) bytes[i] = mark;
+        else if (bytes[i] != mark) return false;
+    }
+    return true;
+}
+
+void StressRelease(StressWorker* w, BenchAllocation* item) {
+    if (!StressPattern(item, false)) w->errors++; // another thread wrote over our memory
+    if (!ArenaDereference(w->arena, item->ptr)) w->errors++;
+}
+
+int ArenaStressWorker(void* data) {
+    auto w = (StressWorker*)data;
+    BenchAllocation ring[STRESS_RING] = {};
+    BenchAllocation taken[STRESS_HANDOFF];
+
+    auto start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < w->rounds; i++) {
+        auto slot = i % STRESS_RING;
+        if (ring[slot].ptr != nullptr) {
+            // every fourth allocation is freed by a different thread
+            bool handed = false;
+            if ((i & 3) == 0) {
+                SDL_AtomicLock(&STRESS_HANDOFF_LOCK);
+                if (STRESS_HANDOFF_COUNT < STRESS_HANDOFF) {
+                    STRESS_HANDOFF_ITEMS[STRESS_HANDOFF_COUNT++] = ring[slot];
+                    handed = true;
+                }
+                SDL_AtomicUnlock(&STRESS_HANDOFF_LOCK);
+            }
+            if (!handed) StressRelease(w, &ring[slot]);
+        }
+
+        w->seed = triple32(&w->seed);
+        ring[slot].size = 16 + (w->seed % 1000);
+        ring[slot].ptr = ArenaAllocate(w->arena, ring[slot].size);
+        if (ring[slot].ptr == nullptr) { w->errors++; continue; }
+        StressPattern(&ring[slot], true);
+
+        if ((i & 63) == 0) { // pick up anything other threads handed over
+            SDL_AtomicLock(&STRESS_HANDOFF_LOCK);
+            int count = STRESS_HANDOFF_COUNT;
+            for (int j = 0; j < count; j++) taken[j] = STRESS_HANDOFF_ITEMS[j];
+            STRESS_HANDOFF_COUNT = 0;
+            SDL_AtomicUnlock(&STRESS_HANDOFF_LOCK);
+            for (int j = 0; j < count; j++) StressRelease(w, &taken[j]);
+        }
+    }
+    for (auto& item : ring) {
+        if (item.ptr != nullptr) StressRelease(w, &item);
+    }
+    w->ticks = SDL_GetPerformanceCounter() - start;
+    return 0;
+}
+
+// Many threads allocating from, and freeing into, one concurrent arena.
+// Reports time per allocation (including its share of frees) and any corruption found.
+bool ArenaConcurrentBenchmark() {
+    auto a = NewArena(64 MEGABYTES);
+    ArenaSetConcurrent(a, true);
+
+    StressWorker workers[STRESS_THREADS];
+    SDL_Thread* threads[STRESS_THREADS];
+    for (int i = 0; i < STRESS_THREADS; i++) {
+        workers[i] = StressWorker{a, (uint32_t)(i + 1) * 7919, 200000, 0, 0};
+        threads[i] = SDL_CreateThread(ArenaStressWorker, "ArenaStress", &workers[i]);
+    }
+
+    int errors = 0;
+    uint64_t ticks = 0;
+    for (int i = 0; i < STRESS_THREADS; i++) {
+        SDL_WaitThread(threads[i], nullptr);
+        errors += workers[i].errors;
+        ticks += workers[i].ticks;
+    }
+
+    BenchAllocation item = {};
+    StressWorker cleanup = {a, 0, 0, 0, 0};
+    while (STRESS_HANDOFF_COUNT > 0) {
+        item = STRESS_HANDOFF_ITEMS[--STRESS_HANDOFF_COUNT];
+        StressRelease(&cleanup, &item);
+    }
+    errors += cleanup.errors;
+
+    ArenaSetConcurrent(a, false);
+    int references = 0;
+    ArenaGetState(a, nullptr, nullptr, nullptr, nullptr, &references, nullptr);
+
+    auto ns = ticks * 1.0e9 / (double)SDL_GetPerformanceFrequency() / (STRESS_THREADS * 200000.0);
+    std::cout << "Concurrent arena, " << STRESS_THREADS << " threads: " << ns << "ns per allocation, "
+              << errors << " errors, " << references << " references left\n";
+
+    DropArena(&a);
+    return errors == 0 && references == 0;
+}
+
+typedef struct SortBenchItem {
+    uint32_t key;
+    uint32_t payload[15];
+} SortBenchItem;
+
+int SortBenchCompareInt(void* a, void* b) {
+    auto x = *(uint32_t*)a, y = *(uint32_t*)b;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+int SortBenchCompareItem(void* a, void* b) {
+    return SortBenchCompareInt(&((SortBenchItem*)a)->key, &((SortBenchItem*)b)->key);
+}
+
+// Time for each sort plan, over a range of sizes, for small and large elements.
+// Each plan runs with a function pointer compare (`VectorSortWithPlan`) and an inlined one (`VectorSortInline`).
+bool VectorSortBenchmark() {
+    const uint32_t sizes[] = {1000, 10000, 100000, 1000000};
+    const char* names[] = {"auto", "merge", "tide", "copy-out", "proxy"};
+    auto frequency = (double)SDL_GetPerformanceFrequency();
+    bool allOk = true;
+
+    for (int large = 0; large < 2; large++) {
+        for (auto n : sizes) {
+            std::cout << (large ? "64 byte" : "4 byte") << " elements, n=" << n << ":";
+            for (int plan = VECTOR_SORT_AUTO; plan <= VECTOR_SORT_PROXY; plan++) {
+                for (int inlined = 0; inlined < 2; inlined++) {
+                    auto a = NewArena(256 MEGABYTES);
+                    auto v = VectorAllocateArena(a, large ? sizeof(SortBenchItem) : sizeof(uint32_t));
+                    SortBenchItem item = {};
+                    for (uint32_t i = 0; i < n; i++) {
+                        item.key = random_at_most(1 << 30);
+                        VectorPush(v, &item);
+                    }
+
+                    auto start = SDL_GetPerformanceCounter();
+                    bool ok;
+                    if (!inlined) {
+                        ok = VectorSortWithPlan(v, large ? SortBenchCompareItem : SortBenchCompareInt, plan);
+                    } else if (large) {
+                        ok = VectorSortInline<SortBenchItem>(v, [](SortBenchItem* x, SortBenchItem* y) {
+                            return (x->key < y->key) ? -1 : (x->key > y->key) ? 1 : 0;
+                        }, plan);
+                    } else {
+                        ok = VectorSortInline<uint32_t>(v, [](uint32_t* x, uint32_t* y) {
+                            return (*x < *y) ? -1 : (*x > *y) ? 1 : 0;
+                        }, plan);
+                    }
+                    auto time = SDL_GetPerformanceCounter() - start;
+
+                    for (uint32_t i = 1; ok && i < n; i++) {
+                        ok = *(uint32_t*)VectorGet(v, (int)i - 1) <= *(uint32_t*)VectorGet(v, (int)i);
+                    }
+                    allOk = allOk && ok;
+
+                    std::cout << " " << names[plan] << (inlined ? "(inline)" : "") << "=" << (time * 1.0e3 / frequency) << "ms" << (ok ? "" : "(FAILED)");
+                    DropArena(&a);
+                }
+            }
+            std::cout << "\n";
+        }
+    }
+    return allOk;
+}
+
+// Parallel sort scaling: time to sort with 1 to N threads (N being the core count, at least 4)
+bool VectorParallelSortBenchmark() {
+    const uint32_t sizes[] = {100000, 1000000, 4000000};
+    auto cores = (int)SDL_GetCPUCount();
+    if (cores < 4) cores = 4;
+    auto frequency = (double)SDL_GetPerformanceFrequency();
+    bool allOk = true;
+
+    for (auto n : sizes) {
+        std::cout << "Parallel sort, n=" << n << ":";
+        double single = 0.0;
+        for (int threads = 1; threads <= cores; threads++) {
+            auto a = NewArena(512 MEGABYTES);
+            auto v = VectorAllocateArena(a, sizeof(uint32_t));
+            for (uint32_t i = 0; i < n; i++) {
+                auto key = random_at_most(1 << 30);
+                VectorPush(v, &key);
+            }
+
+            auto start = SDL_GetPerformanceCounter();
+            bool ok = VectorSortParallelInline<uint32_t>(v, [](uint32_t* x, uint32_t* y) {
+                return (*x < *y) ? -1 : (*x > *y) ? 1 : 0;
+            }, threads);
+            auto ms = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+            if (threads == 1) single = ms;
+
+            for (uint32_t i = 1; ok && i < n; i++) {
+                ok = *(uint32_t*)VectorGet(v, (int)i - 1) <= *(uint32_t*)VectorGet(v, (int)i);
+            }
+            allOk = allOk && ok;
+
+            std::cout << " " << threads << "T=" << ms << "ms (x" << (single / ms) << ")" << (ok ? "" : "(FAILED)");
+            DropArena(&a);
+        }
+        std::cout << "\n";
+    }
+    return allOk;
+}
+
+// Long-running FIFO: a normal vector against a deque vector, holding a steady queue depth.
+// Reports time and the arena allocations made once the queue is warmed up.
+bool VectorFifoBenchmark() {
+    const uint32_t depths[] = {100, 10000, 1000000};
+    const uint32_t rounds = 10000000;
+    auto frequency = (double)SDL_GetPerformanceFrequency();
+    bool allOk = true;
+
+    for (auto depth : depths) {
+        std::cout << "FIFO, depth=" << depth << ":";
+        for (int deque = 0; deque < 2; deque++) {
+            auto a = NewArena(256 MEGABYTES);
+            auto v = deque ? VectorAllocateArenaDeque(a, sizeof(uint32_t)) : VectorAllocateArena(a, sizeof(uint32_t));
+            uint32_t next = 0, expected = 0, out = 0;
+            for (; next < depth * 2; next++) VectorPush(v, &next); // warm up
+            for (uint32_t i = 0; i < depth * 2; i++) VectorDequeue(v, &out);
+            expected = depth * 2;
+            for (uint32_t i = 0; i < depth; i++, next++) VectorPush(v, &next);
+
+            size_t peak, bytes;
+            uint32_t countBefore, countAfter;
+            ArenaGetUsage(a, &peak, &countBefore, &bytes);
+
+            bool ok = true;
+            auto start = SDL_GetPerformanceCounter();
+            for (uint32_t i = 0; i < rounds; i++, next++) {
+                VectorDequeue(v, &out);
+                ok = ok && (out == expected++);
+                VectorPush(v, &next);
+            }
+            auto ms = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+            ArenaGetUsage(a, &peak, &countAfter, &bytes);
+            allOk = allOk && ok;
+
+            std::cout << (deque ? " deque=" : " normal=") << ms << "ms, " << (countAfter - countBefore) << " allocations" << (ok ? "" : "(FAILED)");
+            VectorDeallocate(v);
+            DropArena(&a);
+        }
+        std::cout << "\n";
+    }
+    return allOk;
+}
+
+// Same hash as `HashMapIntKeyHash`, so both maps see the same bucket layout
+struct BenchIntKeyHash {
+    inline uint32_t operator()(const uint32_t& key) const { return key | 0xA0000000; }
+};
+
+// Same work through the C container functions and the typed templates: vector push and read,
+// hash map put and get, and heap insert and delete.
+bool TypedContainerBenchmark() {
+    const uint32_t n = 100000;
+    auto frequency = (double)SDL_GetPerformanceFrequency();
+    auto a = NewArena(256 MEGABYTES);
+    uint64_t checkC = 0, checkTyped = 0;
+
+    // Vector
+    auto start = SDL_GetPerformanceCounter();
+    auto cv = VectorAllocateArena(a, sizeof(uint64_t));
+    for (uint64_t i = 0; i < n; i++) VectorPush(cv, &i);
+    for (uint32_t i = 0; i < n; i++) checkC += *(uint64_t*)VectorGet(cv, (int)i);
+    auto vectorC = SDL_GetPerformanceCounter() - start;
+    VectorDeallocate(cv);
+
+    start = SDL_GetPerformanceCounter();
+    auto tv = TypedVector<uint64_t>::Allocate(a);
+    for (uint64_t i = 0; i < n; i++) tv.Push(i);
+    tv.ForEach([&](uint64_t* value, uint32_t) { checkTyped += *value; });
+    auto vectorTyped = SDL_GetPerformanceCounter() - start;
+    tv.Deallocate();
+
+    // Hash map
+    start = SDL_GetPerformanceCounter();
+    auto cm = HashMapAllocateArena(a, 64, sizeof(uint32_t), sizeof(uint32_t), HashMapIntKeyCompare, HashMapIntKeyHash);
+    for (uint32_t i = 0; i < n; i++) HashMapPut(cm, &i, &i, true);
+    for (uint32_t i = 0; i < n; i++) {
+        void* value;
+        if (HashMapGet(cm, &i, &value)) checkC += *(uint32_t*)value;
+    }
+    auto mapC = SDL_GetPerformanceCounter() - start;
+    HashMapDeallocate(cm);
+
+    start = SDL_GetPerformanceCounter();
+    auto tm = TypedHashMap<uint32_t, uint32_t, BenchIntKeyHash>::Allocate(a, 64);
+    for (uint32_t i = 0; i < n; i++) tm.Put(i, i, true);
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t value;
+        if (tm.TryGet(i, &value)) checkTyped += value;
+    }
+    auto mapTyped = SDL_GetPerformanceCounter() - start;
+    tm.Deallocate();
+
+    // Heap
+    start = SDL_GetPerformanceCounter();
+    auto ch = HeapAllocate(a, sizeof(uint64_t));
+    for (uint64_t i = 0; i < n; i++) HeapInsert(ch, (int)random_at_most(n), &i);
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t value;
+        if (HeapDeleteMin(ch, &value)) checkC += 1;
+    }
+    auto heapC = SDL_GetPerformanceCounter() - start;
+    HeapDeallocate(ch);
+
+    start = SDL_GetPerformanceCounter();
+    auto th = TypedHeap<uint64_t>::Allocate(a);
+    for (uint64_t i = 0; i < n; i++) th.Insert((int)random_at_most(n), i);
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t value;
+        if (th.DeleteMin(&value)) checkTyped += 1;
+    }
+    auto heapTyped = SDL_GetPerformanceCounter() - start;
+    th.Deallocate();
+
+    DropArena(&a);
+
+    auto ms = [&](uint64_t t) { return t * 1.0e3 / frequency; };
+    std::cout << "Containers, n=" << n << ": vector C=" << ms(vectorC) << "ms typed=" << ms(vectorTyped) << "ms;"
+              << " hash map C=" << ms(mapC) << "ms typed=" << ms(mapTyped) << "ms;"
+              << " heap C=" << ms(heapC) << "ms typed=" << ms(heapTyped) << "ms"
+              << (checkC == checkTyped ? "" : " (MISMATCH)") << "\n";
+    return checkC == checkTyped;
+}
+
+// Lots of tiny vectors, as made during a frame: chunked, flat and small vectors holding 3 elements each.
+// Reports time to build, read and release them, and the slab memory they held.
+bool TinyVectorBenchmark() {
+    const uint32_t count = 10000, rounds = 100, length = 3;
+    const char* names[] = {"chunked", "flat", "small"};
+    auto frequency = (double)SDL_GetPerformanceFrequency();
+    auto holder = NewArena(1 MEGABYTES);
+    auto vectors = (Vector**)ArenaAllocateAndClear(holder, count * sizeof(Vector*));
+    if (vectors == nullptr) return false;
+    bool allOk = true;
+
+    std::cout << "Tiny vectors, " << count << " x " << length << " elements:";
+    for (int mode = 0; mode < 3; mode++) {
+        auto a = NewArena(256 MEGABYTES);
+        size_t slabBytes, liveBytes = 0, freeBytes, wastedBytes;
+        uint64_t sum = 0;
+
+        auto start = SDL_GetPerformanceCounter();
+        for (uint32_t r = 0; r < rounds; r++) {
+            for (uint32_t i = 0; i < count; i++) {
+                if (mode == 0) vectors[i] = VectorAllocateArena(a, sizeof(uint32_t));
+                else if (mode == 1) vectors[i] = VectorAllocateArenaFlat(a, sizeof(uint32_t), length);
+                else vectors[i] = VectorAllocateArenaSmall(a, sizeof(uint32_t), length);
+                for (uint32_t k = 0; k < length; k++) VectorPush(vectors[i], &k);
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                for (uint32_t k = 0; k < length; k++) sum += *(uint32_t*)VectorGet(vectors[i], (int)k);
+            }
+            if (r == 0) ArenaGetSlabState(a, &slabBytes, &liveBytes, &freeBytes, &wastedBytes);
+            for (uint32_t i = 0; i < count; i++) VectorDeallocate(vectors[i]);
+        }
+        auto ms = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+        bool ok = sum == (uint64_t)rounds * count * (length * (length - 1) / 2);
+        allOk = allOk && ok;
+
+        std::cout << " " << names[mode] << "=" << ms << "ms, " << (liveBytes / count) << " bytes each" << (ok ? "" : "(FAILED)");
+        DropArena(&a);
+    }
+    std::cout << "\n";
+    DropArena(&holder);
+    return allOk;
+}
+
+// The byte-at-a-time loops the RawData helpers used to be, for comparison
+void ByteCopy(void* dst, void* src, size_t length) {
+    auto d = (char*)dst;
+    auto s = (char*)src;
+    for (size_t i = 0; i < length; i++) *(d++) = *(s++);
+}
+void ByteSwap(void* a, void* b, size_t length) {
+    auto p = (char*)a;
+    auto q = (char*)b;
+    for (size_t i = 0; i < length; i++, p++, q++) {
+        const char t = *p;
+        *p = *q;
+        *q = t;
+    }
+}
+
+// Raw element copy and swap at common element sizes, byte loops against the RawData helpers.
+// Then some container work that runs on those helpers: sorting 16 byte elements, and comparing long strings.
+bool RawDataBenchmark() {
+    const size_t sizes[] = {4, 8, 12, 16, 24, 32, 64, 256};
+    const size_t blockBytes = 64 * 1024;
+    const uint32_t rounds = 200;
+    auto frequency = (double)SDL_GetPerformanceFrequency();
+    auto a = NewArena(256 MEGABYTES);
+    auto block = (char*)ArenaAllocateAndClear(a, blockBytes * 2);
+    if (block == nullptr) return false;
+    for (size_t i = 0; i < blockBytes * 2; i++) block[i] = (char)(i * 7);
+    bool allOk = true;
+
+    std::cout << "Raw data, ms for " << rounds << " x " << (blockBytes / 1024) << "KB (bytes / helper):\n";
+    for (auto size : sizes) {
+        auto count = (uint32_t)(blockBytes / size);
+        auto src = block, dst = block + blockBytes;
+        double times[4];
+        for (int k = 0; k < 4; k++) {
+            auto start = SDL_GetPerformanceCounter();
+            for (uint32_t r = 0; r < rounds; r++) {
+                for (uint32_t i = 0; i < count; i++) {
+                    auto j = (i * 7) % count; // scatter, so the loop doesn't collapse into one big copy
+                    switch (k) {
+                        case 0: ByteCopy(dst + j * size, src + i * size, size); break;
+                        case 1: writeValue(dst, j * size, src + i * size, (uint32_t)size); break;
+                        case 2: ByteSwap(dst + j * size, src + i * size, size); break;
+                        default: swapMem(dst + j * size, src + i * size, (uint32_t)size); break;
+                    }
+                }
+            }
+            times[k] = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+        }
+        std::cout << "  " << size << " bytes: copy " << times[0] << " / " << times[1] << ", swap " << times[2] << " / " << times[3] << "\n";
+    }
+
+    // sort 16 byte elements
+    const uint32_t n = 1000000;
+    typedef struct { uint64_t key, value; } Pair;
+    auto v = VectorAllocateArena(a, sizeof(Pair));
+    for (uint32_t i = 0; i < n; i++) {
+        Pair p = {random_at_most(n), i};
+        VectorPush(v, &p);
+    }
+    auto start = SDL_GetPerformanceCounter();
+    VectorSort(v, [](void* l, void* r) { return (((Pair*)l)->key > ((Pair*)r)->key) - (((Pair*)l)->key < ((Pair*)r)->key); });
+    auto sortMs = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+    VectorDeallocate(v);
+
+    // compare long equal strings
+    auto s1 = StringEmptyInArena(a), s2 = StringEmptyInArena(a);
+    for (uint32_t i = 0; i < 8192; i++) {
+        StringAppendChar(s1, (char)('a' + i % 26));
+        StringAppendChar(s2, (char)('a' + i % 26));
+    }
+    uint32_t equalCount = 0;
+    start = SDL_GetPerformanceCounter();
+    for (uint32_t i = 0; i < 10000; i++) equalCount += StringAreEqual(s1, s2) ? 1 : 0;
+    auto stringMs = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+    allOk = allOk && equalCount == 10000;
+
+    std::cout << "  sort " << n << " x 16 bytes=" << sortMs << "ms; compare 8KB strings x 10000=" << stringMs << "ms" << (allOk ? "" : " (FAILED)") << "\n";
+    DropArena(&a);
+    return allOk;
+}
+
+// Robin-hood buckets against grouped storage, through the C functions and the typed template:
+// put n keys, look them all up, look up n missing keys, then remove them all.
+bool HashMapGroupedBenchmark() {
+    const uint32_t sizes[] = {1000, 100000, 1000000};
+    const char* names[] = {"buckets", "grouped", "typed buckets", "typed grouped"};
+    auto frequency = (double)SDL_GetPerformanceFrequency();
+    bool allOk = true;
+
+    for (auto n : sizes) {
+        std::cout << "Hash map, n=" << n << " (put / hit / miss / remove ms):\n";
+        for (int mode = 0; mode < 4; mode++) {
+            auto a = NewArena(512 MEGABYTES);
+            bool grouped = (mode & 1) != 0;
+            uint32_t found = 0, removed = 0;
+            double ms[4];
+
+            // keys are scattered over the whole range, and misses come from the same sequence past `n`
+            auto start = SDL_GetPerformanceCounter();
+            if (mode < 2) {
+                auto h = grouped ? HashMapAllocateArenaGrouped(a, 64, sizeof(uint32_t), sizeof(uint32_t), HashMapIntKeyCompare, HashMapIntKeyHash)
+                                 : HashMapAllocateArena(a, 64, sizeof(uint32_t), sizeof(uint32_t), HashMapIntKeyCompare, HashMapIntKeyHash);
+                for (uint32_t i = 0; i < n; i++) { uint32_t k = i * 2654435761u; HashMapPut(h, &k, &i, true); }
+                ms[0] = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+
+                start = SDL_GetPerformanceCounter();
+                for (uint32_t i = 0; i < n; i++) {
+                    uint32_t k = i * 2654435761u;
+                    void* value;
+                    if (HashMapGet(h, &k, &value) && *(uint32_t*)value == i) found++;
+                }
+                ms[1] = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+
+                start = SDL_GetPerformanceCounter();
+                for (uint32_t i = 0; i < n; i++) { uint32_t k = (i + n) * 2654435761u; if (HashMapGet(h, &k, nullptr)) found++; }
+                ms[2] = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+
+                start = SDL_GetPerformanceCounter();
+                for (uint32_t i = 0; i < n; i++) { uint32_t k = i * 2654435761u; if (HashMapRemove(h, &k)) removed++; }
+                ms[3] = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+                HashMapDeallocate(h);
+            } else {
+                auto h = grouped ? TypedHashMap<uint32_t, uint32_t, BenchIntKeyHash>::AllocateGrouped(a, 64)
+                                 : TypedHashMap<uint32_t, uint32_t, BenchIntKeyHash>::Allocate(a, 64);
+                for (uint32_t i = 0; i < n; i++) h.Put(i * 2654435761u, i, true);
+                ms[0] = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+
+                start = SDL_GetPerformanceCounter();
+                for (uint32_t i = 0; i < n; i++) {
+                    uint32_t value;
+                    if (h.TryGet(i * 2654435761u, &value) && value == i) found++;
+                }
+                ms[1] = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+
+                start = SDL_GetPerformanceCounter();
+                for (uint32_t i = 0; i < n; i++) if (h.TryGet((i + n) * 2654435761u, nullptr)) found++;
+                ms[2] = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+
+                start = SDL_GetPerformanceCounter();
+                for (uint32_t i = 0; i < n; i++) if (h.Remove(i * 2654435761u)) removed++;
+                ms[3] = (SDL_GetPerformanceCounter() - start) * 1.0e3 / frequency;
+                h.Deallocate();
+            }
+
+            bool ok = found == n && removed == n;
+            allOk = allOk && ok;
+            std::cout << "  " << names[mode] << ": " << ms[0] << " / " << ms[1] << " / " << ms[2] << " / " << ms[3] << (ok ? "" : " (FAILED)") << "\n";
+            DropArena(&a);
+        }
+    }
+    return allOk;
+}
+
+// Distinct keys with random-looking low bits, so buckets collide as they would with real hashes
+inline uint32_t BenchScatter(uint32_t i) {
+    i ^= i >> 16;
+    i *= 0x85ebca6b;
+    i ^= i >> 13;
+    i *= 0xc2b2ae35;
+    i ^= i >> 16;
+    return i;
+}
+
+// Robin-hood buckets held at high load: a map with a fixed number of buckets is filled to each load,
+// then keys are removed and replaced so the load stays the same. Reports the probe lengths after the churn.
+bool HashMapLoadBenchmark() {
+    const uint32_t buckets = 1 << 16, churn = 1000000, histogramSize = 256, shown = 7;
+    const float loads[] = {0.8f, 0.85f, 0.9f, 0.95f, 0.99f};
+    auto frequency = (double)SDL_GetPerformanceFrequency();
+    bool allOk = true;
+
+    std::cout << "Hash map load, " << buckets << " buckets (ns per insert / remove+insert; probe mean, max; % at distance 0..6, 7+):\n";
+    for (auto load : loads) {
+        auto a = NewArena(64 MEGABYTES);
+        auto count = (uint32_t)((float)buckets * load);
+        auto keys = (uint32_t*)ArenaAllocate(a, count * sizeof(uint32_t));
+        auto h = HashMapAllocateArena(a, buckets, sizeof(uint32_t), sizeof(uint32_t), HashMapIntKeyCompare, HashMapIntKeyHash); // no growth until full
+        if (keys == nullptr || h == nullptr) return false;
+
+        uint32_t next = 0;
+        auto start = SDL_GetPerformanceCounter();
+        for (uint32_t i = 0; i < count; i++, next++) {
+            keys[i] = BenchScatter(next);
+            HashMapPut(h, &keys[i], &i, false);
+        }
+        auto insertNs = (SDL_GetPerformanceCounter() - start) * 1.0e9 / frequency / count;
+
+        bool ok = true;
+        start = SDL_GetPerformanceCounter();
+        for (uint32_t i = 0; i < churn; i++, next++) {
+            auto slot = i % count;
+            ok = HashMapRemove(h, &keys[slot]) && ok;
+            keys[slot] = BenchScatter(next);
+            ok = HashMapPut(h, &keys[slot], &slot, false) && ok;
+        }
+        auto churnNs = (SDL_GetPerformanceCounter() - start) * 1.0e9 / frequency / churn;
+        ok = ok && HashMapCount(h) == count;
+        for (uint32_t i = 0; i < count && ok; i++) ok = HashMapGet(h, &keys[i], nullptr);
+        allOk = allOk && ok;
+
+        uint32_t histogram[histogramSize];
+        auto longest = HashMapProbeLengths(h, histogram, histogramSize);
+        double mean = 0;
+        for (uint32_t i = 0; i < histogramSize; i++) mean += (double)i * histogram[i];
+
+        std::cout << "  load " << load << ": " << insertNs << " / " << churnNs << "; " << (mean / count) << ", " << longest << ";";
+        uint32_t further = count;
+        for (uint32_t i = 0; i < shown; i++) {
+            std::cout << " " << (100.0 * histogram[i] / count);
+            further -= histogram[i];
+        }
+        std::cout << " " << (100.0 * further / count);
+        std::cout << (ok ? "" : " (FAILED)") << "\n";
+
+        HashMapDeallocate(h);
+        DropArena(&a);
+    }
+    return allOk;
+}
+
+// One-shot rehash against incremental resize: put n keys into a map that starts small, timing each put.
+// The total should be close; the worst single put is where incremental resize pays off.
+bool HashMapResizeLatencyBenchmark() {
+    const uint32_t n = 1000000;
+    const char* names[] = {"one-shot", "incremental"};
+    auto frequency = (double)SDL_GetPerformanceFrequency();
+    bool allOk = true;
+
+    std::cout << "Hash map resize, n=" << n << " (total ms; worst put us; puts over 50us):\n";
+    for (int mode = 0; mode < 2; mode++) {
+        auto a = NewArena(256 MEGABYTES);
+        auto h = mode == 0 ? HashMapAllocateArena(a, 64, sizeof(uint32_t), sizeof(uint32_t), HashMapIntKeyCompare, HashMapIntKeyHash)
+                           : HashMapAllocateArenaIncremental(a, 64, sizeof(uint32_t), sizeof(uint32_t), HashMapIntKeyCompare, HashMapIntKeyHash);
+        if (h == nullptr) return false;
+
+        uint64_t worst = 0, total = 0;
+        uint32_t slow = 0;
+        auto slowTicks = (uint64_t)(frequency * 50.0e-6);
+        bool ok = true;
+        for (uint32_t i = 0; i < n; i++) {
+            auto k = BenchScatter(i);
+            auto start = SDL_GetPerformanceCounter();
+            ok = HashMapPut(h, &k, &i, false) && ok;
+            auto ticks = SDL_GetPerformanceCounter() - start;
+            total += ticks;
+            if (ticks > worst) worst = ticks;
+            if (ticks > slowTicks) slow++;
+        }
+        ok = ok && HashMapCount(h) == n;
+        for (uint32_t i = 0; i < n && ok; i++) {
+            auto k = BenchScatter(i);
+            void* value;
+            ok = HashMapGet(h, &k, &value) && *(uint32_t*)value == i;
+        }
+        allOk = allOk && ok;
+
+        std::cout << "  " << names[mode] << ": " << (total * 1.0e3 / frequency) << "; " << (worst * 1.0e6 / frequency) << "; " << slow << (ok ? "" : " (FAILED)") << "\n";
+        HashMapDeallocate(h);
+        DropArena(&a);
+    }
+    return allOk;
+}
+
+#define MAP_BENCH_KEYS 100000
+#define MAP_BENCH_WINDOW 50000
+#define MAP_BENCH_LOOKUPS 500000
+#define MAP_BENCH_MAX_READERS 8
+
+// One thread of the concurrent map benchmark. Uses `locked` behind `MAP_BENCH_LOCK` if set, or `shared` otherwise.
+typedef struct MapBenchWorker {
+    HashMap* locked;
+    ConcurrentHashMap* shared;
+    uint32_t seed;
+    uint32_t operations;
+    int errors;
+    uint64_t ticks;
+} MapBenchWorker;
+
+static SDL_SpinLock MAP_BENCH_LOCK = 0;
+static SDL_atomic_t MAP_BENCH_DONE;
+
+// Look up random keys from the ones put before the threads started, checking their values
+int MapBenchReader(void* data) {
+    auto w = (MapBenchWorker*)data;
+    auto start = SDL_GetPerformanceCounter();
+    for (uint32_t i = 0; i < MAP_BENCH_LOOKUPS; i++) {
+        w->seed = triple32(&w->seed);
+        uint32_t index = w->seed % MAP_BENCH_KEYS, key = BenchScatter(index), value = 0;
+        bool found;
+        if (w->locked != nullptr) {
+            void* ptr;
+            SDL_AtomicLock(&MAP_BENCH_LOCK);
+            found = HashMapGet(w->locked, &key, &ptr);
+            if (found) value = *(uint32_t*)ptr;
+            SDL_AtomicUnlock(&MAP_BENCH_LOCK);
+        } else {
+            found = ConcurrentHashMapGet(w->shared, &key, &value);
+        }
+        if (!found || value != index * 3) w->errors++;
+    }
+    w->ticks = SDL_GetPerformanceCounter() - start;
+    w->operations = MAP_BENCH_LOOKUPS;
+    return 0;
+}
+
+// Put new keys in batches until the readers are done, removing each one again once `MAP_BENCH_WINDOW` newer keys are in
+int MapBenchWriter(void* data) {
+    auto w = (MapBenchWorker*)data;
+    uint32_t next = MAP_BENCH_KEYS;
+    while (SDL_AtomicGet(&MAP_BENCH_DONE) == 0) {
+        uint32_t key = BenchScatter(next), value = next * 3, old = BenchScatter(next - MAP_BENCH_WINDOW);
+        bool expire = next >= MAP_BENCH_KEYS + MAP_BENCH_WINDOW, ok;
+        if (w->locked != nullptr) {
+            SDL_AtomicLock(&MAP_BENCH_LOCK);
+            ok = HashMapPut(w->locked, &key, &value, false);
+            if (expire) ok = HashMapRemove(w->locked, &old) && ok;
+            SDL_AtomicUnlock(&MAP_BENCH_LOCK);
+        } else {
+            ok = ConcurrentHashMapPut(w->shared, &key, &value, false);
+            if (expire) ok = ConcurrentHashMapRemove(w->shared, &old) && ok;
+        }
+        if (!ok) w->errors++;
+        next++;
+        if ((++w->operations & 63) == 0) SDL_Delay(0); // let readers in, as a cache writer would between batches
+    }
+    return 0;
+}
+
+// Reader scaling with one writer: a hash map behind a spin lock against the concurrent hash map.
+// Readers look up keys that are always present, while the writer keeps putting and removing others.
+bool HashMapConcurrentBenchmark() {
+    const int readerCounts[] = {1, 2, 4, MAP_BENCH_MAX_READERS};
+    const char* names[] = {"locked", "concurrent"};
+    auto frequency = (double)SDL_GetPerformanceFrequency();
+    bool allOk = true;
+
+    std::cout << "Hash map with one writer, " << MAP_BENCH_KEYS << " keys (ns per lookup in each reader; lookups per us over all readers; writes):\n";
+    for (int mode = 0; mode < 2; mode++) {
+        for (auto readers : readerCounts) {
+            auto a = NewArena(256 MEGABYTES);
+            MapBenchWorker writer = {};
+            if (mode == 0) writer.locked = HashMapAllocateArena(a, 64, sizeof(uint32_t), sizeof(uint32_t), HashMapIntKeyCompare, HashMapIntKeyHash);
+            else writer.shared = ConcurrentHashMapAllocateArena(a, 64, sizeof(uint32_t), sizeof(uint32_t), HashMapIntKeyCompare, HashMapIntKeyHash);
+            if (writer.locked == nullptr && writer.shared == nullptr) return false;
+
+            for (uint32_t i = 0; i < MAP_BENCH_KEYS; i++) {
+                uint32_t key = BenchScatter(i), value = i * 3;
+                if (mode == 0) HashMapPut(writer.locked, &key, &value, false);
+                else ConcurrentHashMapPut(writer.shared, &key, &value, false);
+            }
+
+            SDL_AtomicSet(&MAP_BENCH_DONE, 0);
+            MapBenchWorker workers[MAP_BENCH_MAX_READERS];
+            SDL_Thread* threads[MAP_BENCH_MAX_READERS];
+            auto writerThread = SDL_CreateThread(MapBenchWriter, "MapWriter", &writer);
+            auto start = SDL_GetPerformanceCounter();
+            for (int i = 0; i < readers; i++) {
+                workers[i] = MapBenchWorker{writer.locked, writer.shared, (uint32_t)(i + 1) * 7919, 0, 0, 0};
+                threads[i] = SDL_CreateThread(MapBenchReader, "MapReader", &workers[i]);
+            }
+
+            int errors = 0;
+            uint64_t ticks = 0;
+            for (int i = 0; i < readers; i++) {
+                SDL_WaitThread(threads[i], nullptr);
+                errors += workers[i].errors;
+                ticks += workers[i].ticks;
+            }
+            auto wall = SDL_GetPerformanceCounter() - start;
+            SDL_AtomicSet(&MAP_BENCH_DONE, 1);
+            SDL_WaitThread(writerThread, nullptr);
+            errors += writer.errors;
+            allOk = allOk && errors == 0;
+
+            auto ns = ticks * 1.0e9 / frequency / ((double)readers * MAP_BENCH_LOOKUPS);
+            auto perUs = (double)readers * MAP_BENCH_LOOKUPS / (wall * 1.0e6 / frequency);
+            std::cout << "  " << names[mode] << ", " << readers << " readers: " << ns << "; " << perUs << "; " << writer.operations
+                      << (errors == 0 ? "" : " (FAILED)") << "\n";
+
+            if (mode == 0) HashMapDeallocate(writer.locked);
+            else ConcurrentHashMapDeallocate(writer.shared);
+            DropArena(&a);
+        }
+    }
+    return allOk;
+}
+
 bool RunTest(DrawTarget *draw, int index){
     switch (index) {
         case 0: return RandomNumberTest(draw);
+        case 1: return ArenaFillBenchmark();
+        case 2: return ArenaConcurrentBenchmark();
+        case 3: return VectorSortBenchmark();
+        case 4: return VectorParallelSortBenchmark();
+        case 5: return VectorFifoBenchmark();
+        case 6: return TypedContainerBenchmark();
+        case 7: return TinyVectorBenchmark();
+        case 8: return RawDataBenchmark();
+        case 9: return HashMapGroupedBenchmark();
+        case 10: return HashMapLoadBenchmark();
+        case 11: return HashMapResizeLatencyBenchmark();
+        case 12: return HashMapConcurrentBenchmark();
 
         default: return false;
     }
@@ -0,0 +1,287 @@
+// Offline analyzer for arena trace files, written by `ArenaTraceWrite`.
+// Reports allocation lifetimes and hot allocation sites, and which sites hold zones open
+// long after everything else in them was released (the usual cause of arena fragmentation).
+//
+// Usage: ArenaTraceReport <trace file> [number of sites to list]
+
+#include "src/types/ArenaAllocator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Totals for one call site
+typedef struct SiteStats {
+    uint32_t allocations;
+    uint64_t bytes;
+    uint32_t finished;          // allocations whose last reference was dropped inside the trace
+    uint64_t totalLifetime;     // nanoseconds, over `finished` allocations
+    uint64_t maxLifetime;
+    uint32_t pinnedZones;       // zones where this site's allocation was the last one left
+    uint64_t pinnedTime;        // nanoseconds those zones spent holding only that allocation
+    uint64_t pinnedBytes;       // bytes held by those zones while pinned
+} SiteStats;
+
+// Reference tracking for one zone while replaying the trace
+typedef struct ZoneTrack {
+    int32_t refs;
+    uint32_t fill;              // bytes allocated since the zone was last empty
+    uint64_t pinStart;          // time the zone dropped to a single reference, or 0
+    uint16_t lastSite;          // site of the most recent dereference
+} ZoneTrack;
+
+static const char TRACE_MAGIC[8] = "ArenaTr";
+
+static ArenaTraceEvent* EVENTS = nullptr;
+static uint32_t EVENT_COUNT = 0;
+static char** SITES = nullptr;      // SITES[i] is the name of site index i. SITES[0] is untagged
+static uint32_t SITE_COUNT = 0;     // including the untagged entry
+static uint32_t DROPPED_COUNT = 0;
+
+FILE* OpenRead(const char* path) {
+#ifdef _WIN32
+    FILE* f = nullptr;
+    if (fopen_s(&f, path, "rb") != 0) return nullptr;
+    return f;
+#else
+    return fopen(path, "rb");
+#endif
+}
+
+// Read the whole trace file into EVENTS and SITES
+bool LoadTrace(const char* path) {
+    auto f = OpenRead(path);
+    if (f == nullptr) {
+        std::cout << "Could not open " << path << "\n";
+        return false;
+    }
+
+    ArenaTraceFileHeader header = {};
+    bool ok = fread(&header, sizeof(header), 1, f) == 1
+            && memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) == 0
+            && header.version == ARENA_TRACE_FILE_VERSION;
+
+    if (ok) {
+        SITE_COUNT = header.siteCount + 1;
+        SITES = (char**)calloc(SITE_COUNT, sizeof(char*));
+        ok = SITES != nullptr;
+    }
+    for (uint32_t i = 1; ok && i < SITE_COUNT; i++) {
+        uint16_t length = 0;
+        ok = fread(&length, sizeof(length), 1, f) == 1;
+        if (ok) SITES[i] = (char*)calloc((size_t)length + 1, 1);
+        if (ok) ok = SITES[i] != nullptr && fread(SITES[i], 1, length, f) == length;
+    }
+
+    if (ok) {
+        EVENT_COUNT = header.eventCount;
+        DROPPED_COUNT = header.droppedCount;
+        EVENTS = (ArenaTraceEvent*)calloc((size_t)EVENT_COUNT + 1, sizeof(ArenaTraceEvent));
+        ok = EVENTS != nullptr && fread(EVENTS, sizeof(ArenaTraceEvent), EVENT_COUNT, f) == EVENT_COUNT;
+    }
+    fclose(f);
+
+    if (!ok) std::cout << path << " is not a valid arena trace\n";
+    return ok;
+}
+
+const char* SiteName(uint16_t site) {
+    if (site == 0 || site >= SITE_COUNT || SITES[site] == nullptr) return "(untagged)";
+    return SITES[site];
+}
+
+// Order pointer events by arena, then offset, then time
+int CompareByAddress(const void* A, const void* B) {
+    auto a = &EVENTS[*(const uint32_t*)A];
+    auto b = &EVENTS[*(const uint32_t*)B];
+    if (a->arena != b->arena) return (a->arena < b->arena) ? -1 : 1;
+    if (a->offset != b->offset) return (a->offset < b->offset) ? -1 : 1;
+    if (a->sequence != b->sequence) return (a->sequence < b->sequence) ? -1 : 1;
+    return 0;
+}
+
+// Match each allocation to its references and dereferences, to find lifetimes.
+// Records the owning allocation's site against each dereference in `ownerSite`.
+// Returns the number of allocations still referenced at the end of the trace.
+uint32_t MatchLifetimes(SiteStats* stats, uint16_t* ownerSite) {
+    auto order = (uint32_t*)calloc((size_t)EVENT_COUNT + 1, sizeof(uint32_t));
+    if (order == nullptr) return 0;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < EVENT_COUNT; i++) {
+        auto kind = EVENTS[i].kind;
+        if (kind == ARENA_EVENT_ALLOCATE || kind == ARENA_EVENT_REFERENCE || kind == ARENA_EVENT_DEREFERENCE
+                || kind == ARENA_EVENT_SLAB_ALLOCATE || kind == ARENA_EVENT_SLAB_RELEASE) order[count++] = i;
+    }
+    qsort(order, count, sizeof(uint32_t), CompareByAddress);
+
+    uint32_t live = 0;
+    int open = -1; // event index of the allocation at the current address, or -1
+    int refs = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        auto& e = EVENTS[order[i]];
+        if (i > 0) {
+            auto& prev = EVENTS[order[i - 1]];
+            if (prev.arena != e.arena || prev.offset != e.offset) { // new address
+                if (open >= 0) live++;
+                open = -1;
+            }
+        }
+
+        if (e.kind == ARENA_EVENT_ALLOCATE || e.kind == ARENA_EVENT_SLAB_ALLOCATE) {
+            // A new allocation at an address still in use means the old one went with a reset or dropped arena.
+            open = (int)order[i];
+            refs = 1;
+        } else if (open >= 0 && e.kind == ARENA_EVENT_REFERENCE) {
+            refs++;
+        } else if (open >= 0 && (e.kind == ARENA_EVENT_DEREFERENCE || e.kind == ARENA_EVENT_SLAB_RELEASE)) {
+            auto& start = EVENTS[open];
+            ownerSite[order[i]] = start.site;
+            if (e.kind == ARENA_EVENT_SLAB_RELEASE) refs = 1; // slab objects are never shared
+            if (--refs > 0) continue;
+
+            auto lifetime = e.time - start.time;
+            auto& site = stats[start.site];
+            site.finished++;
+            site.totalLifetime += lifetime;
+            if (lifetime > site.maxLifetime) site.maxLifetime = lifetime;
+            open = -1;
+        }
+    }
+    if (open >= 0) live++;
+
+    free(order);
+    return live;
+}
+
+// Replay zone reference counts in time order, to find allocations that kept otherwise-empty zones alive
+void FindPinnedZones(SiteStats* stats, const uint16_t* ownerSite) {
+    uint32_t arenaLimit = 0, zoneLimit = 0;
+    for (uint32_t i = 0; i < EVENT_COUNT; i++) {
+        if (EVENTS[i].arena >= arenaLimit) arenaLimit = EVENTS[i].arena + 1u;
+        if (EVENTS[i].zone >= 0 && (uint32_t)EVENTS[i].zone >= zoneLimit) zoneLimit = (uint32_t)EVENTS[i].zone + 1;
+    }
+    if (zoneLimit == 0) return;
+
+    auto zones = (ZoneTrack*)calloc((size_t)arenaLimit * zoneLimit, sizeof(ZoneTrack));
+    if (zones == nullptr) return;
+
+    for (uint32_t i = 0; i < EVENT_COUNT; i++) {
+        auto& e = EVENTS[i];
+        if (e.kind == ARENA_EVENT_RESET || e.kind == ARENA_EVENT_DROP) {
+            memset(&zones[(size_t)e.arena * zoneLimit], 0, sizeof(ZoneTrack) * zoneLimit);
+            continue;
+        }
+        if (e.zone < 0) continue;
+
+        auto& zone = zones[((size_t)e.arena * zoneLimit) + e.zone];
+        switch (e.kind) {
+            case ARENA_EVENT_ALLOCATE:
+                zone.refs++;
+                zone.fill += e.size;
+                zone.pinStart = 0;
+                break;
+
+            case ARENA_EVENT_REFERENCE:
+                zone.refs++;
+                zone.pinStart = 0;
+                break;
+
+            case ARENA_EVENT_DEREFERENCE:
+                zone.refs--;
+                zone.lastSite = ownerSite[i];
+                if (zone.refs == 1) zone.pinStart = e.time;
+                break;
+
+            case ARENA_EVENT_RELEASE_ZONE:
+                if (zone.pinStart != 0) { // the last allocation held the zone on its own for a while
+                    auto& site = stats[zone.lastSite];
+                    site.pinnedZones++;
+                    site.pinnedTime += e.time - zone.pinStart;
+                    site.pinnedBytes += zone.fill;
+                }
+                memset(&zone, 0, sizeof(zone));
+                break;
+
+            default: break; // slab objects share their batch's reference, so don't change the count
+        }
+    }
+    free(zones);
+}
+
+static SiteStats* SORT_STATS = nullptr;
+
+int CompareByCount(const void* A, const void* B) {
+    auto a = SORT_STATS[*(const uint16_t*)A].allocations;
+    auto b = SORT_STATS[*(const uint16_t*)B].allocations;
+    return (a == b) ? 0 : ((a > b) ? -1 : 1);
+}
+
+int CompareByPinnedTime(const void* A, const void* B) {
+    auto a = SORT_STATS[*(const uint16_t*)A].pinnedTime;
+    auto b = SORT_STATS[*(const uint16_t*)B].pinnedTime;
+    return (a == b) ? 0 : ((a > b) ? -1 : 1);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: ArenaTraceReport <trace file> [number of sites to list]\n";
+        return 1;
+    }
+    uint32_t listLength = (argc > 2) ? (uint32_t)atoi(argv[2]) : 20;
+    if (!LoadTrace(argv[1])) return 1;
+
+    auto stats = (SiteStats*)calloc(SITE_COUNT, sizeof(SiteStats));
+    auto ownerSite = (uint16_t*)calloc((size_t)EVENT_COUNT + 1, sizeof(uint16_t));
+    auto order = (uint16_t*)calloc(SITE_COUNT, sizeof(uint16_t));
+    if (stats == nullptr || ownerSite == nullptr || order == nullptr) return 1;
+
+    uint64_t totalBytes = 0;
+    uint32_t allocations = 0;
+    for (uint32_t i = 0; i < EVENT_COUNT; i++) {
+        auto& e = EVENTS[i];
+        if (e.kind != ARENA_EVENT_ALLOCATE && e.kind != ARENA_EVENT_SLAB_ALLOCATE) continue;
+        if (e.site >= SITE_COUNT) e.site = 0;
+        stats[e.site].allocations++;
+        stats[e.site].bytes += e.size;
+        totalBytes += e.size;
+        allocations++;
+    }
+    auto live = MatchLifetimes(stats, ownerSite);
+    FindPinnedZones(stats, ownerSite);
+
+    auto span = (EVENT_COUNT > 1) ? EVENTS[EVENT_COUNT - 1].time - EVENTS[0].time : 0;
+    std::cout << EVENT_COUNT << " events over " << (span / 1000000.0) << "ms; " << DROPPED_COUNT << " older events were overwritten.\n";
+    std::cout << allocations << " allocations, " << totalBytes << " bytes; " << live << " still referenced at the end of the trace.\n";
+
+    for (uint32_t i = 0; i < SITE_COUNT; i++) order[i] = (uint16_t)i;
+    SORT_STATS = stats;
+    if (listLength > SITE_COUNT) listLength = SITE_COUNT;
+
+    std::cout << "\nHot allocation sites:\n";
+    qsort(order, SITE_COUNT, sizeof(uint16_t), CompareByCount);
+    for (uint32_t i = 0; i < listLength; i++) {
+        auto& s = stats[order[i]];
+        if (s.allocations == 0) break;
+        std::cout << "    " << SiteName(order[i]) << " -> " << s.allocations << " allocations, " << s.bytes << " bytes";
+        if (s.finished > 0) {
+            std::cout << "; lifetime mean " << (s.totalLifetime / s.finished / 1000.0) << "us, max " << (s.maxLifetime / 1000.0) << "us";
+        }
+        std::cout << "\n";
+    }
+
+    std::cout << "\nSites holding zones open alone (fragmentation):\n";
+    qsort(order, SITE_COUNT, sizeof(uint16_t), CompareByPinnedTime);
+    for (uint32_t i = 0; i < listLength; i++) {
+        auto& s = stats[order[i]];
+        if (s.pinnedZones == 0) break;
+        std::cout << "    " << SiteName(order[i]) << " -> " << s.pinnedZones << " zones, held for " << (s.pinnedTime / 1000000.0)
+                  << "ms in total, " << (s.pinnedBytes / s.pinnedZones) << " bytes per zone kept from reuse\n";
+    }
+
+    free(order);
+    free(ownerSite);
+    free(stats);
+    return 0;
+}
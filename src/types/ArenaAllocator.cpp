@@ -2,21 +2,191 @@
 #include "RawData.h"
 
 #include <cstdlib>
+#include <cstdio>
+#include <atomic>
+
+#ifdef ARENA_TRACE
+#include <chrono>
+#endif
+
+#ifdef ARENA_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "OCUnusedGlobalDeclarationInspection"
-#ifdef ARENA_DEBUG
+#if defined(ARENA_DEBUG) || defined(ARENA_ACCOUNTING)
 #include <iostream>
 #endif
 
+#ifdef ARENA_TAGGED_CALLS
+// the real functions are defined here, the call-site macros are only for users
+#undef ArenaAllocate
+#undef ArenaAllocateAndClear
+#undef ArenaAllocateAligned
+#undef ArenaSlabAllocate
+#undef ArenaSlabAllocateAndClear
+#endif
+
 // maximum number of references in a zone before we give up.
 #define ZONE_MAX_REFS 65000
 
+// ref count value for zones that continue a large allocation from the zone before.
+// References are always counted on the first zone of the run.
+#define ZONE_CONTINUES 0xFFFF
+
+// number of free-space size classes. Class `c` holds zones with [2^c .. 2^(c+1)) bytes free
+#define FREE_CLASS_COUNT 16
+
+// number of slab size classes: 16 byte steps up to 256, then quarter-steps of powers of two up to SLAB_MAX_SIZE
+#define SLAB_CLASS_COUNT 44
+
+// target size of each batch of slab objects taken from the arena
+#define SLAB_BATCH_BYTES 4096
+
+// number of threads that get their own zone in a concurrent arena. Others allocate under the arena lock
+#define ARENA_THREAD_SLOTS 32
+
+// number of handle table entries allocated for an arena's first handle. The table doubles as needed
+#define ARENA_HANDLE_TABLE_START 256
+
+// Snapshot files start with a header padded to this size, so the arena image is page aligned in the file.
+// This is a multiple of every page size we expect to see.
+#define ARENA_SNAPSHOT_HEADER 65536
+
+// Change this if the snapshot header or the arena memory layout changes
+#define ARENA_SNAPSHOT_VERSION 1
+
+// Zone tables are read and written through relaxed atomics, so concurrent arenas are race-free.
+// On the platforms we target these are plain loads and stores.
+static_assert(sizeof(std::atomic<uint16_t>) == sizeof(uint16_t), "zone tables need lock-free 16 bit atomics");
+
+// One entry in an arena's handle table
+typedef struct HandleEntry {
+    uint32_t offset;    // `ArenaPtrToOffset` of the block. For free entries, index of the next free entry
+    uint32_t size;      // size of the block. Zero if the entry is free
+} HandleEntry;
+
+// Header at the start of each batch of slab objects. The objects follow at `SLAB_HEADER_BYTES`
+typedef struct SlabBatch {
+    SlabBatch* nextInZone;  // other batches starting in the same zone, for finding the batch of a released pointer
+    SlabBatch* nextPartial; // batches of the same class that have free objects
+    SlabBatch* prevPartial;
+    void* freeList;         // singly linked list of free objects, next pointer stored in the object
+    uint32_t live;          // objects handed out and not yet released
+    uint32_t count;         // objects in the batch
+    int32_t slabClass;
+} SlabBatch;
+
+// Batch header size, rounded so the objects keep 16 byte alignment
+const size_t SLAB_HEADER_BYTES = (sizeof(SlabBatch) + 15) & ~(size_t)15;
+
+// One size class of the slab allocator
+typedef struct SlabClass {
+    SlabBatch* partial;     // batches with free objects. Full batches are only found through the zone index
+    uint32_t carved;        // number of objects taken from the arena
+    uint32_t live;          // number of objects handed out and not yet released
+    size_t requestedBytes;  // total size requested by live objects (the rest of their class size is wasted)
+} SlabClass;
+
+#ifdef ARENA_TAGGED_CALLS
+// set by `ArenaSiteEnter` for the duration of a tagged call. The outermost call's site is kept
+static thread_local const char* CURRENT_SITE = nullptr;
+
+// site that slab batches are recorded against, so they aren't mistaken for the object that caused the refill
+static const char* SLAB_BATCH_SITE = "(slab batches)";
+#endif
+
+#ifdef ARENA_TRACE
+// number of events kept in the trace ring buffer. Must be a power of two
+#define ARENA_TRACE_CAPACITY 65536
+
+// number of distinct call sites in traces. Extra sites are recorded as untagged
+#define ARENA_TRACE_SITE_COUNT 1024
+
+static ArenaTraceEvent TRACE_RING[ARENA_TRACE_CAPACITY];
+static std::atomic<uint32_t> TRACE_NEXT(0);   // number of events ever recorded. The next slot to write
+static std::atomic<const char*> TRACE_SITES[ARENA_TRACE_SITE_COUNT]; // site 0 is never used
+static std::atomic<int> NEXT_TRACE_ID(1);
+
+// Find or add the index of a call site tag. Tags are string literals, so compared by pointer
+uint16_t TraceSiteIndex(const char* site) {
+    if (site == nullptr) return 0;
+    auto start = (unsigned)(((size_t)site >> 3) % (ARENA_TRACE_SITE_COUNT - 1));
+    for (unsigned i = 0; i < ARENA_TRACE_SITE_COUNT - 1; i++) {
+        auto index = 1 + (start + i) % (ARENA_TRACE_SITE_COUNT - 1);
+        auto& entry = TRACE_SITES[index];
+        auto existing = entry.load(std::memory_order_acquire);
+        if (existing == nullptr && entry.compare_exchange_strong(existing, site)) return (uint16_t)index;
+        if (existing == site) return (uint16_t)index;
+    }
+    return 0; // table full
+}
+
+// Write an event into the next slot of the ring buffer. Safe to call from many threads
+void TraceRecord(uint16_t arenaId, uint8_t kind, uint32_t offset, int zone, size_t size) {
+    auto sequence = TRACE_NEXT.fetch_add(1, std::memory_order_relaxed) + 1;
+    auto& slot = TRACE_RING[(sequence - 1) & (ARENA_TRACE_CAPACITY - 1)];
+    auto& slotSequence = *(std::atomic<uint32_t>*)&slot.sequence;
+
+    slotSequence.store(0, std::memory_order_relaxed); // mark as being written
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.time = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    slot.offset = offset;
+    slot.size = (uint32_t)size;
+    slot.zone = zone;
+    slot.arena = arenaId;
+    slot.site = TraceSiteIndex(CURRENT_SITE);
+    slot.kind = kind;
+    slotSequence.store(sequence, std::memory_order_release); // complete
+}
+#endif
+
+#ifdef ARENA_ACCOUNTING
+// number of distinct call sites we track. Extra sites are not itemised, but still counted in the total
+#define ACCOUNTING_SITE_COUNT 256
+
+typedef struct AccountingSite {
+    const char* site;   // call site tag (a string literal, so compared by pointer)
+    uint32_t count;     // number of allocations
+    size_t bytes;       // total bytes requested
+} AccountingSite;
+
+// Counted per thread, to match the per-thread frames of MemoryManager
+static thread_local AccountingSite ACCOUNT_SITES[ACCOUNTING_SITE_COUNT];
+static thread_local int ACCOUNT_SYSTEM_CALLS = 0;
+static thread_local int ACCOUNT_ARENA_CALLS = 0;
+
+// Record a successful arena allocation against the current call site
+void AccountArenaAllocation(size_t byteCount) {
+    ACCOUNT_ARENA_CALLS++;
+
+    auto site = (CURRENT_SITE == nullptr) ? "(untagged)" : CURRENT_SITE;
+    auto start = (unsigned)(((size_t)site >> 3) % ACCOUNTING_SITE_COUNT);
+    for (unsigned i = 0; i < ACCOUNTING_SITE_COUNT; i++) {
+        auto& entry = ACCOUNT_SITES[(start + i) % ACCOUNTING_SITE_COUNT];
+        if (entry.site != nullptr && entry.site != site) continue; // probe further
+
+        entry.site = site;
+        entry.count++;
+        entry.bytes += byteCount;
+        return;
+    }
+}
+#endif
+
 typedef struct Arena {
 #ifdef ARENA_DEBUG
-    // Diagnostic marker
+    // Diagnostic marker. Events are traced for marked arenas
     bool _marked;
 #endif
+#ifdef ARENA_TRACE
+    // Arena id in trace events
+    uint16_t _traceId;
+#endif
 
     // Bottom of free memory (after arena management is taken up)
     void* _start;
@@ -26,40 +196,118 @@ typedef struct Arena {
 
     // Pointer to array of ushort, length is equal to _zoneCount.
     // Each element is offset of next pointer to allocate. Zero indicates an empty zone.
-    // This is also the base of allocated memory
     uint16_t* _headsPtr;
 
     // Pointer to array of ushort, length is equal to _arenaCount.
     // Each element is number of references claimed against the arena.
     uint16_t* _refCountsPtr;
 
+    // Pointers to arrays of int, length is equal to _zoneCount.
+    // Zones with free space are kept in a doubly linked list per size class (see `FreeClass`).
+    // -1 marks the end of a list.
+    // `_freeNextPtr` is also the base of allocated memory
+    int32_t* _freeNextPtr;
+    int32_t* _freePrevPtr;
+
+    // First zone in each size class list, or -1 if empty
+    int32_t _freeClassHeads[FREE_CLASS_COUNT];
+
+    // Bit `c` is set if size class `c` has any zones
+    uint32_t _freeClassMask;
+
     // The most recent arena that had a successful alloc or clear
     int _currentZone;
 
     // Count of available arenas. This is the limit of memory
     int _zoneCount;
+
+    // Size requested when the arena was created
+    size_t _size;
+
+    // Size of the system memory reservation, starting at `_freeNextPtr`
+    size_t _reservedSize;
+
+    // Free lists and counts for `ArenaSlabAllocate`
+    SlabClass _slabs[SLAB_CLASS_COUNT];
+
+    // First slab batch starting in each zone, so released pointers can be checked. Allocated from the system on first use
+    SlabBatch** _slabZones;
+
+    // If true, the arena can be used from many threads. See `ArenaSetConcurrent`
+    bool _concurrent;
+
+    // Spin lock for the free-space index and slab lists, when concurrent
+    std::atomic<int> _lock;
+
+    // Zone owned by each thread slot, or -1. Only the owning thread bumps that zone's head.
+    // The owner holds one extra reference, so the zone can't be reset under it.
+    int32_t _threadZones[ARENA_THREAD_SLOTS];
+
+    // Next arena in the list of concurrent arenas, so exiting threads can give back their zones
+    Arena* _nextConcurrent;
+
+    // Blocks that `ArenaCompact` can move, indexed by handle-1. Allocated from the system on first use
+    HandleEntry* _handles;
+    uint32_t _handleCapacity;
+    uint32_t _handleUsed;       // entries ever used. Entries beyond this have never been handed out
+    int32_t _handleFree;        // first free entry below `_handleUsed`, or -1
+
+    // Working space for `ArenaCompact`, kept between passes. Zone space is allocated on first use,
+    // and the per-handle moves list only grows when the handle table has grown since the last pass.
+    uint64_t* _compactZones;    // a sort key then three counts per zone
+    uint32_t* _compactMoves;
+    uint32_t _compactMovesCapacity;
+
+    // Running totals for `ArenaGetState`, so it doesn't have to scan the zones.
+    // Only kept while single threaded. They are recounted when leaving concurrent mode.
+    size_t _allocatedBytes;     // sum of all zone heads
+    int _occupiedZones;         // zones with a non-zero head
+    int _totalReferences;       // references held, not counting large allocation continuations
+
+    // Usage since creation or the last reset, for `ArenaGetUsage`
+    size_t _peakAllocatedBytes;
+    uint32_t _allocationCount;
+    size_t _allocationBytes;
 } Arena;
 
+// Record an event if the arena is traced. Compiles to nothing unless ARENA_TRACE is defined
+inline void TraceEvent(Arena* a, uint8_t kind, void* ptr, int zone, size_t size) {
+#ifdef ARENA_TRACE
+    if (!a->_marked) return;
+    auto offset = (ptr == nullptr) ? 0 : (uint32_t)((size_t)ptr - (size_t)a->_start);
+    TraceRecord(a->_traceId, kind, offset, zone, size);
+#else
+    (void)a; (void)kind; (void)ptr; (void)zone; (void)size;
+#endif
+}
+
 // Create a new arena for memory management. Size is the maximum size for the whole
 // arena. Fragmentation may make the usable size smaller. Size should be a multiple of ARENA_ZONE_SIZE
 Arena* NewArena(size_t size) {
     int expectedZoneCount = (int)(size / ARENA_ZONE_SIZE) + 1;
+    auto sizeOfIndex = sizeof(int32_t) * 2 * expectedZoneCount;
 
-    auto realMemory = calloc(1, size + ARENA_ZONE_SIZE);
+    // Data is reserved, but may not be committed until it is used.
+    size_t reservedSize = size + ARENA_ZONE_SIZE + sizeOfIndex;
+    auto realMemory = ArenaSystemReserve(&reservedSize);
     if (realMemory == nullptr) return nullptr;
 
-    auto result = (Arena*)calloc(1, sizeof(Arena));
+    auto result = (Arena*)ArenaSystemAllocateAndClear(sizeof(Arena));
     if (result == nullptr) {
-        free(realMemory);
+        ArenaSystemRelease(realMemory, reservedSize);
         return nullptr;
     }
 
     result->_start = realMemory;
-    result->_limit = byteOffset(realMemory, size - 1);
+    result->_size = size;
+    result->_reservedSize = reservedSize;
     
 #ifdef ARENA_DEBUG
     result->_marked = false;
 #endif
+#ifdef ARENA_TRACE
+    result->_traceId = (uint16_t)NEXT_TRACE_ID.fetch_add(1);
+#endif
 
     // with 64KB arenas (ushort) and 1GB of RAM, we get 16384 arenas.
     // recording only heads and refs would take 64KB of management space
@@ -69,19 +317,19 @@ Arena* NewArena(size_t size) {
     result->_currentZone = 0;
 
     // Allow space for arena tables, store adjusted base
+    // The free-space index goes first, as it needs 4-byte alignment
     auto sizeOfTables = sizeof(uint16_t) * result->_zoneCount;
-    result->_headsPtr = (uint16_t*)result->_start;
-    result->_refCountsPtr = (uint16_t*)byteOffset(result->_start, sizeOfTables);
+    auto sizeOfLinks = sizeof(int32_t) * result->_zoneCount;
+    result->_freeNextPtr = (int32_t*)result->_start;
+    result->_freePrevPtr = (int32_t*)byteOffset(result->_start, sizeOfLinks);
+    result->_headsPtr = (uint16_t*)byteOffset(result->_start, sizeOfLinks * 2);
+    result->_refCountsPtr = (uint16_t*)byteOffset(result->_headsPtr, sizeOfTables);
 
     // shrink space for headers
-    result->_start = byteOffset(result->_start, sizeOfTables * 2);
+    result->_start = byteOffset(result->_headsPtr, sizeOfTables * 2);
+    result->_limit = byteOffset(result->_start, ((size_t)result->_zoneCount * ARENA_ZONE_SIZE) - 1);
 
-    // zero-out the tables
-    auto zeroPtr = result->_headsPtr;
-    while (zeroPtr < result->_start) {
-        writeUshort(zeroPtr, 0, 0);
-        zeroPtr += 1;
-    }
+    ArenaReset(result); // zero-out the tables and build the free-space index
 
     return result;
 }
@@ -93,20 +341,238 @@ void DropArena(Arena** a) {
     auto ptr = *a;
 	*a = nullptr; // kill the arena reference
     if (ptr == nullptr) return;
+    TraceEvent(ptr, ARENA_EVENT_DROP, nullptr, -1, 0);
+    ArenaSetConcurrent(ptr, false); // so exiting threads no longer look at it
 
-    if (ptr->_headsPtr != nullptr) { // delete contained memory
-        free(ptr->_headsPtr);
+    if (ptr->_freeNextPtr != nullptr) { // delete contained memory. The free index is at the base of the allocation
+        ArenaSystemRelease(ptr->_freeNextPtr, ptr->_reservedSize);
+        ptr->_freeNextPtr = nullptr;
+        ptr->_freePrevPtr = nullptr;
         ptr->_headsPtr = nullptr;
         ptr->_start = nullptr;
         ptr->_limit = nullptr;
     }
 
-    free(ptr); // Free the arena reference itself
+    ArenaSystemFree(ptr->_handles);
+    ArenaSystemFree(ptr->_compactZones);
+    ArenaSystemFree(ptr->_compactMoves);
+    ArenaSystemFree(ptr->_slabZones);
+    ArenaSystemFree(ptr); // Free the arena reference itself
+}
+
+// Release every allocation in the arena at once, keeping its memory for reuse
+void ArenaReset(Arena* a) {
+    if (a == nullptr) return;
+    TraceEvent(a, ARENA_EVENT_RESET, nullptr, -1, 0);
+
+    // heads and ref counts are adjacent, so we can clear both in one pass
+    auto zeroPtr = a->_headsPtr;
+    auto end = a->_headsPtr + (a->_zoneCount * 2);
+    while (zeroPtr < end) {
+        writeUshort(zeroPtr, 0, 0);
+        zeroPtr += 1;
+    }
+    a->_currentZone = 0;
+
+    // every zone is empty, so they all go in the top size class, in address order
+    for (int i = 0; i < FREE_CLASS_COUNT; i++) a->_freeClassHeads[i] = -1;
+    auto zoneCount = a->_zoneCount;
+    for (int i = 0; i < zoneCount; i++) {
+        a->_freePrevPtr[i] = i - 1;
+        a->_freeNextPtr[i] = (i + 1 < zoneCount) ? i + 1 : -1;
+    }
+    if (zoneCount > 0) {
+        a->_freeClassHeads[FREE_CLASS_COUNT - 1] = 0;
+        a->_freeClassMask = 1u << (FREE_CLASS_COUNT - 1);
+    } else {
+        a->_freeClassMask = 0;
+    }
+
+    // no thread owns any zone now, and none can be holding the lock
+    for (auto& zone : a->_threadZones) zone = -1;
+    a->_lock.store(0, std::memory_order_relaxed);
+
+    // slab objects were all in zones we just cleared
+    for (auto& slab : a->_slabs) {
+        slab.partial = nullptr;
+        slab.carved = 0;
+        slab.live = 0;
+        slab.requestedBytes = 0;
+    }
+    if (a->_slabZones != nullptr) {
+        for (int i = 0; i < zoneCount; i++) a->_slabZones[i] = nullptr;
+    }
+
+    // every handle's block is gone. Keep the table for reuse
+    a->_handleUsed = 0;
+    a->_handleFree = -1;
+
+    a->_allocatedBytes = 0;
+    a->_occupiedZones = 0;
+    a->_totalReferences = 0;
+    a->_peakAllocatedBytes = 0;
+    a->_allocationCount = 0;
+    a->_allocationBytes = 0;
+}
+
+size_t ArenaGetSize(Arena* a) {
+    if (a == nullptr) return 0;
+    return a->_size;
 }
 
 void TraceArena(Arena* a, bool traceOn) {
 #ifdef ARENA_DEBUG
-    a->_marked = traceOn;
+    if (a != nullptr) a->_marked = traceOn;
+#else
+    (void)a; (void)traceOn;
+#endif
+}
+
+void* ArenaSystemAllocate(size_t byteCount) {
+#ifdef ARENA_ACCOUNTING
+    ACCOUNT_SYSTEM_CALLS++;
+#endif
+    return malloc(byteCount);
+}
+
+void* ArenaSystemAllocateAndClear(size_t byteCount) {
+#ifdef ARENA_ACCOUNTING
+    ACCOUNT_SYSTEM_CALLS++;
+#endif
+    return calloc(1, byteCount);
+}
+
+void ArenaSystemFree(void* ptr) {
+    if (ptr == nullptr) return;
+#ifdef ARENA_ACCOUNTING
+    ACCOUNT_SYSTEM_CALLS++;
+#endif
+    free(ptr);
+}
+
+#ifdef ARENA_MMAP
+// Size of the pages in normal mappings
+size_t SystemPageSize() {
+    static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE); // read once, thread-safe
+    return pageSize;
+}
+#endif
+
+void* ArenaSystemReserve(size_t* byteCount) {
+    if (byteCount == nullptr) return nullptr;
+#ifdef ARENA_ACCOUNTING
+    ACCOUNT_SYSTEM_CALLS++;
+#endif
+#ifdef ARENA_MMAP
+#if defined(ARENA_HUGE_PAGES) && defined(MAP_HUGETLB)
+    // huge page mappings must be a whole number of huge pages. Assume 2MB pages.
+    // No MAP_NORESERVE here: we want this to fail if the huge page pool is short, rather than fault on first touch
+    size_t hugeSize = (*byteCount + (2 MEGABYTES) - 1) & ~(size_t)((2 MEGABYTES) - 1);
+    auto huge = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (huge != MAP_FAILED) {
+        *byteCount = hugeSize;
+        return huge;
+    }
+#endif
+    auto pageSize = SystemPageSize();
+    size_t mapSize = (*byteCount + pageSize - 1) & ~(pageSize - 1);
+    auto mem = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) return nullptr;
+
+#if defined(ARENA_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+    madvise(mem, mapSize, MADV_HUGEPAGE); // transparent huge pages. Only advice, so we don't care if this fails
+#endif
+    *byteCount = mapSize;
+    return mem;
+#else
+    return calloc(1, *byteCount);
+#endif
+}
+
+void ArenaSystemRelease(void* ptr, size_t byteCount) {
+    if (ptr == nullptr) return;
+#ifdef ARENA_ACCOUNTING
+    ACCOUNT_SYSTEM_CALLS++;
+#endif
+#ifdef ARENA_MMAP
+    munmap(ptr, byteCount);
+#else
+    free(ptr);
+#endif
+}
+
+// Return the memory of a run of empty zones to the OS. It will read as zeros if touched again.
+// Does nothing unless ARENA_RELEASE_EMPTY_ZONES is defined
+void ReleaseZoneMemory(Arena* a, int zone, int count) {
+#if defined(ARENA_MMAP) && defined(ARENA_RELEASE_EMPTY_ZONES)
+    // zones don't line up with pages, so only release pages entirely inside the run
+    auto pageSize = SystemPageSize();
+    auto low = (size_t)byteOffset(a->_start, (size_t)zone * ARENA_ZONE_SIZE);
+    auto high = low + ((size_t)count * ARENA_ZONE_SIZE);
+    low = (low + pageSize - 1) & ~(pageSize - 1);
+    high = high & ~(pageSize - 1);
+    if (high <= low) return;
+
+    madvise((void*)low, high - low, MADV_DONTNEED); // huge page mappings will refuse this. That's fine.
+#else
+    (void)a; (void)zone; (void)count;
+#endif
+}
+
+const char* ArenaSiteEnter(const char* site) {
+#ifdef ARENA_TAGGED_CALLS
+    auto outer = CURRENT_SITE;
+    if (outer == nullptr) CURRENT_SITE = site;
+    return outer;
+#else
+    (void)site;
+    return nullptr;
+#endif
+}
+
+void ArenaSiteLeave(const char* outerSite) {
+#ifdef ARENA_TAGGED_CALLS
+    CURRENT_SITE = outerSite;
+#else
+    (void)outerSite;
+#endif
+}
+
+void ArenaAccountingReset() {
+#ifdef ARENA_ACCOUNTING
+    ACCOUNT_SYSTEM_CALLS = 0;
+    ACCOUNT_ARENA_CALLS = 0;
+    for (auto& entry : ACCOUNT_SITES) {
+        entry.site = nullptr;
+        entry.count = 0;
+        entry.bytes = 0;
+    }
+#endif
+}
+
+int ArenaAccountingSystemCalls() {
+#ifdef ARENA_ACCOUNTING
+    return ACCOUNT_SYSTEM_CALLS;
+#else
+    return 0;
+#endif
+}
+
+int ArenaAccountingArenaCalls() {
+#ifdef ARENA_ACCOUNTING
+    return ACCOUNT_ARENA_CALLS;
+#else
+    return 0;
+#endif
+}
+
+void ArenaAccountingReport() {
+#ifdef ARENA_ACCOUNTING
+    std::cout << "System allocator calls: " << ACCOUNT_SYSTEM_CALLS << "; arena allocations: " << ACCOUNT_ARENA_CALLS << "\n";
+    for (auto& entry : ACCOUNT_SITES) {
+        if (entry.site == nullptr) continue;
+        std::cout << "    " << entry.site << " -> " << entry.count << " allocations, " << entry.bytes << " bytes\n";
+    }
 #endif
 }
 
@@ -115,7 +581,7 @@ void* MakePermanent(void* data, size_t length) {
     if (length < 1) return nullptr;
     if (data == nullptr) return nullptr;
 
-    void* perm = malloc(length);
+    void* perm = ArenaSystemAllocate(length);
     if (perm == nullptr) return nullptr;
 
     copyAnonArray(perm, 0, data, 0, length);
@@ -138,53 +604,424 @@ void* CopyToArena(void* srcData, size_t length, Arena* target) {
 }
 
 
+inline std::atomic<uint16_t>& HeadOf(Arena* a, int zoneIndex) {
+    return ((std::atomic<uint16_t>*)a->_headsPtr)[zoneIndex];
+}
+inline std::atomic<uint16_t>& RefCountOf(Arena* a, int zoneIndex) {
+    return ((std::atomic<uint16_t>*)a->_refCountsPtr)[zoneIndex];
+}
+
 uint16_t GetHead(Arena* a, int zoneIndex) {
-    return readUshort(a->_headsPtr, zoneIndex * sizeof(uint16_t));
+    return HeadOf(a, zoneIndex).load(std::memory_order_relaxed);
 }
 uint16_t GetRefCount(Arena* a, int zoneIndex) {
-    return readUshort(a->_refCountsPtr, zoneIndex * sizeof(uint16_t));
+    return RefCountOf(a, zoneIndex).load(std::memory_order_relaxed);
 }
 void SetHead(Arena* a, int zoneIndex, uint16_t val) {
-    writeUshort(a->_headsPtr, zoneIndex * sizeof(uint16_t), val);
+    HeadOf(a, zoneIndex).store(val, std::memory_order_relaxed);
 }
 void SetRefCount(Arena* a, int zoneIndex, uint16_t val) {
-    writeUshort(a->_refCountsPtr, zoneIndex * sizeof(uint16_t), val);
+    RefCountOf(a, zoneIndex).store(val, std::memory_order_relaxed);
 }
 
-// Allocate memory of the given size
-void* ArenaAllocate(Arena* a, size_t byteCount) {
-    if (byteCount > ARENA_ZONE_SIZE) return nullptr; // Invalid allocation -- beyond max size.
-    if (a == nullptr) return nullptr;
+// Move a zone's head, keeping the running totals up to date but not the peak
+inline void ShiftHead(Arena* a, int zoneIndex, uint16_t oldHead, uint16_t newHead) {
+    SetHead(a, zoneIndex, newHead);
+    a->_allocatedBytes = a->_allocatedBytes + newHead - oldHead;
+    a->_occupiedZones += (newHead > 0) - (oldHead > 0);
+}
 
-#ifdef ARENA_DEBUG
-    if (a->_marked) {
-        std::cout << "A@" << a->_headsPtr << ";S" << byteCount << "\n";
-    }
+// Move a zone's head, keeping the running totals and peak up to date
+inline void MoveHead(Arena* a, int zoneIndex, uint16_t oldHead, uint16_t newHead) {
+    ShiftHead(a, zoneIndex, oldHead, newHead);
+    if (a->_allocatedBytes > a->_peakAllocatedBytes) a->_peakAllocatedBytes = a->_allocatedBytes;
+}
+
+// Count a successful allocation in the usage totals
+inline void CountAllocation(Arena* a, size_t byteCount) {
+    a->_totalReferences++;
+    a->_allocationCount++;
+    a->_allocationBytes += byteCount;
+#ifdef ARENA_ACCOUNTING
+    AccountArenaAllocation(byteCount);
 #endif
+}
+
+// Rebuild the running totals from the zone tables
+void RecountState(Arena* a) {
+    a->_allocatedBytes = 0;
+    a->_occupiedZones = 0;
+    a->_totalReferences = 0;
+    for (int i = 0; i < a->_zoneCount; i++) {
+        auto head = GetHead(a, i);
+        auto refs = GetRefCount(a, i);
+        a->_allocatedBytes += head;
+        if (head > 0) a->_occupiedZones++;
+        if (refs != ZONE_CONTINUES) a->_totalReferences += refs;
+    }
+    if (a->_allocatedBytes > a->_peakAllocatedBytes) a->_peakAllocatedBytes = a->_allocatedBytes;
+}
 
+// Take the arena lock if the arena is concurrent. Single threaded arenas never lock.
+inline void ArenaLock(Arena* a) {
+    if (!a->_concurrent) return;
+    while (a->_lock.exchange(1, std::memory_order_acquire) != 0) {}
+}
+inline void ArenaUnlock(Arena* a) {
+    if (!a->_concurrent) return;
+    a->_lock.store(0, std::memory_order_release);
+}
+
+// Size class for a number of free bytes: the index of the highest set bit. -1 if there are none.
+inline int FreeClass(uint32_t freeBytes) {
+    int c = -1;
+    while (freeBytes > 0) {
+        c++;
+        freeBytes >>= 1;
+    }
+    return c;
+}
+
+void FreeIndexRemove(Arena* a, int zone, int freeClass) {
+    if (freeClass < 0) return; // full zones are not indexed
+    auto prev = a->_freePrevPtr[zone];
+    auto next = a->_freeNextPtr[zone];
+
+    if (prev >= 0) a->_freeNextPtr[prev] = next;
+    else a->_freeClassHeads[freeClass] = next;
+    if (next >= 0) a->_freePrevPtr[next] = prev;
+
+    if (a->_freeClassHeads[freeClass] < 0) a->_freeClassMask &= ~(1u << freeClass);
+}
+
+void FreeIndexInsert(Arena* a, int zone, int freeClass) {
+    if (freeClass < 0) return; // full zones are not indexed
+    auto next = a->_freeClassHeads[freeClass];
+
+    a->_freePrevPtr[zone] = -1;
+    a->_freeNextPtr[zone] = next;
+    if (next >= 0) a->_freePrevPtr[next] = zone;
+
+    a->_freeClassHeads[freeClass] = zone;
+    a->_freeClassMask |= 1u << freeClass;
+}
+
+// Move a zone between size classes after its head has changed
+inline void FreeIndexUpdate(Arena* a, int zone, uint16_t oldHead, uint16_t newHead) {
+    auto oldClass = FreeClass(ARENA_ZONE_SIZE - oldHead);
+    auto newClass = FreeClass(ARENA_ZONE_SIZE - newHead);
+    if (oldClass == newClass) return;
+
+    FreeIndexRemove(a, zone, oldClass);
+    FreeIndexInsert(a, zone, newClass);
+}
+
+// Find a zone with at least `byteCount` free, using the size class index. Returns -1 if none.
+int FindZoneWithSpace(Arena* a, size_t byteCount) {
     auto maxOff = ARENA_ZONE_SIZE - byteCount;
+    auto needClass = FreeClass((uint32_t)byteCount);
+
+    // any zone in a higher class is big enough. Pick the smallest class to keep big gaps for big requests
+    uint32_t bigEnough = (needClass + 1 >= FREE_CLASS_COUNT) ? 0 : (a->_freeClassMask >> (needClass + 1));
+    if (bigEnough != 0) {
+        int c = needClass + 1;
+        while ((bigEnough & 1) == 0) {
+            bigEnough >>= 1;
+            c++;
+        }
+        return a->_freeClassHeads[c];
+    }
+
+    // zones in the same class might fit, but we have to check each one
+    if (needClass < 0) needClass = 0; // zero-byte request. Any indexed zone will do
+    for (int zone = a->_freeClassHeads[needClass]; zone >= 0; zone = a->_freeNextPtr[zone]) {
+        if (GetHead(a, zone) <= maxOff) return zone;
+    }
+    return -1;
+}
+
+// Find a zone with room for `byteCount`, that can take another reference. Returns -1 if none.
+int SelectZone(Arena* a, size_t byteCount) {
+    auto i = FindZoneWithSpace(a, byteCount);
+
+    // a zone full of tiny allocations can run out of references before it runs out of space.
+    // Close it off so the reference count can't reach ZONE_CONTINUES
+    while (i >= 0 && GetRefCount(a, i) >= ZONE_MAX_REFS) {
+        FreeIndexUpdate(a, i, GetHead(a, i), ARENA_ZONE_SIZE);
+        MoveHead(a, i, GetHead(a, i), ARENA_ZONE_SIZE);
+        i = FindZoneWithSpace(a, byteCount);
+    }
+    return i;
+}
+
+// Allocate from the head of a zone, skipping `padding` bytes first. The zone must have room.
+void* ClaimInZone(Arena* a, int i, size_t padding, size_t byteCount) {
+    a->_currentZone = i;
+    auto oldHead = GetHead(a, i);
+    auto result = oldHead + padding; // new pointer
+    auto newHead = (uint16_t) (result + byteCount);
+    MoveHead(a, i, oldHead, newHead); // advance pointer to end of allocated data
+    FreeIndexUpdate(a, i, oldHead, newHead);
+
+    auto oldRefs = GetRefCount(a, i);
+    SetRefCount(a, i, oldRefs + 1); // increase arena ref count
+
+    CountAllocation(a, byteCount);
+    auto ptr = byteOffset(a->_start, result + ((size_t)i * ARENA_ZONE_SIZE)); // turn the offset into an absolute position
+    TraceEvent(a, ARENA_EVENT_ALLOCATE, ptr, i, byteCount);
+    return ptr;
+}
+
+// Allocate a run of contiguous empty zones, for requests bigger than a single zone.
+// For alignments over 1, `byteCount` must already include room for padding.
+void* ArenaAllocateLarge(Arena* a, size_t byteCount, size_t alignment) {
+    auto zonesNeeded = (int)((byteCount + ARENA_ZONE_SIZE - 1) / ARENA_ZONE_SIZE);
     auto zoneCount = a->_zoneCount;
 
-    // scan for first arena where there is enough room
-    // we can either start from scratch each time, start from last success, or last emptied
-    for (int seq = 0; seq < zoneCount; seq++) {
-        auto i = (seq + a->_currentZone) % zoneCount; // simple scan from last active, looping back if needed
+    // find the first run of empty zones that is long enough
+    int runStart = 0;
+    int runLength = 0;
+    for (int i = 0; i < zoneCount && runLength < zonesNeeded; i++) {
+        if (GetHead(a, i) != 0 || GetRefCount(a, i) != 0) { // zones can have references but no data, if owned by a thread
+            runStart = i + 1;
+            runLength = 0;
+        } else {
+            runLength++;
+        }
+    }
+    if (runLength < zonesNeeded) return nullptr; // no space -- too fragmented, or out of memory
 
-        if (GetHead(a, i) > maxOff) continue; // no room in this slot
+    // mark the run as full, with the references held by the first zone
+    for (int i = runStart; i < runStart + zonesNeeded; i++) {
+        FreeIndexUpdate(a, i, 0, ARENA_ZONE_SIZE);
+        MoveHead(a, i, 0, ARENA_ZONE_SIZE);
+        SetRefCount(a, i, ZONE_CONTINUES);
+    }
+    SetRefCount(a, runStart, 1);
 
-        // found a slot where it will fit
-        a->_currentZone = i;
-        size_t result = GetHead(a, i); // new pointer
-        SetHead(a, i, (uint16_t) (result + byteCount)); // advance pointer to end of allocated data
+    CountAllocation(a, byteCount);
+    auto run = (size_t)byteOffset(a->_start, (size_t)runStart * ARENA_ZONE_SIZE);
+    auto ptr = byteOffset((void*)run, (alignment - (run & (alignment - 1))) & (alignment - 1));
+    TraceEvent(a, ARENA_EVENT_ALLOCATE, ptr, runStart, byteCount);
+    return ptr;
+}
 
-        auto oldRefs = GetRefCount(a, i);
-        SetRefCount(a, i, oldRefs + 1); // increase arena ref count
+// Release all the zones of a large allocation, given the first zone
+void ArenaReleaseLarge(Arena* a, int zone) {
+    int length = 1;
+    MoveHead(a, zone, ARENA_ZONE_SIZE, 0);
+    FreeIndexUpdate(a, zone, ARENA_ZONE_SIZE, 0);
+
+    for (int i = zone + 1; i < a->_zoneCount; i++) {
+        if (GetRefCount(a, i) != ZONE_CONTINUES) break;
+        SetRefCount(a, i, 0);
+        MoveHead(a, i, ARENA_ZONE_SIZE, 0);
+        FreeIndexUpdate(a, i, ARENA_ZONE_SIZE, 0);
+        length++;
+    }
+    ReleaseZoneMemory(a, zone, length);
+}
 
-        return byteOffset(a->_start, result + (i * ARENA_ZONE_SIZE)); // turn the offset into an absolute position
+// Give a thread's zone back to the free-space index. Call inside the lock.
+void RetireThreadZone(Arena* a, int zone) {
+    auto remaining = RefCountOf(a, zone).fetch_sub(1, std::memory_order_acq_rel) - 1; // drop the owner's reference
+    if (remaining == 0) { // everything in it was already released
+        TraceEvent(a, ARENA_EVENT_RELEASE_ZONE, nullptr, zone, GetHead(a, zone));
+        SetHead(a, zone, 0);
+        ReleaseZoneMemory(a, zone, 1);
     }
+    FreeIndexInsert(a, zone, FreeClass(ARENA_ZONE_SIZE - GetHead(a, zone)));
+}
 
-    // found nothing -- out of memory!
-    return nullptr;
+// Concurrent arenas, and thread slots not held by any live thread. Both are guarded by `SLOT_LOCK`.
+// Lock order is `SLOT_LOCK` then the arena lock.
+static std::atomic<int> SLOT_LOCK(0);
+static Arena* CONCURRENT_ARENAS = nullptr;
+static int FREE_SLOTS[ARENA_THREAD_SLOTS];
+static int FREE_SLOT_COUNT = 0;
+static int NEXT_THREAD_SLOT = 0;
+
+inline void SlotLock() {
+    while (SLOT_LOCK.exchange(1, std::memory_order_acquire) != 0) {}
+}
+inline void SlotUnlock() {
+    SLOT_LOCK.store(0, std::memory_order_release);
+}
+
+// Each thread gets a slot number the first time it allocates from a concurrent arena.
+// When the thread exits, its zones go back to their arenas and the slot is reused.
+typedef struct ThreadSlotGuard {
+    int slot = -1;
+
+    ~ThreadSlotGuard() {
+        if (slot < 0 || slot >= ARENA_THREAD_SLOTS) return;
+        SlotLock();
+        for (auto a = CONCURRENT_ARENAS; a != nullptr; a = a->_nextConcurrent) {
+            ArenaLock(a);
+            if (a->_threadZones[slot] >= 0) RetireThreadZone(a, a->_threadZones[slot]);
+            a->_threadZones[slot] = -1;
+            ArenaUnlock(a);
+        }
+        FREE_SLOTS[FREE_SLOT_COUNT++] = slot;
+        SlotUnlock();
+    }
+} ThreadSlotGuard;
+static thread_local ThreadSlotGuard THREAD_SLOT;
+
+inline int ThreadSlot() {
+    if (THREAD_SLOT.slot >= 0) return THREAD_SLOT.slot;
+
+    SlotLock();
+    if (FREE_SLOT_COUNT > 0) THREAD_SLOT.slot = FREE_SLOTS[--FREE_SLOT_COUNT];
+    else if (NEXT_THREAD_SLOT < ARENA_THREAD_SLOTS) THREAD_SLOT.slot = NEXT_THREAD_SLOT++;
+    else THREAD_SLOT.slot = ARENA_THREAD_SLOTS; // all taken, share the arena lock
+    SlotUnlock();
+    return THREAD_SLOT.slot;
+}
+
+// Allocation for concurrent arenas. Each thread bumps in a zone it owns, and only takes the lock to change zones.
+void* ArenaAllocateConcurrent(Arena* a, size_t byteCount, size_t alignment) {
+    auto worstCase = byteCount + alignment - 1;
+    if (worstCase > ARENA_ZONE_SIZE) {
+        ArenaLock(a);
+        auto run = ArenaAllocateLarge(a, worstCase, alignment);
+        ArenaUnlock(a);
+        return run;
+    }
+
+    auto slot = ThreadSlot();
+    if (slot >= ARENA_THREAD_SLOTS) { // too many threads. Share the index under the lock
+        ArenaLock(a);
+        auto i = SelectZone(a, worstCase);
+        void* result = nullptr;
+        if (i >= 0) {
+            auto head = GetHead(a, i);
+            auto address = (size_t)byteOffset(a->_start, head + ((size_t)i * ARENA_ZONE_SIZE));
+            auto padding = (alignment - (address & (alignment - 1))) & (alignment - 1);
+            auto newHead = (uint16_t)(head + padding + byteCount);
+            SetHead(a, i, newHead);
+            FreeIndexUpdate(a, i, head, newHead);
+            RefCountOf(a, i).fetch_add(1, std::memory_order_relaxed);
+            result = byteOffset((void*)address, padding);
+            TraceEvent(a, ARENA_EVENT_ALLOCATE, result, i, byteCount);
+        }
+        ArenaUnlock(a);
+        return result;
+    }
+
+    auto zone = a->_threadZones[slot];
+    if (zone >= 0) {
+        // we own this zone, so nobody else moves its head
+        auto head = GetHead(a, zone);
+        auto address = (size_t)byteOffset(a->_start, head + ((size_t)zone * ARENA_ZONE_SIZE));
+        auto padding = (alignment - (address & (alignment - 1))) & (alignment - 1);
+        if (head + padding + byteCount <= ARENA_ZONE_SIZE && GetRefCount(a, zone) < ZONE_MAX_REFS) {
+            SetHead(a, zone, (uint16_t)(head + padding + byteCount));
+            RefCountOf(a, zone).fetch_add(1, std::memory_order_relaxed);
+#ifdef ARENA_ACCOUNTING
+            AccountArenaAllocation(byteCount);
+#endif
+            auto result = byteOffset((void*)address, padding);
+            TraceEvent(a, ARENA_EVENT_ALLOCATE, result, zone, byteCount);
+            return result;
+        }
+    }
+
+    // Swap our zone for one with enough room
+    ArenaLock(a);
+    if (zone >= 0) RetireThreadZone(a, zone);
+    zone = SelectZone(a, worstCase);
+    if (zone >= 0) {
+        FreeIndexRemove(a, zone, FreeClass(ARENA_ZONE_SIZE - GetHead(a, zone))); // owned zones are not in the index
+        RefCountOf(a, zone).fetch_add(1, std::memory_order_relaxed); // owner's reference
+    }
+    a->_threadZones[slot] = zone;
+    ArenaUnlock(a);
+
+    if (zone < 0) return nullptr; // out of memory
+    return ArenaAllocateConcurrent(a, byteCount, alignment);
+}
+
+// Switch an arena between single threaded and concurrent modes. The arena must not be in use by other threads.
+void ArenaSetConcurrent(Arena* a, bool concurrent) {
+    if (a == nullptr) return;
+    if (a->_concurrent == concurrent) return;
+
+    SlotLock();
+    if (concurrent) {
+        a->_nextConcurrent = CONCURRENT_ARENAS;
+        CONCURRENT_ARENAS = a;
+    } else {
+        auto link = &CONCURRENT_ARENAS;
+        while (*link != a) link = &(*link)->_nextConcurrent;
+        *link = a->_nextConcurrent;
+        a->_nextConcurrent = nullptr;
+    }
+
+    // give back all the zones owned by threads
+    for (auto& zone : a->_threadZones) {
+        if (zone >= 0) RetireThreadZone(a, zone);
+        zone = -1;
+    }
+    a->_currentZone = 0;
+    a->_lock.store(0);
+    a->_concurrent = concurrent;
+    SlotUnlock();
+
+    if (!concurrent) RecountState(a); // threads don't keep the running totals
+}
+
+// Allocate memory of the given size
+void* ArenaAllocate(Arena* a, size_t byteCount) {
+    if (a == nullptr) return nullptr;
+    if (a->_concurrent) return ArenaAllocateConcurrent(a, byteCount, 1);
+    if (byteCount > ARENA_ZONE_SIZE) return ArenaAllocateLarge(a, byteCount, 1);
+
+    auto maxOff = ARENA_ZONE_SIZE - byteCount;
+
+    // Keep bumping in the most recent zone if we can, otherwise ask the free-space index
+    int i = a->_currentZone;
+    if (i >= a->_zoneCount || GetHead(a, i) > maxOff || GetRefCount(a, i) >= ZONE_MAX_REFS) {
+        i = SelectZone(a, byteCount);
+        if (i < 0) return nullptr; // found nothing -- out of memory!
+    }
+
+    return ClaimInZone(a, i, 0, byteCount);
+}
+
+// Bytes needed to bring the head of a zone up to the given alignment
+inline size_t AlignmentPadding(Arena* a, int zone, size_t alignment) {
+    auto address = (size_t)byteOffset(a->_start, GetHead(a, zone) + ((size_t)zone * ARENA_ZONE_SIZE));
+    return (alignment - (address & (alignment - 1))) & (alignment - 1);
+}
+
+// Allocate memory of the given size, starting at a multiple of `alignment` bytes
+void* ArenaAllocateAligned(Arena* a, size_t byteCount, size_t alignment) {
+    if (a == nullptr) return nullptr;
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) return nullptr; // must be a power of two
+    if (alignment > ARENA_ZONE_SIZE / 2) return nullptr; // would waste most of a zone
+    if (alignment == 1) return ArenaAllocate(a, byteCount);
+    if (a->_concurrent) return ArenaAllocateConcurrent(a, byteCount, alignment);
+
+    // Zones don't start on aligned addresses, so we might need up to `alignment-1` bytes of padding
+    auto worstCase = byteCount + alignment - 1;
+    if (worstCase > ARENA_ZONE_SIZE) {
+        // Over-allocate a run of zones, and hand out an aligned pointer inside it.
+        // References to the inner pointer are counted on the first zone, same as any large allocation.
+        return ArenaAllocateLarge(a, worstCase, alignment);
+    }
+
+    // Try the current zone with the exact padding, otherwise find a zone that's sure to fit
+    int i = a->_currentZone;
+    if (i < a->_zoneCount && GetRefCount(a, i) < ZONE_MAX_REFS) {
+        auto padding = AlignmentPadding(a, i, alignment);
+        if (GetHead(a, i) + padding + byteCount <= ARENA_ZONE_SIZE) return ClaimInZone(a, i, padding, byteCount);
+    }
+
+    i = SelectZone(a, worstCase);
+    if (i < 0) return nullptr; // out of memory
+
+    return ClaimInZone(a, i, AlignmentPadding(a, i, alignment), byteCount);
 }
 
 void* ArenaAllocateAndClear(Arena* a, size_t byteCount) {
@@ -196,6 +1033,29 @@ void* ArenaAllocateAndClear(Arena* a, size_t byteCount) {
     return (void*)res;
 }
 
+#ifdef ARENA_TAGGED_CALLS
+void* ArenaAllocateAlignedTagged(Arena* a, size_t byteCount, size_t alignment, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = ArenaAllocateAligned(a, byteCount, alignment);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+void* ArenaAllocateTagged(Arena* a, size_t byteCount, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = ArenaAllocate(a, byteCount);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+void* ArenaAllocateAndClearTagged(Arena* a, size_t byteCount, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = ArenaAllocateAndClear(a, byteCount);
+    ArenaSiteLeave(outer);
+    return result;
+}
+#endif
+
 
 int ZoneForPtr(Arena* a, void* ptr) {
     if (ptr < a->_start || ptr > a->_limit) return -1;
@@ -203,6 +1063,9 @@ int ZoneForPtr(Arena* a, void* ptr) {
     ptrdiff_t rawOffset = (ptrdiff_t)ptr - (ptrdiff_t)a->_start;
     ptrdiff_t zone = rawOffset / ARENA_ZONE_SIZE;
     if (zone < 0 || zone >= a->_zoneCount) return -1;
+
+    // pointers inside a large allocation are counted against its first zone
+    while (zone > 0 && GetRefCount(a, (int)zone) == ZONE_CONTINUES) zone--;
     return (int)zone;
 }
 
@@ -213,31 +1076,55 @@ bool ArenaContainsPointer(Arena* a, void* ptr) {
     return true;
 }
 
+// Release a zone that has dropped to zero references. Call inside the lock if concurrent
+void ReleaseZone(Arena* a, int zone) {
+    TraceEvent(a, ARENA_EVENT_RELEASE_ZONE, nullptr, zone, GetHead(a, zone));
+    if (zone + 1 < a->_zoneCount && GetRefCount(a, zone + 1) == ZONE_CONTINUES) {
+        ArenaReleaseLarge(a, zone);
+        return;
+    }
+    FreeIndexUpdate(a, zone, GetHead(a, zone), 0);
+    MoveHead(a, zone, GetHead(a, zone), 0);
+    ReleaseZoneMemory(a, zone, 1);
+    if (zone < a->_currentZone) a->_currentZone = zone; // keep allocations packed in low memory. Is this worth it?
+}
+
+bool ArenaDereferenceConcurrent(Arena* a, int zone) {
+    auto& refs = RefCountOf(a, zone);
+    auto refCount = refs.load(std::memory_order_relaxed);
+    do {
+        if (refCount == 0) return false; // Over-free. Fix your code.
+    } while (!refs.compare_exchange_weak(refCount, (uint16_t)(refCount - 1), std::memory_order_acq_rel));
+
+    if (refCount != 1) return true;
+
+    // We took the last reference, but another thread might claim the zone before we get the lock.
+    // Owned zones always have a reference, so check again inside.
+    ArenaLock(a);
+    if (refs.load(std::memory_order_acquire) == 0) ReleaseZone(a, zone);
+    ArenaUnlock(a);
+    return true;
+}
+
 // Remove a reference to memory. When no references are left, the memory may be deallocated
 bool ArenaDereference(Arena* a, void* ptr) {
     if (a == nullptr) return false;
     if (ptr == nullptr) return false;
 
-#ifdef ARENA_DEBUG
-    if (a->_marked) {
-        std::cout << "D@" << a->_headsPtr << "\n";
-    }
-#endif
-
     auto zone = ZoneForPtr(a, ptr);
     if (zone < 0) return false;
+    TraceEvent(a, ARENA_EVENT_DEREFERENCE, ptr, zone, 0);
+    if (a->_concurrent) return ArenaDereferenceConcurrent(a, zone);
 
     auto refCount = GetRefCount(a, zone);
     if (refCount == 0) return false; // Over-free. Fix your code.
 
     refCount--;
     SetRefCount(a, zone, refCount);
+    a->_totalReferences--;
 
     // If no more references, free the block
-    if (refCount == 0) {
-        SetHead(a, zone, 0);
-        if (zone < a->_currentZone) a->_currentZone = zone; // keep allocations packed in low memory. Is this worth it?
-    }
+    if (refCount == 0) ReleaseZone(a, zone);
     return true;
 }
 
@@ -246,40 +1133,503 @@ bool ArenaReference(Arena* a, void* ptr) {
     if (a == nullptr) return false;
     if (ptr == nullptr) return false;
 
-#ifdef ARENA_DEBUG
-    if (a->_marked) {
-        std::cout << "R@" << a->_headsPtr << "\n";
-    }
-#endif
-
     auto zone = ZoneForPtr(a, ptr);
     if (zone < 0) return false;
+    TraceEvent(a, ARENA_EVENT_REFERENCE, ptr, zone, 0);
+
+    if (a->_concurrent) {
+        auto& refs = RefCountOf(a, zone);
+        auto oldRefs = refs.load(std::memory_order_relaxed);
+        do {
+            if (oldRefs >= ZONE_MAX_REFS) return false; // saturated references. Fix your code.
+        } while (!refs.compare_exchange_weak(oldRefs, (uint16_t)(oldRefs + 1), std::memory_order_relaxed));
+        return true;
+    }
 
     auto oldRefs = GetRefCount(a, zone);
     if (oldRefs >= ZONE_MAX_REFS) return false; // saturated references. Fix your code.
 
     SetRefCount(a, zone, oldRefs + 1);
+    a->_totalReferences++;
+    return true;
+}
+
+// Take a free handle table entry, growing the table if needed. Returns -1 if out of memory
+int32_t HandleTake(Arena* a) {
+    if (a->_handleFree >= 0) {
+        auto index = a->_handleFree;
+        auto next = a->_handles[index].offset;
+        a->_handleFree = (next == UINT32_MAX) ? -1 : (int32_t)next;
+        return index;
+    }
+
+    if (a->_handleUsed >= a->_handleCapacity) {
+        auto newCapacity = (a->_handleCapacity < 1) ? ARENA_HANDLE_TABLE_START : a->_handleCapacity * 2;
+        auto table = (HandleEntry*)ArenaSystemAllocate(sizeof(HandleEntry) * newCapacity);
+        if (table == nullptr) return -1;
+        if (a->_handles != nullptr) {
+            copyAnonArray(table, 0, a->_handles, 0, sizeof(HandleEntry) * a->_handleUsed);
+            ArenaSystemFree(a->_handles);
+        }
+        a->_handles = table;
+        a->_handleCapacity = newCapacity;
+    }
+    return (int32_t)(a->_handleUsed++);
+}
+
+// Find the table entry for a live handle, or null
+inline HandleEntry* HandleEntryOf(Arena* a, ArenaHandle handle) {
+    if (a == nullptr || handle < 1 || handle > a->_handleUsed) return nullptr;
+    auto entry = &a->_handles[handle - 1];
+    return (entry->size == 0) ? nullptr : entry;
+}
+
+// Allocate a block that `ArenaCompact` may move
+ArenaHandle ArenaHandleAllocate(Arena* a, size_t byteCount) {
+    if (a == nullptr || a->_concurrent) return 0;
+    if (byteCount < 1 || byteCount > UINT32_MAX) return 0;
+
+    auto index = HandleTake(a);
+    if (index < 0) return 0;
+
+    auto ptr = ArenaAllocate(a, byteCount);
+    if (ptr == nullptr) { // give the entry back
+        a->_handles[index].size = 0;
+        a->_handles[index].offset = (a->_handleFree < 0) ? UINT32_MAX : (uint32_t)a->_handleFree;
+        a->_handleFree = index;
+        return 0;
+    }
+
+    a->_handles[index].offset = ArenaPtrToOffset(a, ptr);
+    a->_handles[index].size = (uint32_t)byteCount;
+    return (ArenaHandle)(index + 1);
+}
+
+// Allocate a relocatable block, and set all bytes to zero
+ArenaHandle ArenaHandleAllocateAndClear(Arena* a, size_t byteCount) {
+    auto handle = ArenaHandleAllocate(a, byteCount);
+    auto ptr = (char*)ArenaHandleGet(a, handle);
+    if (ptr == nullptr) return 0;
+    for (size_t i = 0; i < byteCount; i++) {
+        ptr[i] = 0;
+    }
+    return handle;
+}
+
+// Get the current location of a handle's block
+void* ArenaHandleGet(Arena* a, ArenaHandle handle) {
+    auto entry = HandleEntryOf(a, handle);
+    if (entry == nullptr) return nullptr;
+    return ArenaOffsetToPtr(a, entry->offset);
+}
+
+// Release a handle and its block
+bool ArenaHandleRelease(Arena* a, ArenaHandle handle) {
+    auto entry = HandleEntryOf(a, handle);
+    if (entry == nullptr) return false;
+
+    ArenaDereference(a, ArenaOffsetToPtr(a, entry->offset));
+    entry->size = 0;
+    entry->offset = (a->_handleFree < 0) ? UINT32_MAX : (uint32_t)a->_handleFree;
+    a->_handleFree = (int32_t)(handle - 1);
+    return true;
+}
+
+// Zone holding a handle block. Blocks moved by `ArenaCompact` are never larger than a zone
+inline int HandleZone(const HandleEntry& entry) {
+    return (int)((entry.offset - 1) / ARENA_ZONE_SIZE);
+}
+
+// Take room for a block being moved by `ArenaCompact`. Like `ClaimInZone`, but nothing new is allocated,
+// so usage totals and the peak are left alone.
+void* ClaimForMove(Arena* a, size_t byteCount) {
+    // Keep filling the same zone, like `ArenaAllocate`, so moved blocks end up packed together
+    int i = a->_currentZone;
+    if (i >= a->_zoneCount || GetHead(a, i) > ARENA_ZONE_SIZE - byteCount || GetRefCount(a, i) >= ZONE_MAX_REFS) {
+        i = SelectZone(a, byteCount);
+        if (i < 0) return nullptr;
+    }
+    a->_currentZone = i;
+
+    auto oldHead = GetHead(a, i);
+    auto newHead = (uint16_t)(oldHead + byteCount);
+    ShiftHead(a, i, oldHead, newHead);
+    FreeIndexUpdate(a, i, oldHead, newHead);
+    SetRefCount(a, i, GetRefCount(a, i) + 1);
+    a->_totalReferences++; // given back when the old block is dereferenced
+
+    auto ptr = byteOffset(a->_start, oldHead + ((size_t)i * ARENA_ZONE_SIZE));
+    TraceEvent(a, ARENA_EVENT_ALLOCATE, ptr, i, byteCount);
+    return ptr;
+}
+
+// Order candidate zones for `ArenaCompact`: fewest handle bytes first, then by zone
+int CompareCompactKeys(const void* x, const void* y) {
+    auto kx = *(const uint64_t*)x;
+    auto ky = *(const uint64_t*)y;
+    return (kx > ky) - (kx < ky);
+}
+
+// Move handle blocks out of sparsely used zones into denser ones
+int ArenaCompact(Arena* a, size_t byteBudget) {
+    if (a == nullptr || a->_concurrent || a->_handleUsed < 1) return 0;
+    if (byteBudget < 1) byteBudget = SIZE_MAX;
+
+    auto zoneCount = a->_zoneCount;
+    if (a->_compactZones == nullptr) {
+        a->_compactZones = (uint64_t*)ArenaSystemAllocate((sizeof(uint64_t) + sizeof(uint32_t) * 3) * zoneCount);
+        if (a->_compactZones == nullptr) return 0;
+    }
+    if (a->_compactMovesCapacity < a->_handleCapacity) {
+        auto table = (uint32_t*)ArenaSystemAllocate(sizeof(uint32_t) * a->_handleCapacity);
+        if (table == nullptr) return 0;
+        ArenaSystemFree(a->_compactMoves);
+        a->_compactMoves = table;
+        a->_compactMovesCapacity = a->_handleCapacity;
+    }
+    auto keys = a->_compactZones;
+    auto handleRefs = (uint32_t*)(keys + zoneCount);
+    auto handleBytes = handleRefs + zoneCount;
+    auto bucketEnd = handleBytes + zoneCount;
+    auto moves = a->_compactMoves;
+    memset(handleRefs, 0, sizeof(uint32_t) * 2 * zoneCount);
+
+    // Count live handle blocks and bytes in each zone
+    for (uint32_t i = 0; i < a->_handleUsed; i++) {
+        auto& entry = a->_handles[i];
+        if (entry.size == 0 || entry.size > ARENA_ZONE_SIZE) continue; // free, or a large block with zones to itself
+        auto zone = HandleZone(entry);
+        handleRefs[zone]++;
+        handleBytes[zone] += entry.size;
+    }
+
+    // A zone whose every reference is a handle block can be emptied by moving them all.
+    // Empty the sparsest zones first: they give back the most space for the least copying.
+    // Zones more than half full aren't worth it.
+    int keyCount = 0;
+    uint32_t total = 0;
+    for (int i = 0; i < zoneCount; i++) {
+        total += handleRefs[i];
+        bucketEnd[i] = total;
+        if (handleRefs[i] < 1 || handleRefs[i] != GetRefCount(a, i)) continue;
+        if (handleBytes[i] > ARENA_ZONE_SIZE / 2) continue;
+        keys[keyCount++] = ((uint64_t)handleBytes[i] << 32) | (uint32_t)i;
+    }
+    qsort(keys, (size_t)keyCount, sizeof(uint64_t), CompareCompactKeys);
+
+    // Group the handles by zone, so each zone's blocks are found without scanning the table
+    for (uint32_t i = a->_handleUsed; i > 0; i--) {
+        auto& entry = a->_handles[i - 1];
+        if (entry.size == 0 || entry.size > ARENA_ZONE_SIZE) continue;
+        moves[--bucketEnd[HandleZone(entry)]] = i - 1; // leaves `bucketEnd` at the start of each group
+    }
+
+    int emptied = 0;
+    size_t moved = 0;
+    for (int k = 0; k < keyCount && moved < byteBudget; k++) {
+        auto zone = (int)(uint32_t)keys[k];
+        if (GetRefCount(a, zone) != handleRefs[zone]) continue; // moved blocks landed here. Keep it.
+
+        // Close the zone, so the moved blocks can't land back in it
+        auto oldHead = GetHead(a, zone);
+        FreeIndexUpdate(a, zone, oldHead, ARENA_ZONE_SIZE);
+        ShiftHead(a, zone, oldHead, ARENA_ZONE_SIZE);
+
+        bool stuck = false;
+        auto first = bucketEnd[zone];
+        for (auto i = first; i < first + handleRefs[zone]; i++) {
+            auto& entry = a->_handles[moves[i]];
+            auto oldPtr = ArenaOffsetToPtr(a, entry.offset);
+            auto newPtr = ClaimForMove(a, entry.size);
+            if (newPtr == nullptr) { // no room anywhere else
+                stuck = true;
+                break;
+            }
+            copyAnonArray(newPtr, 0, oldPtr, 0, entry.size);
+            entry.offset = ArenaPtrToOffset(a, newPtr);
+            moved += entry.size;
+            ArenaDereference(a, oldPtr); // the last one releases the zone
+        }
+
+        if (stuck) {
+            // put the zone back as it was, less anything we did manage to move
+            if (GetRefCount(a, zone) > 0) {
+                FreeIndexUpdate(a, zone, ARENA_ZONE_SIZE, oldHead);
+                ShiftHead(a, zone, ARENA_ZONE_SIZE, oldHead);
+            }
+            break;
+        }
+        emptied++;
+    }
+    return emptied;
+}
+
+// Size class for a slab request. Returns -1 if too big for the slab allocator.
+int SlabClassIndex(size_t byteCount) {
+    if (byteCount > SLAB_MAX_SIZE) return -1;
+    if (byteCount <= 256) return (byteCount < 16) ? 0 : (int)((byteCount + 15) / 16) - 1;
+
+    // above 256, each power of two is split into 4 classes
+    int c = 16;
+    size_t low = 256;
+    while (byteCount > low * 2) {
+        low *= 2;
+        c += 4;
+    }
+    auto step = low / 4;
+    return c + (int)((byteCount - low + step - 1) / step) - 1;
+}
+
+// Object size for a slab size class
+size_t SlabClassSize(int slabClass) {
+    if (slabClass < 16) return (size_t)(slabClass + 1) * 16;
+
+    size_t low = 256;
+    slabClass -= 16;
+    while (slabClass >= 4) {
+        low *= 2;
+        slabClass -= 4;
+    }
+    return low + ((low / 4) * (slabClass + 1));
+}
+
+// Add a batch to the front of its class's list of batches with free objects. Call inside the lock.
+inline void SlabLinkPartial(SlabClass& slab, SlabBatch* batch) {
+    batch->prevPartial = nullptr;
+    batch->nextPartial = slab.partial;
+    if (slab.partial != nullptr) slab.partial->prevPartial = batch;
+    slab.partial = batch;
+}
+inline void SlabUnlinkPartial(SlabClass& slab, SlabBatch* batch) {
+    if (batch->prevPartial != nullptr) batch->prevPartial->nextPartial = batch->nextPartial;
+    else slab.partial = batch->nextPartial;
+    if (batch->nextPartial != nullptr) batch->nextPartial->prevPartial = batch->prevPartial;
+    batch->nextPartial = nullptr;
+    batch->prevPartial = nullptr;
+}
+
+// Find the batch holding a slab object of the given class.
+// Returns null if `ptr` is not the start of an object from such a batch. Call inside the lock.
+SlabBatch* SlabBatchOf(Arena* a, void* ptr, int slabClass) {
+    if (a->_slabZones == nullptr) return nullptr;
+    auto zone = ZoneForPtr(a, ptr);
+    if (zone < 0) return nullptr;
+
+    for (auto batch = a->_slabZones[zone]; batch != nullptr; batch = batch->nextInZone) {
+        auto size = SlabClassSize(batch->slabClass);
+        auto first = (char*)batch + SLAB_HEADER_BYTES;
+        if ((char*)ptr < first || (char*)ptr >= first + (size_t)batch->count * size) continue;
+
+        if (batch->slabClass != slabClass) return nullptr; // released with the wrong size
+        if ((size_t)((char*)ptr - first) % size != 0) return nullptr; // inside an object
+        return batch;
+    }
+    return nullptr; // not slab memory
+}
+
+// Take a batch of objects for a size class from the arena, making them available to `ArenaSlabAllocate`
+bool SlabRefill(Arena* a, int slabClass) {
+    auto size = SlabClassSize(slabClass);
+    auto count = (SLAB_BATCH_BYTES - SLAB_HEADER_BYTES) / size;
+    if (count < 1) count = 1;
+
+    // The whole batch holds a single reference in its zone, released once all of its objects are
+#ifdef ARENA_TAGGED_CALLS
+    auto callerSite = CURRENT_SITE;
+    CURRENT_SITE = SLAB_BATCH_SITE;
+#endif
+    auto batch = (SlabBatch*)ArenaAllocateAligned(a, SLAB_HEADER_BYTES + (size * count), 16);
+#ifdef ARENA_TAGGED_CALLS
+    CURRENT_SITE = callerSite;
+#endif
+    if (batch == nullptr) return false;
+    auto zone = ZoneForPtr(a, batch);
+
+    auto objects = (char*)batch + SLAB_HEADER_BYTES;
+    batch->freeList = nullptr;
+    for (size_t i = count; i > 0; i--) { // link in address order
+        auto obj = objects + ((i - 1) * size);
+        *(void**)obj = batch->freeList;
+        batch->freeList = obj;
+    }
+    batch->live = 0;
+    batch->count = (uint32_t)count;
+    batch->slabClass = slabClass;
+
+    ArenaLock(a);
+    if (a->_slabZones == nullptr) a->_slabZones = (SlabBatch**)ArenaSystemAllocateAndClear(sizeof(SlabBatch*) * a->_zoneCount);
+    if (a->_slabZones == nullptr || zone < 0) {
+        ArenaUnlock(a);
+        ArenaDereference(a, batch);
+        return false;
+    }
+    batch->nextInZone = a->_slabZones[zone];
+    a->_slabZones[zone] = batch;
+
+    auto& slab = a->_slabs[slabClass];
+    SlabLinkPartial(slab, batch);
+    slab.carved += (uint32_t)count;
+    ArenaUnlock(a);
     return true;
 }
 
+void* ArenaSlabAllocate(Arena* a, size_t byteCount) {
+    if (a == nullptr) return nullptr;
+
+    auto slabClass = SlabClassIndex(byteCount);
+    if (slabClass < 0) return ArenaAllocate(a, byteCount);
+
+    auto& slab = a->_slabs[slabClass];
+    ArenaLock(a);
+    while (slab.partial == nullptr) {
+        ArenaUnlock(a); // refill takes the lock itself
+        if (!SlabRefill(a, slabClass)) return nullptr;
+        ArenaLock(a);
+    }
+
+    auto batch = slab.partial;
+    auto result = batch->freeList;
+    batch->freeList = *(void**)result;
+    batch->live++;
+    if (batch->freeList == nullptr) SlabUnlinkPartial(slab, batch); // now full
+
+    slab.live++;
+    slab.requestedBytes += byteCount;
+    ArenaUnlock(a);
+
+#ifdef ARENA_ACCOUNTING
+    AccountArenaAllocation(byteCount);
+#endif
+    TraceEvent(a, ARENA_EVENT_SLAB_ALLOCATE, result, ZoneForPtr(a, result), byteCount);
+    return result;
+}
+
+void* ArenaSlabAllocateAndClear(Arena* a, size_t byteCount) {
+    auto res = (char*)ArenaSlabAllocate(a, byteCount);
+    if (res == nullptr) return nullptr;
+    for (size_t i = 0; i < byteCount; i++) {
+        res[i] = 0;
+    }
+    return (void*)res;
+}
+
+#ifdef ARENA_TAGGED_CALLS
+void* ArenaSlabAllocateTagged(Arena* a, size_t byteCount, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = ArenaSlabAllocate(a, byteCount);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+void* ArenaSlabAllocateAndClearTagged(Arena* a, size_t byteCount, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = ArenaSlabAllocateAndClear(a, byteCount);
+    ArenaSiteLeave(outer);
+    return result;
+}
+#endif
+
+bool ArenaSlabRelease(Arena* a, void* ptr, size_t byteCount) {
+    if (a == nullptr) return false;
+    if (ptr == nullptr) return false;
+
+    auto slabClass = SlabClassIndex(byteCount);
+    if (slabClass < 0) return ArenaDereference(a, ptr);
+
+    auto& slab = a->_slabs[slabClass];
+    ArenaLock(a);
+    auto batch = SlabBatchOf(a, ptr, slabClass);
+    if (batch == nullptr || batch->live < 1) { // Not a slab object of this size, or over-free. Fix your code.
+        ArenaUnlock(a);
+        return false;
+    }
+#ifdef ARENA_DEBUG
+    for (auto obj = batch->freeList; obj != nullptr; obj = *(void**)obj) {
+        if (obj == ptr) { // Double release. Fix your code.
+            ArenaUnlock(a);
+            return false;
+        }
+    }
+#endif
+
+    if (batch->freeList == nullptr) SlabLinkPartial(slab, batch); // was full
+    *(void**)ptr = batch->freeList;
+    batch->freeList = ptr;
+    batch->live--;
+    slab.live--;
+    slab.requestedBytes -= byteCount;
+
+    // Give empty batches back to the arena, but keep one per class so alternating allocate and release doesn't churn
+    bool drop = batch->live == 0 && (slab.partial != batch || batch->nextPartial != nullptr);
+    if (drop) {
+        SlabUnlinkPartial(slab, batch);
+        auto link = &a->_slabZones[ZoneForPtr(a, batch)];
+        while (*link != batch) link = &(*link)->nextInZone;
+        *link = batch->nextInZone;
+        slab.carved -= batch->count;
+    }
+    TraceEvent(a, ARENA_EVENT_SLAB_RELEASE, ptr, ZoneForPtr(a, ptr), byteCount); // before another thread can reuse it
+    ArenaUnlock(a);
+
+    if (drop) ArenaDereference(a, batch); // outside the lock, as concurrent dereference can take it
+    return true;
+}
+
+void ArenaGetSlabState(Arena* a, size_t* slabBytes, size_t* liveBytes, size_t* freeBytes, size_t* wastedBytes) {
+    if (a == nullptr) return;
+
+    size_t total = 0;
+    size_t live = 0;
+    size_t free = 0;
+    size_t wasted = 0;
+
+    ArenaLock(a);
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        auto& slab = a->_slabs[i];
+        auto size = SlabClassSize(i);
+        total += slab.carved * size;
+        live += slab.requestedBytes;
+        free += (slab.carved - slab.live) * size;
+        wasted += (slab.live * size) - slab.requestedBytes;
+    }
+    ArenaUnlock(a);
+
+    if (slabBytes != nullptr) *slabBytes = total;
+    if (liveBytes != nullptr) *liveBytes = live;
+    if (freeBytes != nullptr) *freeBytes = free;
+    if (wastedBytes != nullptr) *wastedBytes = wasted;
+}
+
 // Read statistics for this Arena. Pass `NULL` for anything you're not interested in.
 void ArenaGetState(Arena* a, size_t* allocatedBytes, size_t* unallocatedBytes,
     int* occupiedZones, int* emptyZones, int* totalReferenceCount, size_t* largestContiguous) {
     if (a == nullptr) return;
 
+    // Use the running totals if we can. Only the largest free block needs a scan.
+    if (!a->_concurrent && largestContiguous == nullptr) {
+        auto capacity = (size_t)a->_zoneCount * ARENA_ZONE_SIZE;
+        if (allocatedBytes != nullptr) *allocatedBytes = a->_allocatedBytes;
+        if (unallocatedBytes != nullptr) *unallocatedBytes = capacity - a->_allocatedBytes;
+        if (occupiedZones != nullptr) *occupiedZones = a->_occupiedZones;
+        if (emptyZones != nullptr) *emptyZones = a->_zoneCount - a->_occupiedZones;
+        if (totalReferenceCount != nullptr) *totalReferenceCount = a->_totalReferences;
+        return;
+    }
+
     size_t allocated = 0;
     size_t unallocated = 0;
     int occupied = 0;
     int empty = 0;
     int totalReferences = 0;
     size_t largestFree = 0;
+    size_t emptyRun = 0;
 
     auto zoneCount = a->_zoneCount;
 
     for (int i = 0; i < zoneCount; i++) {
         auto zoneRefCount = GetRefCount(a, i);
         auto zoneHead = GetHead(a, i);
-        totalReferences += zoneRefCount;
+        if (zoneRefCount != ZONE_CONTINUES) totalReferences += zoneRefCount;
 
         if (zoneHead > 0) occupied++;
         else empty++;
@@ -288,6 +1638,10 @@ void ArenaGetState(Arena* a, size_t* allocatedBytes, size_t* unallocatedBytes,
         allocated += zoneHead;
         unallocated += free;
         if (free > largestFree) largestFree = free;
+
+        // runs of empty zones can be used for large allocations
+        emptyRun = (zoneHead == 0) ? emptyRun + ARENA_ZONE_SIZE : 0;
+        if (emptyRun > largestFree) largestFree = emptyRun;
     }
 
     if (allocatedBytes != nullptr) *allocatedBytes = allocated;
@@ -298,6 +1652,15 @@ void ArenaGetState(Arena* a, size_t* allocatedBytes, size_t* unallocatedBytes,
     if (largestContiguous != nullptr) *largestContiguous = largestFree;
 }
 
+// Read usage since the arena was created or last reset
+void ArenaGetUsage(Arena* a, size_t* peakBytes, uint32_t* allocationCount, size_t* allocationBytes) {
+    if (a == nullptr) return;
+
+    if (peakBytes != nullptr) *peakBytes = a->_peakAllocatedBytes;
+    if (allocationCount != nullptr) *allocationCount = a->_allocationCount;
+    if (allocationBytes != nullptr) *allocationBytes = a->_allocationBytes;
+}
+
 // Get an offset into the arena for a pointer to memory
 uint32_t ArenaPtrToOffset(Arena* a, void* ptr) {
     if (!ArenaContainsPointer(a, ptr)) return 0;
@@ -305,7 +1668,7 @@ uint32_t ArenaPtrToOffset(Arena* a, void* ptr) {
     auto base = (size_t)(a->_start);
     auto actual = (size_t)ptr;
 
-    if (base >= actual) return 0;
+    if (base > actual) return 0;
 
     return (actual - base) + 1; // zero is a failure case
 }
@@ -319,4 +1682,229 @@ void* ArenaOffsetToPtr(Arena* a, uint32_t offset) {
 }
 
 
+// Start of a snapshot file. The arena image follows at ARENA_SNAPSHOT_HEADER bytes.
+// The image is the arena's system memory from `_freeNextPtr` to the end of the last zone in use,
+// so the free-space index, heads and ref counts are all restored as-is.
+typedef struct ArenaSnapshotHeader {
+    char magic[8];                              // "ArenaSn" and a zero
+    uint32_t version;                           // ARENA_SNAPSHOT_VERSION
+    uint32_t zoneSize;                          // ARENA_ZONE_SIZE when written
+    uint64_t size;                              // size the arena was created with
+    uint64_t imageBytes;                        // bytes of arena memory after the header
+    int32_t zoneCount;                          // must match the arena we create from `size`
+    int32_t currentZone;
+    uint32_t rootOffset;                        // caller's entry point into the data
+    uint32_t freeClassMask;
+    int32_t freeClassHeads[FREE_CLASS_COUNT];
+} ArenaSnapshotHeader;
+
+static const char SNAPSHOT_MAGIC[8] = "ArenaSn";
+
+// Open a file with stdio, for snapshots and traces. MSVC refuses to compile `fopen` with warnings as errors
+FILE* SystemFileOpen(const char* path, const char* mode) {
+#ifdef _WIN32
+    FILE* f = nullptr;
+    if (fopen_s(&f, path, mode) != 0) return nullptr;
+    return f;
+#else
+    return fopen(path, mode);
+#endif
+}
+
+// Write the arena's zones, heads and reference counts to a file
+bool ArenaWriteSnapshot(Arena* a, const char* path, uint32_t rootOffset) {
+    if (a == nullptr || path == nullptr) return false;
+
+    // zones owned by threads hold an extra reference that nobody would drop after a reload
+    for (auto& zone : a->_threadZones) {
+        if (zone >= 0) RetireThreadZone(a, zone);
+        zone = -1;
+    }
+
+    // only store up to the last zone that has anything in it
+    int usedZones = a->_zoneCount;
+    while (usedZones > 0 && GetHead(a, usedZones - 1) == 0 && GetRefCount(a, usedZones - 1) == 0) usedZones--;
+
+    ArenaSnapshotHeader header = {};
+    copyAnonArray(header.magic, 0, (void*)SNAPSHOT_MAGIC, 0, sizeof(header.magic));
+    header.version = ARENA_SNAPSHOT_VERSION;
+    header.zoneSize = ARENA_ZONE_SIZE;
+    header.size = a->_size;
+    header.imageBytes = (size_t)a->_start - (size_t)a->_freeNextPtr + ((size_t)usedZones * ARENA_ZONE_SIZE);
+    header.zoneCount = a->_zoneCount;
+    header.currentZone = a->_currentZone;
+    header.rootOffset = rootOffset;
+    header.freeClassMask = a->_freeClassMask;
+    for (int i = 0; i < FREE_CLASS_COUNT; i++) header.freeClassHeads[i] = a->_freeClassHeads[i];
+
+    auto f = SystemFileOpen(path, "wb");
+    if (f == nullptr) return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    // pad to the image start
+    static const char zeros[1024] = {};
+    size_t written = sizeof(header);
+    while (ok && written < ARENA_SNAPSHOT_HEADER) {
+        auto chunk = ARENA_SNAPSHOT_HEADER - written;
+        if (chunk > sizeof(zeros)) chunk = sizeof(zeros);
+        ok = fwrite(zeros, 1, chunk, f) == chunk;
+        written += chunk;
+    }
+
+    if (ok) ok = fwrite(a->_freeNextPtr, 1, (size_t)header.imageBytes, f) == (size_t)header.imageBytes;
+    if (fclose(f) != 0) ok = false;
+
+#ifdef ARENA_DEBUG
+    if (!ok) std::cout << "Failed to write arena snapshot to " << path << "\n";
+#endif
+    return ok;
+}
+
+// Map the image part of a snapshot file over the arena's memory, copy-on-write. Returns false if that can't be done.
+bool SnapshotMapImage(Arena* a, const char* path, size_t imageBytes) {
+#ifdef ARENA_MMAP
+    if (ARENA_SNAPSHOT_HEADER % SystemPageSize() != 0) return false;
+
+    auto fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    // Replaces the pages of our reservation. Huge page reservations will refuse this, and we read instead
+    auto mem = mmap(a->_freeNextPtr, imageBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, ARENA_SNAPSHOT_HEADER);
+    close(fd); // the mapping keeps the file open
+    return mem != MAP_FAILED;
+#else
+    (void)a; (void)path; (void)imageBytes;
+    return false;
+#endif
+}
+
+// Create an arena from a file written by `ArenaWriteSnapshot`
+Arena* ArenaLoadSnapshot(const char* path, uint32_t* rootOffset) {
+    if (path == nullptr) return nullptr;
+
+    auto f = SystemFileOpen(path, "rb");
+    if (f == nullptr) return nullptr;
+
+    ArenaSnapshotHeader header = {};
+    bool ok = fread(&header, sizeof(header), 1, f) == 1;
+    for (int i = 0; ok && i < (int)sizeof(header.magic); i++) ok = header.magic[i] == SNAPSHOT_MAGIC[i];
+    ok = ok && header.version == ARENA_SNAPSHOT_VERSION && header.zoneSize == ARENA_ZONE_SIZE;
+    ok = ok && header.size <= SIZE_MAX;
+
+    // the file must have all of the image
+    if (ok) ok = fseek(f, 0, SEEK_END) == 0;
+    if (ok) {
+        auto fileSize = ftell(f);
+        ok = fileSize > 0 && (uint64_t)fileSize >= ARENA_SNAPSHOT_HEADER + header.imageBytes;
+    }
+
+    // A new arena of the same size has the same layout, so the image fits straight over it
+    auto a = ok ? NewArena((size_t)header.size) : nullptr;
+    ok = a != nullptr && a->_zoneCount == header.zoneCount;
+    if (ok) {
+        auto tableBytes = (size_t)a->_start - (size_t)a->_freeNextPtr;
+        ok = header.imageBytes >= tableBytes
+            && header.imageBytes <= tableBytes + ((size_t)a->_zoneCount * ARENA_ZONE_SIZE)
+            && (header.imageBytes - tableBytes) % ARENA_ZONE_SIZE == 0;
+    }
+
+    if (ok && !SnapshotMapImage(a, path, (size_t)header.imageBytes)) {
+        ok = fseek(f, ARENA_SNAPSHOT_HEADER, SEEK_SET) == 0
+            && fread(a->_freeNextPtr, 1, (size_t)header.imageBytes, f) == (size_t)header.imageBytes;
+    }
+    fclose(f);
+
+    if (!ok) {
+#ifdef ARENA_DEBUG
+        std::cout << "Arena snapshot " << path << " could not be loaded\n";
+#endif
+        DropArena(&a);
+        return nullptr;
+    }
+
+    // zones past the image are still empty from `NewArena`, and were linked into the index then.
+    // The saved index already includes them, so we just take its list heads.
+    a->_currentZone = header.currentZone;
+    a->_freeClassMask = header.freeClassMask;
+    for (int i = 0; i < FREE_CLASS_COUNT; i++) a->_freeClassHeads[i] = header.freeClassHeads[i];
+    RecountState(a);
+
+    if (rootOffset != nullptr) *rootOffset = header.rootOffset;
+    return a;
+}
+
+#ifdef ARENA_TRACE
+static const char TRACE_MAGIC[8] = "ArenaTr";
+#endif
+
+// Write the trace ring buffer to a file, oldest event first
+bool ArenaTraceWrite(const char* path) {
+#ifdef ARENA_TRACE
+    if (path == nullptr) return false;
+
+    auto total = TRACE_NEXT.load(std::memory_order_acquire);
+    uint32_t first = (total > ARENA_TRACE_CAPACITY) ? total - ARENA_TRACE_CAPACITY : 0;
+
+    // take a stable copy first, dropping any slot that is being written or was overwritten while we read it
+    auto events = (ArenaTraceEvent*)ArenaSystemAllocate(sizeof(ArenaTraceEvent) * (total - first + 1));
+    if (events == nullptr) return false;
+    uint32_t count = 0;
+    for (uint32_t sequence = first + 1; sequence <= total; sequence++) {
+        auto& slot = TRACE_RING[(sequence - 1) & (ARENA_TRACE_CAPACITY - 1)];
+        auto& slotSequence = *(std::atomic<uint32_t>*)&slot.sequence;
+        if (slotSequence.load(std::memory_order_acquire) != sequence) continue;
+        events[count] = slot;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slotSequence.load(std::memory_order_relaxed) != sequence) continue;
+        events[count].sequence = sequence;
+        count++;
+    }
+
+    // site 0 is the untagged placeholder, so the table is written from 1
+    uint32_t siteCount = 0;
+    for (uint32_t i = 1; i < ARENA_TRACE_SITE_COUNT; i++) {
+        if (TRACE_SITES[i].load(std::memory_order_acquire) != nullptr) siteCount = i;
+    }
+
+    ArenaTraceFileHeader header = {};
+    copyAnonArray(header.magic, 0, (void*)TRACE_MAGIC, 0, sizeof(header.magic));
+    header.version = ARENA_TRACE_FILE_VERSION;
+    header.eventCount = count;
+    header.siteCount = siteCount;
+    header.droppedCount = first + ((total - first) - count);
+
+    auto f = SystemFileOpen(path, "wb");
+    bool ok = f != nullptr;
+    if (ok) ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (uint32_t i = 1; ok && i <= siteCount; i++) {
+        auto site = TRACE_SITES[i].load(std::memory_order_acquire);
+        uint16_t length = 0;
+        while (site != nullptr && site[length] != 0 && length < 0xFFFF) length++;
+        ok = fwrite(&length, sizeof(length), 1, f) == 1;
+        if (ok && length > 0) ok = fwrite(site, 1, length, f) == length;
+    }
+    if (ok && count > 0) ok = fwrite(events, sizeof(ArenaTraceEvent), count, f) == count;
+    if (f != nullptr && fclose(f) != 0) ok = false;
+
+    ArenaSystemFree(events);
+    if (!ok) std::cout << "Failed to write arena trace to " << path << "\n";
+    return ok;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+// Drop all events from the trace ring buffer
+void ArenaTraceClear() {
+#ifdef ARENA_TRACE
+    for (auto& slot : TRACE_RING) {
+        ((std::atomic<uint32_t>*)&slot.sequence)->store(0, std::memory_order_relaxed);
+    }
+    TRACE_NEXT.store(0, std::memory_order_release);
+#endif
+}
+
+
 #pragma clang diagnostic pop
\ No newline at end of file
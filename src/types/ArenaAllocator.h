@@ -9,7 +9,8 @@
 #include <cstdint>
 #include <cstddef>
 
-// Maximum size of a single allocation
+// Size of each zone in an arena. Allocations up to this size are packed into zones.
+// Larger allocations take a run of whole empty zones.
 #define ARENA_ZONE_SIZE 65535
 
 #define KILOBYTES * 1024UL
@@ -20,8 +21,33 @@
 #define MEGABYTE * 1048576
 #define GIGABYTE * 1073741824UL
 
-// Enable diagnostics
+// Enable diagnostics. On for debug builds only
+#ifndef NDEBUG
 #define ARENA_DEBUG 1
+#endif
+
+// Record events of arenas marked with `TraceArena` in a binary ring buffer. See `ArenaTraceWrite`.
+// Requires ARENA_DEBUG, so the hooks are compiled out of release builds.
+#ifdef ARENA_DEBUG
+#define ARENA_TRACE 1
+#endif
+
+// Back arenas with reserved address space (mmap) rather than malloc.
+// Pages are only committed when first touched, so resident memory tracks use rather than arena size.
+#if !defined(_WIN32)
+#define ARENA_MMAP 1
+#endif
+
+// Request huge pages for mmap arenas. Falls back to normal pages with transparent huge page advice.
+//#define ARENA_HUGE_PAGES 1
+
+// Give the pages of a zone back to the OS when it becomes empty. Requires ARENA_MMAP.
+// This lowers resident memory in long-lived arenas, at the cost of a system call and fresh page faults on reuse
+//#define ARENA_RELEASE_EMPTY_ZONES 1
+
+// Enable allocation accounting. Counts system allocator calls, and arena allocations by call site, for each thread.
+// See `MMFrameStart` and `MMFrameEnd` in MemoryManager.h
+//#define ARENA_ACCOUNTING 1
 
 typedef struct Arena Arena;
 typedef Arena* ArenaPtr;
@@ -33,6 +59,21 @@ Arena* NewArena(size_t size);
 // Call to drop an arena, deallocating all memory it contains
 void DropArena(Arena** a);
 
+// Release every allocation in the arena at once, keeping its memory for reuse.
+// All existing pointers into the arena become invalid. Memory is not zeroed.
+// Concurrent and traced arenas stay that way; see `ArenaSetConcurrent` and `TraceArena`.
+void ArenaReset(Arena* a);
+
+// Return the size the arena was created with
+size_t ArenaGetSize(Arena* a);
+
+// Switch an arena between single threaded and concurrent modes. Arenas start single threaded.
+// Concurrent arenas can be allocated from and dereferenced by many threads at once:
+// each thread bumps in its own zone, and reference counts are atomic.
+// A thread's zones go back to the arena when the thread exits.
+// Only switch while no other thread is using the arena. `ArenaReset` and `DropArena` are never thread-safe.
+void ArenaSetConcurrent(Arena* a, bool concurrent);
+
 // Copy arena data out to system-level memory. Use this for very long-lived data
 void* MakePermanent(void* data, size_t length);
 
@@ -42,9 +83,13 @@ void* CopyToArena(void* srcData, size_t length, Arena* target);
 // Returns true if the given pointer is managed by this arena
 bool ArenaContainsPointer(Arena* a, void* ptr);
 
-// Allocate memory of the given size
+// Allocate memory of the given size. Requests over ARENA_ZONE_SIZE need that many contiguous empty zones.
 void* ArenaAllocate(Arena* a, size_t byteCount);
 
+// Allocate memory of the given size, starting at a multiple of `alignment` bytes.
+// Alignment must be a power of two, such as 16, 32 or 64 for SIMD data or cache lines
+void* ArenaAllocateAligned(Arena* a, size_t byteCount, size_t alignment);
+
 // Allocate memory of the given size and set all bytes to zero
 void* ArenaAllocateAndClear(Arena* a, size_t byteCount);
 
@@ -60,12 +105,177 @@ uint32_t ArenaPtrToOffset(Arena* a, void* ptr);
 // Get a raw memory pointer from an offset into an arena. Zero is NOT a valid offset value.
 void* ArenaOffsetToPtr(Arena* a, uint32_t offset);
 
+// Write the arena's zones, heads and reference counts to a file, so it can be reloaded with `ArenaLoadSnapshot`.
+// Only offset-addressed data survives a reload -- raw pointers into the arena will be wrong.
+// `rootOffset` is stored with the snapshot, so the loader can find its way in. Slab free lists and handles are not saved.
+// The arena must not be in use by other threads. Returns false if the file could not be written.
+bool ArenaWriteSnapshot(Arena* a, const char* path, uint32_t rootOffset);
+
+// Create an arena from a file written by `ArenaWriteSnapshot`. Returns null if the file is missing or not valid.
+// With ARENA_MMAP, the file is mapped copy-on-write rather than read: start-up cost does not depend on the
+// snapshot size, and pages that are never written stay shared with the file cache.
+// The arena can be allocated from and dereferenced as normal. Changes are never written back to the file.
+// If `rootOffset` is not null, it is set to the value given when the snapshot was written.
+Arena* ArenaLoadSnapshot(const char* path, uint32_t* rootOffset);
+
+// Reference to a relocatable block of arena memory. Zero is NOT a valid handle.
+typedef uint32_t ArenaHandle;
+
+// Allocate a block that `ArenaCompact` may move. Use `ArenaHandleGet` to find it.
+// Handles are for single threaded arenas only. Returns zero if the arena is out of memory.
+ArenaHandle ArenaHandleAllocate(Arena* a, size_t byteCount);
+// Allocate a relocatable block, and set all bytes to zero
+ArenaHandle ArenaHandleAllocateAndClear(Arena* a, size_t byteCount);
+// Get the current location of a handle's block. The pointer is only valid until the next `ArenaCompact`,
+// so don't store it. Store the handle instead. Returns null for a released or invalid handle.
+void* ArenaHandleGet(Arena* a, ArenaHandle handle);
+// Release a handle and its block. The handle value may be reused by a later `ArenaHandleAllocate`.
+bool ArenaHandleRelease(Arena* a, ArenaHandle handle);
+
+// Move handle blocks out of sparsely used zones into denser ones, so the zones they leave become empty.
+// Only zones holding nothing but handle blocks are emptied -- anything allocated with `ArenaAllocate` pins its zone.
+// Stops after moving `byteBudget` bytes (zero for no limit), so can be spread over idle frames.
+// Returns the number of zones emptied. Pointers from `ArenaHandleGet` are invalid afterwards.
+int ArenaCompact(Arena* a, size_t byteBudget);
+
+// Largest object served by the slab allocator. Larger requests go straight to the arena
+#define SLAB_MAX_SIZE 32768
+
+// Allocate a fixed-size object from the arena's size-class free lists.
+// Objects are reused at object granularity. Release with `ArenaSlabRelease`, never `ArenaDereference`.
+void* ArenaSlabAllocate(Arena* a, size_t byteCount);
+// Allocate a slab object, and set all bytes to zero
+void* ArenaSlabAllocateAndClear(Arena* a, size_t byteCount);
+// Return an object to its size-class free list. `byteCount` must match the size it was allocated with.
+// Returns false, changing nothing, if `ptr` is not a live slab object of that size. Batches left empty go back to the arena.
+bool ArenaSlabRelease(Arena* a, void* ptr, size_t byteCount);
+// Read slab statistics. Pass `NULL` for anything you're not interested in.
+// `slabBytes` is all memory taken for slabs, `liveBytes` is what callers asked for,
+// `freeBytes` is on the free lists, and `wastedBytes` is lost to rounding up to size classes.
+void ArenaGetSlabState(Arena* a, size_t* slabBytes, size_t* liveBytes, size_t* freeBytes, size_t* wastedBytes);
+
 // Read statistics for this Arena. Pass `NULL` for anything you're not interested in.
+// `largestContiguous` includes runs of empty zones, so is the largest allocation that could succeed.
+// Everything except `largestContiguous` is kept as a running total, so is cheap to read every frame.
+// Asking for `largestContiguous`, or reading a concurrent arena, scans every zone.
 void ArenaGetState(Arena* a, size_t* allocatedBytes, size_t* unallocatedBytes, int* occupiedZones, int* emptyZones, int* totalReferenceCount, size_t* largestContiguous);
 
-// Set a flag on this arena instance to help with debugging
-// The ARENA_DEBUG flag must also be defined
+// Read usage since the arena was created or last reset. Pass `NULL` for anything you're not interested in.
+// `peakBytes` is the high-water mark of allocated bytes, including alignment padding.
+// `allocationCount` and `allocationBytes` count every successful allocation; they wrap, so take differences for rates.
+// Not updated while the arena is concurrent.
+void ArenaGetUsage(Arena* a, size_t* peakBytes, uint32_t* allocationCount, size_t* allocationBytes);
+
+// Record this arena's allocations, references, dereferences and zone releases in the trace ring buffer.
+// Does nothing unless ARENA_TRACE is defined
 void TraceArena(Arena* a, bool traceOn);
 
+// Write the trace ring buffer to a file, oldest event first. Read it with the `ArenaTraceReport` tool.
+// Returns false if tracing is not compiled in, or the file could not be written.
+// Events being written by other threads while this runs may be left out.
+bool ArenaTraceWrite(const char* path);
+// Drop all events from the trace ring buffer. No traced arena may be in use while this runs
+void ArenaTraceClear();
+
+// System-level allocation. All calls to the stdlib allocator should go through these, so they can be counted
+void* ArenaSystemAllocate(size_t byteCount);
+// System-level allocation, with all bytes set to zero
+void* ArenaSystemAllocateAndClear(size_t byteCount);
+// Release memory from `ArenaSystemAllocate` or `ArenaSystemAllocateAndClear`
+void ArenaSystemFree(void* ptr);
+// Reserve zero-filled memory for arena storage. Uses mmap if ARENA_MMAP is defined.
+// `byteCount` is updated to the actual size reserved, which must be passed to `ArenaSystemRelease`
+void* ArenaSystemReserve(size_t* byteCount);
+// Release memory from `ArenaSystemReserve`
+void ArenaSystemRelease(void* ptr, size_t byteCount);
+
+// Record arena allocations made by the calling thread against `site` until the matching `ArenaSiteLeave`,
+// including those made deep inside container functions. If a site is already set, the outer one is kept.
+// `site` must be a string literal, such as ARENA_CALL_SITE. Returns the value to pass to `ArenaSiteLeave`.
+// Does nothing unless ARENA_ACCOUNTING or ARENA_TRACE is defined
+const char* ArenaSiteEnter(const char* site);
+// End the call site started by `ArenaSiteEnter`
+void ArenaSiteLeave(const char* outerSite);
+
+// Reset the calling thread's accounting counters. Does nothing unless ARENA_ACCOUNTING is defined
+void ArenaAccountingReset();
+// Number of system allocator calls (allocate or free) by the calling thread since its last reset
+int ArenaAccountingSystemCalls();
+// Number of arena allocations by the calling thread since its last reset
+int ArenaAccountingArenaCalls();
+// Write counts of system calls and arena allocations by call site to stdout
+void ArenaAccountingReport();
+
+// Trace event kinds
+#define ARENA_EVENT_ALLOCATE        1 // `offset`, `zone` and `size` of a new allocation
+#define ARENA_EVENT_REFERENCE       2 // `offset` and `zone` of a pointer given to `ArenaReference`
+#define ARENA_EVENT_DEREFERENCE     3 // `offset` and `zone` of a pointer given to `ArenaDereference`
+#define ARENA_EVENT_RELEASE_ZONE    4 // a zone (or the first zone of a large allocation) was emptied. `size` is the bytes it held
+#define ARENA_EVENT_RESET           5 // every allocation in the arena was released at once
+#define ARENA_EVENT_DROP            6 // the arena was deallocated
+#define ARENA_EVENT_SLAB_ALLOCATE   7 // `offset`, `zone` and `size` of an object from `ArenaSlabAllocate`. Its batch is traced as a normal allocation
+#define ARENA_EVENT_SLAB_RELEASE    8 // `offset`, `zone` and `size` of an object given to `ArenaSlabRelease`
+
+// One entry in the trace ring buffer, and in trace files
+typedef struct ArenaTraceEvent {
+    uint64_t time;      // nanoseconds, from an arbitrary start
+    uint32_t sequence;  // order events were recorded in, starting at 1. Zero for an unused slot
+    uint32_t offset;    // byte offset of the pointer from the start of the arena's first zone
+    uint32_t size;      // bytes requested, or held by a released zone
+    int32_t zone;       // zone index, or -1
+    uint16_t arena;     // trace id of the arena, unique while the program runs
+    uint16_t site;      // call site index in the file's site table. Zero is untagged
+    uint8_t kind;       // one of the ARENA_EVENT_... values
+    uint8_t _padding[7];
+} ArenaTraceEvent;
+
+// Start of a trace file. It is followed by `siteCount` sites, each a uint16_t length and that many characters;
+// then `eventCount` ArenaTraceEvent records
+typedef struct ArenaTraceFileHeader {
+    char magic[8];          // "ArenaTr" and a zero
+    uint32_t version;       // ARENA_TRACE_FILE_VERSION
+    uint32_t eventCount;
+    uint32_t siteCount;
+    uint32_t droppedCount;  // events overwritten before the file was written
+} ArenaTraceFileHeader;
+
+#define ARENA_TRACE_FILE_VERSION 1
+
+#if defined(ARENA_ACCOUNTING) || defined(ARENA_TRACE)
+#define ARENA_TAGGED_CALLS 1
+#endif
+
+// Tag for the calling source line. Null when call sites are not recorded
+#ifdef ARENA_TAGGED_CALLS
+#define ARENA_STRINGIFY_INNER(x) #x
+#define ARENA_STRINGIFY(x) ARENA_STRINGIFY_INNER(x)
+#define ARENA_CALL_SITE __FILE__ ":" ARENA_STRINGIFY(__LINE__)
+#else
+#define ARENA_CALL_SITE nullptr
+#endif
+
+#ifdef ARENA_TAGGED_CALLS
+// The tagged allocators record the given call site, unless one was already set by `ArenaSiteEnter`
+
+// Allocate, recording the given call site in the accounting tables and trace
+void* ArenaAllocateTagged(Arena* a, size_t byteCount, const char* site);
+// Allocate and clear, recording the given call site in the accounting tables and trace
+void* ArenaAllocateAndClearTagged(Arena* a, size_t byteCount, const char* site);
+// Allocate aligned, recording the given call site in the accounting tables and trace
+void* ArenaAllocateAlignedTagged(Arena* a, size_t byteCount, size_t alignment, const char* site);
+// Allocate a slab object, recording the given call site in the accounting tables and trace
+void* ArenaSlabAllocateTagged(Arena* a, size_t byteCount, const char* site);
+// Allocate and clear a slab object, recording the given call site in the accounting tables and trace
+void* ArenaSlabAllocateAndClearTagged(Arena* a, size_t byteCount, const char* site);
+
+// Attribute all arena allocations to the calling source line. Vector, String and HashMap constructors
+// do the same, so allocations they make are recorded against their caller rather than their own source lines
+#define ArenaAllocate(a, byteCount) ArenaAllocateTagged((a), (byteCount), ARENA_CALL_SITE)
+#define ArenaAllocateAndClear(a, byteCount) ArenaAllocateAndClearTagged((a), (byteCount), ARENA_CALL_SITE)
+#define ArenaAllocateAligned(a, byteCount, alignment) ArenaAllocateAlignedTagged((a), (byteCount), (alignment), ARENA_CALL_SITE)
+#define ArenaSlabAllocate(a, byteCount) ArenaSlabAllocateTagged((a), (byteCount), ARENA_CALL_SITE)
+#define ArenaSlabAllocateAndClear(a, byteCount) ArenaSlabAllocateAndClearTagged((a), (byteCount), ARENA_CALL_SITE)
+#endif
+
 #endif
 #pragma clang diagnostic pop
\ No newline at end of file
@@ -0,0 +1,404 @@
+#include "ConcurrentHashMap.h"
+#include "MemoryManager.h"
+#include "RawData.h"
+
+#include <atomic>
+#include <thread>
+
+// Fixed sizes -- these are structural to the code and must not change
+#define CONCURRENT_MAP_STRIPE_BITS 6 // 64 stripes, so writers to different keys rarely wait for each other
+const uint32_t STRIPE_COUNT = 1 << CONCURRENT_MAP_STRIPE_BITS;
+const uint32_t SLOT_EMPTY = 0; // hash of a slot that was never used
+const uint32_t SLOT_DELETED = 1; // hash of a removed entry. Lookups probe past these.
+const uint32_t SLOT_FILLED = 0x80000000; // set in the hash of every live entry, so it can't match the markers above
+const uint32_t MAX_STRIPE_CAPACITY = 1 << 24; // safety limit for growing a stripe
+
+// Tuning parameters
+const uint32_t MIN_STRIPE_CAPACITY = 16;
+const float STRIPE_LOAD_FACTOR = 0.75f; // live and removed entries, as a fraction of the slots
+const uint32_t SPINS_BEFORE_YIELD = 64; // a writer that was switched out can hold a stripe for a whole time slice
+
+// Slots are made of atomic words, so readers can copy them while a writer changes them.
+// Only relaxed loads and stores are used: ordering comes from the fences around the stripe sequence.
+typedef std::atomic<uint32_t> SlotWord;
+
+// Slot storage of a stripe. Slots are [hash][key words][value words] after the header.
+// Readers take the capacity from here, so always agree with the slots they are reading.
+typedef struct StripeTable {
+    StripeTable* retired; // older tables of the same stripe, kept until the map is deallocated
+    uint32_t capacity; // number of slots. Always a power of two
+    uint32_t _pad;
+} StripeTable;
+
+// A stripe of the map. Padded to a cache line, so writes to one stripe don't slow readers of its neighbours.
+typedef struct Stripe {
+    std::atomic<uint32_t> sequence; // odd while a writer holds the stripe
+    std::atomic<uint32_t> count; // live entries
+    uint32_t used; // live and removed entries. Only touched by the writer.
+    uint32_t _pad;
+    std::atomic<StripeTable*> table;
+    char _cacheLine[64 - 16 - sizeof(void*)];
+} Stripe;
+static_assert(sizeof(Stripe) == 64, "stripes must fill one cache line");
+
+typedef struct ConcurrentHashMap {
+    Arena* memory;
+    unsigned int KeyByteSize;
+    unsigned int ValueByteSize;
+    unsigned int keyWords; // key bytes, rounded up to whole words
+    unsigned int slotWords; // hash, key and value words
+    bool(*KeyComparer)(void* key_A, void* key_B);
+    unsigned int(*GetHash)(void* key);
+    Stripe* stripes;
+} ConcurrentHashMap;
+
+// Spread the caller's hash, so both the stripe (high bits) and the slot (low bits) are well mixed
+inline uint32_t StripeMix(uint32_t hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+inline SlotWord* SlotAt(ConcurrentHashMap* h, StripeTable* table, uint32_t index) {
+    return (SlotWord*)byteOffset(table, sizeof(StripeTable) + (size_t)index * h->slotWords * sizeof(uint32_t));
+}
+inline uint32_t SlotHash(SlotWord* slot) {
+    return slot->load(std::memory_order_relaxed);
+}
+inline void SetSlotHash(SlotWord* slot, uint32_t hash) {
+    slot->store(hash, std::memory_order_relaxed);
+}
+
+// Copy bytes into slot words. The spare bytes of the last word are zeroed.
+inline void StoreWords(SlotWord* dst, const void* src, uint32_t byteCount) {
+    auto bytes = (const char*)src;
+    for (; byteCount >= 4; byteCount -= 4, bytes += 4) {
+        uint32_t word;
+        memcpy(&word, bytes, 4);
+        (dst++)->store(word, std::memory_order_relaxed);
+    }
+    if (byteCount < 1) return;
+    uint32_t word = 0;
+    memcpy(&word, bytes, byteCount);
+    dst->store(word, std::memory_order_relaxed);
+}
+// Copy whole slot words out to memory
+inline void LoadWords(uint32_t* dst, SlotWord* src, uint32_t wordCount) {
+    for (uint32_t i = 0; i < wordCount; i++) dst[i] = src[i].load(std::memory_order_relaxed);
+}
+// Copy a whole slot
+inline void CopySlot(ConcurrentHashMap* h, SlotWord* dst, SlotWord* src) {
+    for (uint32_t i = 0; i < h->slotWords; i++) dst[i].store(src[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+StripeTable* AllocateTable(ConcurrentHashMap* h, uint32_t capacity) {
+    auto byteCount = sizeof(StripeTable) + (size_t)capacity * h->slotWords * sizeof(uint32_t);
+    auto table = (StripeTable*)ArenaAllocateAligned(h->memory, byteCount, sizeof(void*));
+    if (table == nullptr) return nullptr;
+    for (size_t i = 0; i < byteCount; i++) ((char*)table)[i] = 0;
+    table->capacity = capacity;
+    return table;
+}
+
+// Wait a little for a stripe held by a writer
+inline void StripeBackoff(uint32_t* spins) {
+    if (++(*spins) < SPINS_BEFORE_YIELD) return;
+    std::this_thread::yield();
+    *spins = 0;
+}
+
+// Take the stripe's write lock. Readers see an odd sequence until `StripeUnlock`
+inline void StripeLock(Stripe* s) {
+    uint32_t spins = 0;
+    for (;;) {
+        auto sequence = s->sequence.load(std::memory_order_relaxed);
+        if ((sequence & 1) == 0 && s->sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire)) break;
+        StripeBackoff(&spins);
+    }
+    std::atomic_thread_fence(std::memory_order_release); // slot writes can't move above the odd sequence
+}
+inline void StripeUnlock(Stripe* s) {
+    s->sequence.fetch_add(1, std::memory_order_release);
+}
+
+// Find a live entry in a locked stripe. Returns the slot index, or the capacity if not found.
+// `freeIndex` gets the first reusable slot on the probe sequence.
+uint32_t StripeFind(ConcurrentHashMap* h, StripeTable* table, uint32_t mixed, uint32_t tag, void* key, uint32_t* freeIndex) {
+    auto mask = table->capacity - 1;
+    *freeIndex = table->capacity;
+    for (uint32_t i = 0; i < table->capacity; i++) {
+        auto index = (mixed + i) & mask;
+        auto slot = SlotAt(h, table, index);
+        auto slotHash = SlotHash(slot);
+        if (slotHash == SLOT_EMPTY) {
+            if (*freeIndex == table->capacity) *freeIndex = index;
+            break;
+        }
+        if (slotHash == SLOT_DELETED) {
+            if (*freeIndex == table->capacity) *freeIndex = index;
+            continue;
+        }
+        if (slotHash != tag) continue;
+
+        uint32_t slotKey[CONCURRENT_MAP_MAX_ENTRY / 4 + 1];
+        LoadWords(slotKey, slot + 1, h->keyWords);
+        if (h->KeyComparer(slotKey, key)) return index;
+    }
+    return table->capacity;
+}
+
+// Home slot of a live entry, from its stored key
+inline uint32_t SlotHome(ConcurrentHashMap* h, SlotWord* slot) {
+    uint32_t slotKey[CONCURRENT_MAP_MAX_ENTRY / 4 + 1];
+    LoadWords(slotKey, slot + 1, h->keyWords);
+    return StripeMix(h->GetHash(slotKey));
+}
+
+// Move a locked stripe's live entries into a bigger table. The old table is retired.
+bool StripeGrow(ConcurrentHashMap* h, Stripe* s, uint32_t capacity) {
+    auto oldTable = s->table.load(std::memory_order_relaxed);
+    auto newTable = AllocateTable(h, capacity);
+    if (newTable == nullptr) return false;
+
+    auto mask = capacity - 1;
+    for (uint32_t i = 0; i < oldTable->capacity; i++) {
+        auto src = SlotAt(h, oldTable, i);
+        if ((SlotHash(src) & SLOT_FILLED) == 0) continue;
+
+        auto index = SlotHome(h, src) & mask;
+        while (SlotHash(SlotAt(h, newTable, index)) != SLOT_EMPTY) index = (index + 1) & mask;
+        CopySlot(h, SlotAt(h, newTable, index), src);
+    }
+
+    newTable->retired = oldTable;
+    s->used = s->count.load(std::memory_order_relaxed);
+    s->table.store(newTable, std::memory_order_release);
+    return true;
+}
+
+// Drop the removed markers of a locked stripe, without a new table.
+// Readers see the odd sequence throughout, so they retry rather than trust a half-moved entry.
+void StripePurge(ConcurrentHashMap* h, Stripe* s) {
+    auto table = s->table.load(std::memory_order_relaxed);
+    auto capacity = table->capacity;
+    auto mask = capacity - 1;
+
+    // Start just after a slot that was empty before the purge. No probe run crosses it,
+    // so walking forward from there, every live entry's home is at or behind it.
+    uint32_t start = 0;
+    while (SlotHash(SlotAt(h, table, start)) != SLOT_EMPTY) start++; // the load factor leaves some empty
+    for (uint32_t i = 0; i < capacity; i++) {
+        auto slot = SlotAt(h, table, i);
+        if (SlotHash(slot) == SLOT_DELETED) SetSlotHash(slot, SLOT_EMPTY);
+    }
+
+    // Pull each live entry back to the first free slot after its home
+    for (uint32_t i = 1; i < capacity; i++) {
+        auto index = (start + i) & mask;
+        auto slot = SlotAt(h, table, index);
+        if ((SlotHash(slot) & SLOT_FILLED) == 0) continue;
+
+        auto target = SlotHome(h, slot) & mask;
+        while (target != index && SlotHash(SlotAt(h, table, target)) != SLOT_EMPTY) target = (target + 1) & mask;
+        if (target == index) continue; // already as close as it can be
+
+        CopySlot(h, SlotAt(h, table, target), slot);
+        SetSlotHash(slot, SLOT_EMPTY);
+    }
+    s->used = s->count.load(std::memory_order_relaxed);
+}
+
+ConcurrentHashMap* ConcurrentHashMapAllocateArena(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key)) {
+    if (a == nullptr || keyComparerFunc == nullptr || getHashFunc == nullptr) return nullptr;
+    if (keyByteSize < 1 || valueByteSize < 0 || keyByteSize + valueByteSize > CONCURRENT_MAP_MAX_ENTRY) return nullptr;
+
+    auto result = (ConcurrentHashMap*)ArenaAllocateAndClear(a, sizeof(ConcurrentHashMap));
+    if (result == nullptr) return nullptr;
+    result->memory = a;
+    result->KeyByteSize = (unsigned int)keyByteSize;
+    result->ValueByteSize = (unsigned int)valueByteSize;
+    result->keyWords = (result->KeyByteSize + 3) / 4;
+    result->slotWords = 1 + result->keyWords + ((result->ValueByteSize + 3) / 4);
+    result->KeyComparer = keyComparerFunc;
+    result->GetHash = getHashFunc;
+
+    result->stripes = (Stripe*)ArenaAllocateAligned(a, sizeof(Stripe) * STRIPE_COUNT, 64);
+    if (result->stripes == nullptr) {
+        ArenaDereference(a, result);
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < sizeof(Stripe) * STRIPE_COUNT; i++) ((char*)result->stripes)[i] = 0;
+
+    auto capacity = NextPow2((uint32_t)((float)(size / STRIPE_COUNT + 1) / STRIPE_LOAD_FACTOR));
+    if (capacity < MIN_STRIPE_CAPACITY) capacity = MIN_STRIPE_CAPACITY;
+    if (capacity > MAX_STRIPE_CAPACITY) capacity = MAX_STRIPE_CAPACITY;
+    for (uint32_t i = 0; i < STRIPE_COUNT; i++) {
+        auto table = AllocateTable(result, capacity);
+        result->stripes[i].table.store(table, std::memory_order_relaxed);
+        if (table == nullptr) {
+            ConcurrentHashMapDeallocate(result);
+            return nullptr;
+        }
+    }
+    return result;
+}
+
+ConcurrentHashMap* ConcurrentHashMapAllocate(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key)) {
+    return ConcurrentHashMapAllocateArena(MMCurrent(), size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc);
+}
+
+void ConcurrentHashMapDeallocate(ConcurrentHashMap* h) {
+    if (h == nullptr) return;
+    auto a = h->memory;
+    if (h->stripes != nullptr) {
+        for (uint32_t i = 0; i < STRIPE_COUNT; i++) {
+            auto table = h->stripes[i].table.load(std::memory_order_acquire);
+            while (table != nullptr) {
+                auto next = table->retired;
+                ArenaDereference(a, table);
+                table = next;
+            }
+        }
+        ArenaDereference(a, h->stripes);
+    }
+    ArenaDereference(a, h);
+}
+
+bool ConcurrentHashMapGet(ConcurrentHashMap* h, void* key, void* outValue) {
+    if (h == nullptr || key == nullptr) return false;
+
+    auto hash = h->GetHash(key);
+    auto tag = hash | SLOT_FILLED;
+    auto mixed = StripeMix(hash);
+    auto s = &h->stripes[mixed >> (32 - CONCURRENT_MAP_STRIPE_BITS)];
+    auto copyWords = h->slotWords - 1;
+    uint32_t entry[CONCURRENT_MAP_MAX_ENTRY / 4 + 2]; // candidate key and value words, only compared once known to be whole
+    uint32_t spins = 0;
+
+    for (;; StripeBackoff(&spins)) {
+        auto sequence = s->sequence.load(std::memory_order_acquire);
+        if (sequence & 1) continue; // a writer has the stripe
+
+        auto table = s->table.load(std::memory_order_acquire);
+        auto mask = table->capacity - 1;
+        bool found = false, torn = false;
+        for (uint32_t i = 0; i < table->capacity; i++) {
+            auto slot = SlotAt(h, table, (mixed + i) & mask);
+            auto slotHash = SlotHash(slot);
+            if (slotHash == SLOT_EMPTY) break;
+            if (slotHash != tag) continue;
+
+            LoadWords(entry, slot + 1, copyWords);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s->sequence.load(std::memory_order_relaxed) != sequence) { torn = true; break; }
+            if (h->KeyComparer(entry, key)) { found = true; break; }
+        }
+
+        // a miss is only trusted if no write overlapped the whole probe
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (torn || s->sequence.load(std::memory_order_relaxed) != sequence) continue;
+
+        if (found && outValue != nullptr) copyBytes(outValue, entry + h->keyWords, h->ValueByteSize);
+        return found;
+    }
+}
+
+bool ConcurrentHashMapPut(ConcurrentHashMap* h, void* key, void* value, bool canReplace) {
+    if (h == nullptr || key == nullptr) return false;
+
+    auto hash = h->GetHash(key);
+    auto tag = hash | SLOT_FILLED;
+    auto mixed = StripeMix(hash);
+    auto s = &h->stripes[mixed >> (32 - CONCURRENT_MAP_STRIPE_BITS)];
+
+    StripeLock(s);
+    auto table = s->table.load(std::memory_order_relaxed);
+    uint32_t freeIndex;
+    auto index = StripeFind(h, table, mixed, tag, key, &freeIndex);
+    if (index < table->capacity) { // existing entry
+        if (canReplace) StoreWords(SlotAt(h, table, index) + 1 + h->keyWords, value, h->ValueByteSize);
+        StripeUnlock(s);
+        return canReplace;
+    }
+
+    // grow if full, or just clear out removed markers in place if most of the slots are those
+    auto reuse = freeIndex < table->capacity && SlotHash(SlotAt(h, table, freeIndex)) == SLOT_DELETED;
+    if (!reuse && (float)(s->used + 1) > (float)table->capacity * STRIPE_LOAD_FACTOR) {
+        auto capacity = table->capacity;
+        if ((s->count.load(std::memory_order_relaxed) + 1) * 2 > capacity) {
+            if (capacity * 2 > MAX_STRIPE_CAPACITY || !StripeGrow(h, s, capacity * 2)) {
+                StripeUnlock(s);
+                return false;
+            }
+        } else {
+            StripePurge(h, s);
+        }
+        table = s->table.load(std::memory_order_relaxed);
+        StripeFind(h, table, mixed, tag, key, &freeIndex);
+    }
+
+    auto slot = SlotAt(h, table, freeIndex);
+    StoreWords(slot + 1, key, h->KeyByteSize);
+    StoreWords(slot + 1 + h->keyWords, value, h->ValueByteSize);
+    SetSlotHash(slot, tag);
+    if (!reuse) s->used++;
+    s->count.fetch_add(1, std::memory_order_relaxed);
+    StripeUnlock(s);
+    return true;
+}
+
+bool ConcurrentHashMapRemove(ConcurrentHashMap* h, void* key) {
+    if (h == nullptr || key == nullptr) return false;
+
+    auto hash = h->GetHash(key);
+    auto mixed = StripeMix(hash);
+    auto s = &h->stripes[mixed >> (32 - CONCURRENT_MAP_STRIPE_BITS)];
+
+    StripeLock(s);
+    auto table = s->table.load(std::memory_order_relaxed);
+    uint32_t freeIndex;
+    auto index = StripeFind(h, table, mixed, hash | SLOT_FILLED, key, &freeIndex);
+    if (index >= table->capacity) {
+        StripeUnlock(s);
+        return false;
+    }
+
+    // if this ends a probe run, it and any removed markers before it become empty again
+    auto mask = table->capacity - 1;
+    if (SlotHash(SlotAt(h, table, (index + 1) & mask)) == SLOT_EMPTY) {
+        for (uint32_t i = 0; i < table->capacity; i++) {
+            SetSlotHash(SlotAt(h, table, index), SLOT_EMPTY);
+            s->used--;
+            index = (index - 1) & mask;
+            if (SlotHash(SlotAt(h, table, index)) != SLOT_DELETED) break;
+        }
+    } else {
+        SetSlotHash(SlotAt(h, table, index), SLOT_DELETED);
+    }
+    s->count.fetch_sub(1, std::memory_order_relaxed);
+    StripeUnlock(s);
+    return true;
+}
+
+void ConcurrentHashMapClear(ConcurrentHashMap* h) {
+    if (h == nullptr) return;
+    for (uint32_t i = 0; i < STRIPE_COUNT; i++) {
+        auto s = &h->stripes[i];
+        StripeLock(s);
+        auto table = s->table.load(std::memory_order_relaxed);
+        for (uint32_t j = 0; j < table->capacity; j++) SetSlotHash(SlotAt(h, table, j), SLOT_EMPTY);
+        s->used = 0;
+        s->count.store(0, std::memory_order_relaxed);
+        StripeUnlock(s);
+    }
+}
+
+unsigned int ConcurrentHashMapCount(ConcurrentHashMap* h) {
+    if (h == nullptr) return 0;
+    unsigned int total = 0;
+    for (uint32_t i = 0; i < STRIPE_COUNT; i++) total += h->stripes[i].count.load(std::memory_order_relaxed);
+    return total;
+}
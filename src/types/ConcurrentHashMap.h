@@ -0,0 +1,42 @@
+#pragma once
+
+#ifndef concurrent_hashmap_h
+#define concurrent_hashmap_h
+#include "ArenaAllocator.h"
+
+// A hash map for read-mostly data shared between threads (caches of materials, glyphs, textures...)
+// Any number of threads can read while others write. Reads never take a lock or write to shared memory.
+//
+// The map is split into stripes by hash. Each stripe has its own buckets and a sequence lock:
+// writers to the same stripe wait for each other, and readers retry if a write to their stripe overlapped.
+// Values are copied out rather than handed back as pointers, as another thread could replace them.
+//
+// Keys and values are stored by copy, like `HashMap`. If keys point to other data, that must stay alive
+// and unchanged while the map can be read. If more than one thread writes, the arena must be concurrent (see `ArenaSetConcurrent`).
+// Buckets replaced by growth are kept until the map is deallocated, as readers may still be looking at them.
+
+// Largest key plus value size. Readers copy candidate entries to the stack before comparing keys.
+#define CONCURRENT_MAP_MAX_ENTRY 256
+
+typedef struct ConcurrentHashMap ConcurrentHashMap;
+
+// Create a new concurrent hash map with an initial size, pinned to a specific arena.
+// Returns null if the arena is null or out of memory, or the key and value are larger than `CONCURRENT_MAP_MAX_ENTRY`.
+ConcurrentHashMap* ConcurrentHashMapAllocateArena(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key));
+// Create a new concurrent hash map in the current arena. See `ConcurrentHashMapAllocateArena`
+ConcurrentHashMap* ConcurrentHashMapAllocate(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key));
+// Deallocate the map and all its buckets. No other thread may be using it.
+void ConcurrentHashMapDeallocate(ConcurrentHashMap* h);
+
+// Returns true if the key is found. If so, its value is copied to `outValue`, unless that is null. Lock free.
+bool ConcurrentHashMapGet(ConcurrentHashMap* h, void* key, void* outValue);
+// Add a key/value pair to the map. If `canReplace` is true, conflicts replace existing data. if false, existing data survives
+bool ConcurrentHashMapPut(ConcurrentHashMap* h, void* key, void* value, bool canReplace);
+// Remove the entry for the given key, if it exists
+bool ConcurrentHashMapRemove(ConcurrentHashMap* h, void* key);
+// Remove all entries, a stripe at a time. Entries put by other threads during the clear may survive.
+void ConcurrentHashMapClear(ConcurrentHashMap* h);
+// Count of entries in the map. Only a snapshot if other threads are writing.
+unsigned int ConcurrentHashMapCount(ConcurrentHashMap* h);
+
+#endif
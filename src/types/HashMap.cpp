@@ -3,6 +3,20 @@
 #include "MemoryManager.h"
 #include "RawData.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef ARENA_TAGGED_CALLS
+// the real functions are defined here, the call-site macros are only for users
+#undef HashMapAllocate
+#undef HashMapAllocateArena
+#undef HashMapAllocateGrouped
+#undef HashMapAllocateArenaGrouped
+#undef HashMapAllocateIncremental
+#undef HashMapAllocateArenaIncremental
+#endif
+
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "OCUnusedGlobalDeclarationInspection"
 // Fixed sizes -- these are structural to the code and must not change
@@ -12,9 +26,21 @@ const unsigned int SAFE_HASH = 0x80000000; // just in case you get a zero result
 // Tuning parameters: have a play if you have performance or memory issues.
 const unsigned int MIN_BUCKET_SIZE = 64; // default size used if none given
 const float LOAD_FACTOR = 0.8f; // higher is more memory efficient. Lower is faster, to a point.
+const unsigned int MIGRATE_BUCKETS = 32; // old buckets moved by each put or remove during an incremental resize
+const unsigned int PREPARE_BUCKETS = 64; // new buckets made ready by each put or remove before an incremental resize
 
 //#define AGGRESSIVE_SCALING 1
 
+// Grouped storage (see `HashMapAllocateArenaGrouped`)
+const unsigned int GROUP_WIDTH = 16; // control bytes matched at once. Structural: SSE2 register width
+const float GROUPED_LOAD_FACTOR = 0.875f; // grouped maps stay fast at a higher load
+const uint8_t CTRL_EMPTY = 0x80; // control byte of a slot that was never used
+const uint8_t CTRL_DELETED = 0xFE; // control byte of a removed entry. Lookups probe past these.
+const uint32_t NO_INDEX = 0xFFFFFFFF;
+
+#define HASHMAP_GROUPED 1 // control byte groups and flat slots, rather than robin-hood buckets
+#define HASHMAP_INCREMENTAL 2 // robin-hood buckets are resized a few at a time
+
 // Entry in the hash-table
 // The actual entries are tagged on the end of the entry
 typedef struct HashMap_Entry {
@@ -37,6 +63,27 @@ typedef struct HashMap {
     unsigned int shrinkAt;
 
     bool IsValid; // if false, the hash map has failed
+    HashMap_Entry* scratch; // two entries: one being placed by a put, and one being moved by an incremental resize (robin-hood buckets only)
+
+    // Incremental resize (robin-hood buckets only). `countUsed` counts entries in both sets of buckets.
+    bool incremental;
+    Vector* oldBuckets; // buckets still being emptied into `buckets`, or null
+    uint8_t* oldRemoved; // bit per old bucket, set when its entry is removed before being moved
+    unsigned int oldCount;
+    unsigned int oldCountMod;
+    unsigned int migrateNext; // old buckets before this have been moved
+    unsigned int prepareAt; // `countUsed` at which to start making the next buckets ready for growing. For shrinking, it's `shrinkAt` and an eighth
+    Vector* nextBuckets; // empty buckets being made ready for the next resize, or null
+    uint8_t* nextRemoved; // `oldRemoved` for when the current buckets become old, being cleared alongside
+    unsigned int nextCount; // size of `nextBuckets` once ready
+    unsigned int nextRemovedCleared; // bytes of `nextRemoved` cleared so far
+
+    // Grouped storage. `count` and `countMod` are the slot count and mask, and `countUsed` the live entries.
+    bool grouped;
+    uint8_t* ctrl; // control byte per slot: `CTRL_EMPTY`, `CTRL_DELETED` or the low 7 bits of the mixed hash of its key
+    char* slots; // [key][value] per slot. Follows the control bytes in the same block
+    unsigned int slotSize;
+    unsigned int growthLeft; // inserts into empty slots before we must rehash
 
     // Should return true IFF the two key objects are equal
     bool(*KeyComparer)(void* key_A, void* key_B);
@@ -48,16 +95,27 @@ typedef struct HashMap {
 
 bool HashMapIsValid(HashMap *h) {
     if (h == nullptr) return false;
+    if (h->grouped) return h->IsValid;
     if (!VectorIsValid(h->buckets)) return false;
     return h->IsValid;
 }
 
 bool ResizeNext(HashMap * h); // defined below
+bool GroupedResize(HashMap* h, uint32_t newSize); // defined below
 
-inline uint32_t DistanceToInitIndex(HashMap * h, uint32_t indexStored, HashMap_Entry* entry) {
-    auto indexInit = entry->hash & h->countMod;
+// Distance of an entry from its home bucket, in a set of `count` buckets
+inline uint32_t DistanceIn(uint32_t count, uint32_t countMod, uint32_t indexStored, HashMap_Entry* entry) {
+    auto indexInit = entry->hash & countMod;
     if (indexInit <= indexStored) return indexStored - indexInit;
-    return indexStored + (h->count - indexInit);
+    return indexStored + (count - indexInit);
+}
+
+inline uint32_t DistanceToInitIndex(HashMap * h, uint32_t indexStored, HashMap_Entry* entry) {
+    return DistanceIn(h->count, h->countMod, indexStored, entry);
+}
+
+inline size_t EntrySize(HashMap* h) {
+    return sizeof(HashMap_Entry) + h->KeyByteSize + h->ValueByteSize;
 }
 
 inline void* KeyPtr(HashMap_Entry* e) {
@@ -67,40 +125,22 @@ inline void* ValuePtr(HashMap* h, HashMap_Entry* e) {
     return byteOffset(e, sizeof(HashMap_Entry) + h->KeyByteSize);
 }
 
-inline bool SwapOut(Vector* vec, uint32_t idx, HashMap_Entry* newEntry) {
-    if (vec == nullptr) return false;
-
-    auto size = VectorElementSize(vec);
-
-    // use push/pop to do temp allocation
-    if (!VectorPush(vec, newEntry)) return false;
-
-    auto temp = VectorGet(vec, -1);
-
-    if (!VectorSet(vec, (int)idx, newEntry, temp)) {
-        VectorPop(vec, nullptr);
-        return false;
-    }
-    writeValue(newEntry, 0, temp, size);
-    VectorPop(vec, nullptr);
-    return true;
-}
-
+// Place `entry` in the buckets. `entry` is used as the carry slot for robin-hood swaps, so its contents are changed.
 bool PutInternal(HashMap * h, HashMap_Entry* entry, bool canReplace, bool checkDuplicates) {
+    if (!VectorIsValid(h->buckets)) return false;
     uint32_t indexInit = entry->hash & h->countMod;
     uint32_t probeCurrent = 0;
+    auto entrySize = VectorElementSize(h->buckets);
 
     for (uint32_t i = 0; i < h->count; i++) {
-        auto indexCurrent = (int)((indexInit + i) & h->countMod);
+        auto indexCurrent = (indexInit + i) & h->countMod;
 
-        if (!VectorIsValid(h->buckets))
-            return false;
-        auto current = (HashMap_Entry*)VectorGet(h->buckets, indexCurrent);
+        auto current = (HashMap_Entry*)VectorGet(h->buckets, (int)indexCurrent);
         if (current == nullptr) return false; // internal failure
 
         if (current->hash == 0) {
             h->countUsed++;
-            VectorSet(h->buckets, indexCurrent, entry, nullptr);
+            copyBytes(current, entry, entrySize);
             return true;
         }
 
@@ -109,18 +149,16 @@ bool PutInternal(HashMap * h, HashMap_Entry* entry, bool canReplace, bool checkD
             ) {
             if (!canReplace) return false;
 
-            if (!VectorIsValid(h->buckets)) return false;
-
-            VectorSet(h->buckets, indexCurrent, entry, nullptr);
+            copyBytes(current, entry, entrySize);
             return true;
         }
 
-        // Perform the core robin-hood balancing
+        // Perform the core robin-hood balancing: take the bucket from an entry closer to home, and carry that on instead
         auto probeDistance = DistanceToInitIndex(h, indexCurrent, current);
         if (probeCurrent > probeDistance) {
             probeCurrent = probeDistance;
-            if (!SwapOut(h->buckets, indexCurrent, entry))
-                return false;
+            swapMem(current, entry, entrySize);
+            checkDuplicates = false; // the carried entry is already unique
         }
         probeCurrent++;
     }
@@ -130,7 +168,164 @@ bool PutInternal(HashMap * h, HashMap_Entry* entry, bool canReplace, bool checkD
     return PutInternal(h, entry, canReplace, checkDuplicates);
 }
 
+/*
+ * Incremental resize
+ *
+ * The old buckets are kept as they are, and emptied into the new buckets in order, a few on each put and remove.
+ * Old entries are never moved within the old buckets, so lookups can still probe them: entries before
+ * `migrateNext` have moved, and removed ones are marked in `oldRemoved`. Replacing a value in the old buckets
+ * is done in place.
+ */
+
+// True if the entry at an old bucket has been moved or removed
+inline bool OldEntryGone(HashMap* h, uint32_t index) {
+    return index < h->migrateNext || (h->oldRemoved[index >> 3] & (1 << (index & 7))) != 0;
+}
+
+void DropOldBuckets(HashMap* h) {
+    if (h->oldBuckets != nullptr) VectorDeallocate(h->oldBuckets);
+    if (h->oldRemoved != nullptr) ArenaDereference(h->memory, h->oldRemoved);
+    h->oldBuckets = nullptr;
+    h->oldRemoved = nullptr;
+    h->oldCount = 0;
+    h->oldCountMod = 0;
+    h->migrateNext = 0;
+}
+
+// Move up to `budget` old buckets into the new ones. Drops the old buckets once they are all moved.
+void MigrateStep(HashMap* h, uint32_t budget) {
+    if (h->oldBuckets == nullptr) return;
+
+    auto entrySize = EntrySize(h);
+    auto carry = (HashMap_Entry*)byteOffset(h->scratch, entrySize); // the first scratch entry may hold a put in progress
+    for (; budget > 0 && h->migrateNext < h->oldCount; budget--, h->migrateNext++) {
+        auto index = h->migrateNext;
+        auto entry = (HashMap_Entry*)VectorGet(h->oldBuckets, (int)index);
+        if (entry == nullptr || entry->hash == 0 || OldEntryGone(h, index)) continue;
+
+        copyBytes(carry, entry, entrySize);
+        PutInternal(h, carry, false, false);
+        h->countUsed--; // counted again by `PutInternal`
+    }
+
+    if (h->migrateNext >= h->oldCount) DropOldBuckets(h);
+}
+
+void DropNextBuckets(HashMap* h) {
+    if (h->nextBuckets != nullptr) VectorDeallocate(h->nextBuckets);
+    if (h->nextRemoved != nullptr) ArenaDereference(h->memory, h->nextRemoved);
+    h->nextBuckets = nullptr;
+    h->nextRemoved = nullptr;
+    h->nextCount = 0;
+    h->nextRemovedCleared = 0;
+}
+
+// Size of buckets to resize to, given the size asked for and the number of entries they must hold
+inline size_t MigrationSize(size_t newSize, uint32_t entries) {
+    if (newSize < MIN_BUCKET_SIZE) newSize = MIN_BUCKET_SIZE;
+    while ((float)newSize * LOAD_FACTOR < (float)entries && newSize < MAX_BUCKET_SIZE) newSize *= 2; // must hold everything
+    if (newSize > MAX_BUCKET_SIZE) newSize = MAX_BUCKET_SIZE;
+    return newSize;
+}
+
+// Make up to `budget` more of the next buckets ready. Returns false if out of memory.
+bool PrepareFill(HashMap* h, uint32_t budget) {
+    auto removedBytes = (h->count + 7) / 8;
+    if (h->nextRemovedCleared < removedBytes) {
+        auto length = removedBytes - h->nextRemovedCleared;
+        if (length > budget) length = budget;
+        memset(h->nextRemoved + h->nextRemovedCleared, 0, length);
+        h->nextRemovedCleared += length;
+    }
+
+    for (; budget > 0 && VectorLength(h->nextBuckets) < h->nextCount; budget--) {
+        auto entry = (HashMap_Entry*)VectorPushSlot(h->nextBuckets);
+        if (entry == nullptr) {
+            DropNextBuckets(h);
+            return false;
+        }
+        entry->hash = 0; // only the hash marks a bucket as used
+    }
+    return true;
+}
+
+// Once the map is close to growing or shrinking, make up to `budget` of the buckets for that resize ready.
+// Spread over the last puts and removes before the resize, so the one that starts it doesn't clear a whole new set.
+// Returns false if out of memory.
+bool PrepareStep(HashMap* h, uint32_t budget) {
+    if (!h->incremental || h->count < 1) return true;
+
+    size_t target = 0;
+    if (h->countUsed >= h->prepareAt && h->count < MAX_BUCKET_SIZE) target = MigrationSize((size_t)h->count * 2, h->growAt);
+    else if (h->countUsed <= h->shrinkAt + (h->shrinkAt / 8) && h->shrinkAt > 0) target = MigrationSize(h->shrinkAt, h->shrinkAt);
+
+    if (h->nextBuckets != nullptr && target != 0 && target != h->nextCount) DropNextBuckets(h); // heading the other way now
+    if (h->nextBuckets == nullptr) {
+        if (target == 0) return true;
+
+        // Room is taken now, but only cleared as we go. A flat vector has its whole block up front, so pushing doesn't move it.
+        h->nextRemoved = (uint8_t*)ArenaAllocate(h->memory, (h->count + 7) / 8);
+        h->nextBuckets = VectorAllocateArenaFlat(h->memory, EntrySize(h), (uint32_t)target);
+        h->nextCount = (uint32_t)target;
+        h->nextRemovedCleared = 0;
+        if (h->nextRemoved == nullptr || !VectorIsValid(h->nextBuckets)) {
+            DropNextBuckets(h);
+            return false;
+        }
+    }
+    return PrepareFill(h, budget);
+}
+
+// Switch to `newSize` empty buckets, and start moving entries across. Returns false if out of memory.
+bool StartMigration(HashMap* h, size_t newSize) {
+    newSize = MigrationSize(newSize, h->countUsed);
+
+    // Use the buckets made ready by `PrepareStep` if they fit. Normally they are already complete.
+    Vector* newBuckets = nullptr;
+    uint8_t* removed = nullptr;
+    if (h->nextBuckets != nullptr && h->nextCount == newSize && PrepareFill(h, UINT32_MAX)) {
+        newBuckets = h->nextBuckets;
+        removed = h->nextRemoved;
+        h->nextBuckets = nullptr;
+        h->nextRemoved = nullptr;
+        DropNextBuckets(h); // reset the rest
+    } else {
+        DropNextBuckets(h);
+        removed = (uint8_t*)ArenaAllocateAndClear(h->memory, (h->count + 7) / 8);
+        if (removed == nullptr) return false;
+        newBuckets = VectorAllocateArenaFlat(h->memory, EntrySize(h), newSize);
+        if (!VectorIsValid(newBuckets) || !VectorPreallocate(newBuckets, newSize)) {
+            ArenaDereference(h->memory, removed);
+            if (newBuckets != nullptr) VectorDeallocate(newBuckets);
+            return false;
+        }
+    }
+
+    h->oldBuckets = h->buckets;
+    h->oldRemoved = removed;
+    h->oldCount = h->count;
+    h->oldCountMod = h->countMod;
+    h->migrateNext = 0;
+
+    h->buckets = newBuckets;
+    h->count = newSize;
+    h->countMod = newSize - 1;
+    h->growAt = (uint32_t)((float)newSize * LOAD_FACTOR);
+    h->shrinkAt = newSize >> 2;
+    h->prepareAt = h->growAt - (h->growAt / 8); // enough puts for `PREPARE_BUCKETS` to make the next buckets ready
+    return true;
+}
+
 bool Resize(HashMap * h, size_t newSize, bool autoSize) {
+    if (h->grouped) return GroupedResize(h, (uint32_t)newSize);
+
+    if (h->oldBuckets != nullptr) { // finish any incremental resize first
+        if (newSize == 0) DropOldBuckets(h);
+        else MigrateStep(h, h->oldCount);
+    }
+    if (h->incremental && newSize > 0 && h->countUsed > 0) return StartMigration(h, newSize);
+    DropNextBuckets(h);
+
     auto oldCount = h->count;
     auto oldBuckets = h->buckets;
 
@@ -140,13 +335,14 @@ bool Resize(HashMap * h, size_t newSize, bool autoSize) {
     h->count = newSize;
     h->countMod = newSize - 1;
 
-    auto newBuckets = VectorAllocateArena(h->memory, sizeof(HashMap_Entry) + h->KeyByteSize + h->ValueByteSize);
+    auto newBuckets = VectorAllocateArenaFlat(h->memory, sizeof(HashMap_Entry) + h->KeyByteSize + h->ValueByteSize, newSize);
     if (!VectorIsValid(newBuckets) || !VectorPreallocate(newBuckets, newSize)) return false;
 
     h->buckets = newBuckets;
 
     h->growAt = autoSize ? (uint32_t)((float)newSize * LOAD_FACTOR) : newSize;
     h->shrinkAt = autoSize ? newSize >> 2 : 0;
+    h->prepareAt = h->growAt - (h->growAt / 8);
 
     h->countUsed = 0;
 
@@ -172,7 +368,7 @@ bool Resize(HashMap * h, size_t newSize, bool autoSize) {
 
 
 void HashMapPurge(HashMap *h) {
-    auto size = NextPow2((uint32_t)((float)(h->countUsed) / LOAD_FACTOR));
+    auto size = NextPow2((uint32_t)((float)(h->countUsed) / (h->grouped ? GROUPED_LOAD_FACTOR : LOAD_FACTOR)));
     Resize(h, size, true);
 }
 
@@ -193,13 +389,212 @@ bool ResizeNext(HashMap * h) {
 
 }
 
+/*
+ * Grouped storage
+ *
+ * Open addressing over one block: [ctrl bytes][slots]. Each slot has one control byte, so a group of
+ * 16 slots can be checked for a hash match with one SSE2 compare. Keys are only compared on a match.
+ * Groups are probed in triangular steps. A lookup ends at the first group with an empty slot.
+ *
+ * The user's hash is mixed first, so weak hashes (like `HashMapIntKeyHash`) still spread over the groups:
+ * the low 7 bits go in the control byte, and the rest pick the first group.
+ */
+
+inline uint32_t GroupedMix(uint32_t hash) {
+    if (hash == 0) hash = SAFE_HASH; // same as the robin-hood buckets
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
 
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "UnusedLocalVariable"
-HashMap* HashMapAllocateArena(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* /*key_A*/, void* /*key_B*/), unsigned int(*getHashFunc)(void* /*key*/)) {
-#pragma clang diagnostic pop
+inline uint8_t GroupedTag(uint32_t mixed) { return (uint8_t)(mixed & 0x7F); }
+
+// Index of the first slot in the group at `step` of the probe sequence for a mixed hash
+inline uint32_t GroupedStart(HashMap* h, uint32_t mixed, uint32_t step) {
+    auto triangle = (uint32_t)(((uint64_t)step * (step + 1)) >> 1);
+    return (((mixed >> 7) + triangle) * GROUP_WIDTH) & h->countMod;
+}
+
+inline char* SlotPtr(HashMap* h, uint32_t index) {
+    return h->slots + ((size_t)index * h->slotSize);
+}
+
+// Index of lowest set bit. `mask` must not be zero
+inline uint32_t LowestBit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (uint32_t)index;
+#else
+    return (uint32_t)__builtin_ctz(mask);
+#endif
+}
+
+// Bit mask of the control bytes in a group that equal `tag`
+inline uint32_t GroupMatch(const uint8_t* group, uint8_t tag) {
+#ifdef RAWDATA_SSE2
+    auto ctrl = _mm_load_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < GROUP_WIDTH; i++) mask |= (uint32_t)(group[i] == tag) << i;
+    return mask;
+#endif
+}
+
+// Bit mask of the slots in a group that are empty or deleted (control bytes with the high bit set)
+inline uint32_t GroupMatchFree(const uint8_t* group) {
+#ifdef RAWDATA_SSE2
+    return (uint32_t)_mm_movemask_epi8(_mm_load_si128((const __m128i*)group));
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < GROUP_WIDTH; i++) mask |= (uint32_t)(group[i] >> 7) << i;
+    return mask;
+#endif
+}
+
+// Walk the probe sequence from `probe->_step`, stopping at the next slot after `probe->_index` with the probe's tag.
+// `probe->_hash` holds the mixed hash.
+bool GroupedScan(HashMap* h, HashMapProbe* probe) {
+    auto tag = GroupedTag(probe->_hash);
+    auto groupCount = h->count / GROUP_WIDTH;
+    for (; probe->_step < groupCount; probe->_step++) {
+        auto start = GroupedStart(h, probe->_hash, probe->_step);
+        auto group = h->ctrl + start;
+
+        auto matches = GroupMatch(group, tag);
+        if (probe->_index != NO_INDEX) matches &= ~((2u << (probe->_index - start)) - 1); // skip matches already returned
+        if (matches != 0) {
+            probe->_index = start + LowestBit(matches);
+            probe->Key = SlotPtr(h, probe->_index);
+            probe->Value = (char*)probe->Key + h->KeyByteSize;
+            return true;
+        }
+
+        if (GroupMatch(group, CTRL_EMPTY) != 0) return false; // end of the run
+        probe->_index = NO_INDEX;
+    }
+    return false;
+}
+
+// Index of a free slot for a mixed hash. There must be one.
+inline uint32_t GroupedFindFree(HashMap* h, uint32_t mixed) {
+    for (uint32_t step = 0;; step++) {
+        auto start = GroupedStart(h, mixed, step);
+        auto free = GroupMatchFree(h->ctrl + start);
+        if (free != 0) return start + LowestBit(free);
+    }
+}
+
+// Set up empty storage with `newSize` slots. Old storage is not released.
+bool GroupedAllocate(HashMap* h, uint32_t newSize) {
+    h->ctrl = nullptr;
+    h->slots = nullptr;
+    h->count = 0;
+    h->countMod = 0;
+    h->countUsed = 0;
+    h->growthLeft = 0;
+    if (newSize == 0) return true;
+
+    auto block = (uint8_t*)ArenaAllocateAligned(h->memory, newSize + ((size_t)newSize * h->slotSize), GROUP_WIDTH);
+    if (block == nullptr) return false;
+    memset(block, CTRL_EMPTY, newSize);
+
+    h->ctrl = block;
+    h->slots = (char*)(block + newSize);
+    h->count = newSize;
+    h->countMod = newSize - 1;
+    h->growthLeft = (uint32_t)((float)newSize * GROUPED_LOAD_FACTOR);
+    return true;
+}
+
+// Replace the storage with `newSize` slots, and move the live entries across. Deleted slots are dropped.
+bool GroupedResize(HashMap* h, uint32_t newSize) {
+    if (newSize > 0 && newSize < MIN_BUCKET_SIZE) newSize = MIN_BUCKET_SIZE;
+    if (newSize > MAX_BUCKET_SIZE) newSize = MAX_BUCKET_SIZE;
+    if (newSize > 0 && (float)newSize * GROUPED_LOAD_FACTOR < (float)h->countUsed) return false;
+
+    auto oldCtrl = h->ctrl;
+    auto oldSlots = h->slots;
+    auto oldCount = h->count;
+    auto oldMod = h->countMod;
+    auto oldUsed = h->countUsed;
+    auto oldGrowth = h->growthLeft;
+    if (!GroupedAllocate(h, newSize)) {
+        h->ctrl = oldCtrl; // leave the map as it was
+        h->slots = oldSlots;
+        h->count = oldCount;
+        h->countMod = oldMod;
+        h->countUsed = oldUsed;
+        h->growthLeft = oldGrowth;
+        return false;
+    }
+    if (oldCtrl == nullptr) return true;
+
+    if (newSize > 0) {
+        for (uint32_t i = 0; i < oldCount; i++) {
+            if (oldCtrl[i] & 0x80) continue; // empty or deleted
+
+            auto src = oldSlots + ((size_t)i * h->slotSize);
+            auto mixed = GroupedMix(h->GetHash(src));
+            auto index = GroupedFindFree(h, mixed);
+            h->ctrl[index] = GroupedTag(mixed);
+            copyBytes(SlotPtr(h, index), src, h->slotSize);
+        }
+        h->countUsed = oldUsed;
+        h->growthLeft -= oldUsed;
+    }
+
+    ArenaDereference(h->memory, oldCtrl);
+    return true;
+}
+
+// Add an entry without checking for an existing key
+bool GroupedInsert(HashMap* h, uint32_t hash, void* key, void* value) {
+    auto mixed = GroupedMix(hash);
+    uint32_t index = h->count > 0 ? GroupedFindFree(h, mixed) : 0;
+
+    if (h->count == 0 || (h->ctrl[index] == CTRL_EMPTY && h->growthLeft == 0)) {
+        // rebuild at the same size if deleted slots are using up the space, otherwise grow
+        uint32_t newSize = MIN_BUCKET_SIZE;
+        if (h->count > 0) newSize = ((float)h->countUsed < (float)h->count * GROUPED_LOAD_FACTOR * 0.5f) ? h->count : h->count * 2;
+        if (!GroupedResize(h, newSize)) return false;
+        if (h->growthLeft == 0) return false; // at the size limit
+
+        index = GroupedFindFree(h, mixed);
+    }
+
+    if (h->ctrl[index] == CTRL_EMPTY) h->growthLeft--;
+    h->ctrl[index] = GroupedTag(mixed);
+    auto slot = SlotPtr(h, index);
+    writeValue(slot, 0, key, h->KeyByteSize);
+    writeValue(slot, h->KeyByteSize, value, h->ValueByteSize);
+    h->countUsed++;
+    return true;
+}
+
+bool GroupedRemoveAt(HashMap* h, uint32_t index) {
+    if (index >= h->count || (h->ctrl[index] & 0x80)) return false;
+
+    // If the group still has an empty slot, it has never been full, so no probe has passed it: the slot can be empty again.
+    if (GroupMatch(h->ctrl + (index & ~(GROUP_WIDTH - 1)), CTRL_EMPTY) != 0) {
+        h->ctrl[index] = CTRL_EMPTY;
+        h->growthLeft++;
+    } else {
+        h->ctrl[index] = CTRL_DELETED;
+    }
+    h->countUsed--;
+    return true;
+}
+
+
+// `flags` is zero, `HASHMAP_GROUPED` or `HASHMAP_INCREMENTAL`
+HashMap* HashMapAllocateInternal(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void*, void*), unsigned int(*getHashFunc)(void*), uint32_t flags) {
     if (a == nullptr) return nullptr;
-    auto result = (HashMap*)ArenaAllocateAndClear(a, sizeof(HashMap));
+    auto result = (HashMap*)ArenaSlabAllocateAndClear(a, sizeof(HashMap));
     if (result == nullptr) return nullptr;
     result->memory = a;
     result->KeyByteSize = keyByteSize;
@@ -207,10 +602,43 @@ HashMap* HashMapAllocateArena(Arena* a, unsigned int size, int keyByteSize, int
     result->KeyComparer = keyComparerFunc;
     result->GetHash = getHashFunc;
     result->buckets = nullptr; // created in `Resize`
+    result->grouped = (flags & HASHMAP_GROUPED) != 0;
+    result->incremental = !result->grouped && (flags & HASHMAP_INCREMENTAL) != 0;
+    result->slotSize = (unsigned int)(keyByteSize + valueByteSize);
+    if (!result->grouped) {
+        result->scratch = (HashMap_Entry*)ArenaSlabAllocateAndClear(a, EntrySize(result) * 2);
+        if (result->scratch == nullptr) {
+            ArenaSlabRelease(a, result, sizeof(HashMap));
+            return nullptr;
+        }
+    }
     result->IsValid = Resize(result, (uint32_t)NextPow2(size), false);
     return result;
 }
 
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "UnusedLocalVariable"
+HashMap* HashMapAllocateArena(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* /*key_A*/, void* /*key_B*/), unsigned int(*getHashFunc)(void* /*key*/)) {
+#pragma clang diagnostic pop
+    return HashMapAllocateInternal(a, size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc, 0);
+}
+
+HashMap* HashMapAllocateArenaGrouped(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key)) {
+    return HashMapAllocateInternal(a, size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc, HASHMAP_GROUPED);
+}
+
+HashMap* HashMapAllocateGrouped(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key)) {
+    return HashMapAllocateArenaGrouped(MMCurrent(), size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc);
+}
+
+HashMap* HashMapAllocateArenaIncremental(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key)) {
+    return HashMapAllocateInternal(a, size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc, HASHMAP_INCREMENTAL);
+}
+
+HashMap* HashMapAllocateIncremental(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key)) {
+    return HashMapAllocateArenaIncremental(MMCurrent(), size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc);
+}
+
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "UnusedLocalVariable"
@@ -219,141 +647,331 @@ HashMap* HashMapAllocate(unsigned int size, int keyByteSize, int valueByteSize,
 }
 #pragma clang diagnostic pop
 
+#ifdef ARENA_TAGGED_CALLS
+HashMap* HashMapAllocateTagged(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key), const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = HashMapAllocate(size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+HashMap* HashMapAllocateArenaTagged(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key), const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = HashMapAllocateArena(a, size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+HashMap* HashMapAllocateGroupedTagged(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key), const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = HashMapAllocateGrouped(size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+HashMap* HashMapAllocateArenaGroupedTagged(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key), const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = HashMapAllocateArenaGrouped(a, size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+HashMap* HashMapAllocateIncrementalTagged(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key), const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = HashMapAllocateIncremental(size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+HashMap* HashMapAllocateArenaIncrementalTagged(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key), const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = HashMapAllocateArenaIncremental(a, size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc);
+    ArenaSiteLeave(outer);
+    return result;
+}
+#endif
+
 void HashMapDeallocate(HashMap * h) {
     if (h == nullptr) return;
     h->IsValid = false;
     h->count = 0;
     if (h->buckets != nullptr) VectorDeallocate(h->buckets);
-    ArenaDereference(h->memory, h);
+    if (h->ctrl != nullptr) ArenaDereference(h->memory, h->ctrl);
+    if (h->scratch != nullptr) ArenaSlabRelease(h->memory, h->scratch, EntrySize(h) * 2);
+    DropOldBuckets(h);
+    DropNextBuckets(h);
+    ArenaSlabRelease(h->memory, h, sizeof(HashMap));
 }
 
-bool Find(HashMap* h, void* key, uint32_t* index, HashMap_Entry** found) {
-    *index = 0;
-    if (h == nullptr) return false;
-    if (h->countUsed <= 0) return false;
-    //if (!VectorIsValid(h->buckets)) return false;
-
-    uint32_t hash = h->GetHash(key);
-    uint32_t indexInit = hash & h->countMod;
-    uint32_t probeDistance = 0;
+// Walk the probe sequence in one set of buckets from `probe->_step`, stopping at the next entry with the probe's hash
+bool ProbeScanBuckets(HashMap* h, HashMapProbe* probe, Vector* buckets, uint32_t count, uint32_t countMod, bool old) {
+    for (; probe->_step < count; probe->_step++) {
+        auto index = (probe->_hash + probe->_step) & countMod;
+        auto res = (HashMap_Entry*)VectorGet(buckets, (int)index);
+        if (res == nullptr || res->hash == 0) return false; // internal failure, or end of the run
+
+        if (res->hash == probe->_hash && !(old && OldEntryGone(h, index))) {
+            probe->_index = index;
+            probe->Key = KeyPtr(res);
+            probe->Value = ValuePtr(h, res);
+            return true;
+        }
 
-    for (uint32_t i = 0; i < h->count; i++) {
-        *index = (indexInit + i) & h->countMod;
-        auto res = (HashMap_Entry*)VectorGet(h->buckets, (int)(*index));
-        if (res == nullptr) return false; // internal failure
+        // robin-hood: our key can't be past an entry that is closer to its home slot
+        if (probe->_step > DistanceIn(count, countMod, index, res)) return false;
+    }
+    return false;
+}
 
-        auto keyData = KeyPtr(res);
+// Walk the probe sequence from `probe->_step`, stopping at the next entry with the probe's hash.
+// During an incremental resize, the old buckets are searched after the new ones.
+bool ProbeScan(HashMap* h, HashMapProbe* probe) {
+    if (probe->_table == 0) {
+        if (ProbeScanBuckets(h, probe, h->buckets, h->count, h->countMod, false)) return true;
+        if (h->oldBuckets == nullptr) return false;
 
-        // found?
-        if ((hash == res->hash) && h->KeyComparer(key, keyData)) {
-            if (found != nullptr) *found = res;
-            return true;
-        }
+        probe->_table = 1;
+        probe->_step = 0;
+    }
+    return ProbeScanBuckets(h, probe, h->oldBuckets, h->oldCount, h->oldCountMod, true);
+}
 
-        // not found, probe further
-        if (res->hash != 0) probeDistance = DistanceToInitIndex(h, *index, res);
+bool HashMapProbeFirst(HashMap* h, uint32_t hash, HashMapProbe* probe) {
+    if (h == nullptr || probe == nullptr) return false;
+    if (h->countUsed <= 0) return false;
 
-        if (i > probeDistance) break;
+    probe->_step = 0;
+    probe->_table = 0;
+    if (h->grouped) {
+        probe->_hash = GroupedMix(hash);
+        probe->_index = NO_INDEX;
+        return GroupedScan(h, probe);
     }
 
-    return false;
+    probe->_hash = (hash == 0) ? SAFE_HASH : hash; // same as stored by `HashMapPut`
+    return ProbeScan(h, probe);
 }
 
-bool HashMapGet(HashMap* h, void* key, void** outValue) {
+bool HashMapProbeNext(HashMap* h, HashMapProbe* probe) {
+    if (h == nullptr || probe == nullptr) return false;
+    if (h->grouped) return GroupedScan(h, probe);
+    probe->_step++;
+    return ProbeScan(h, probe);
+}
+
+// Find the entry for a key. The probe is left on the entry.
+bool Find(HashMap* h, void* key, HashMapProbe* probe) {
     if (h == nullptr) return false;
-    // Find the entry index
-    uint32_t index = 0;
-    HashMap_Entry* res = nullptr;
-    if (!Find(h, key, &index, &res)) return false;
 
-    // look up the entry
-    if (res == nullptr) {
-        return false;
+    for (bool ok = HashMapProbeFirst(h, h->GetHash(key), probe); ok; ok = HashMapProbeNext(h, probe)) {
+        if (h->KeyComparer(key, probe->Key)) return true;
     }
 
+    return false;
+}
+
+bool HashMapGet(HashMap* h, void* key, void** outValue) {
+    HashMapProbe probe;
+    if (!Find(h, key, &probe)) return false;
+
     // look up the value
-    if (outValue != nullptr) *outValue = ValuePtr(h, res);
+    if (outValue != nullptr) *outValue = probe.Value;
     return true;
 }
 
-inline HashMap_Entry* HashMapAllocEntry(HashMap* h) {
-    if (h->memory == nullptr) return nullptr;
-    return (HashMap_Entry*)ArenaAllocateAndClear(h->memory, sizeof(HashMap_Entry) + h->KeyByteSize + h->ValueByteSize);
-}
+// Find a key in the old buckets of an incremental resize
+bool FindOld(HashMap* h, uint32_t safeHash, void* key, HashMapProbe* probe) {
+    if (h->oldBuckets == nullptr) return false;
 
-inline void HashMapFreeEntry(HashMap* h, HashMap_Entry* e) {
-    ArenaDereference(h->memory, e);
+    probe->_hash = safeHash;
+    probe->_step = 0;
+    probe->_table = 1;
+    for (bool ok = ProbeScan(h, probe); ok; ok = ProbeScan(h, probe)) {
+        if (h->KeyComparer(key, probe->Key)) return true;
+        probe->_step++;
+    }
+    return false;
 }
 
-bool HashMapPut(HashMap* h, void* key, void* value, bool canReplace) {
+bool PutWithHash(HashMap* h, uint32_t hash, void* key, void* value, bool canReplace, bool checkDuplicates) {
     if (h == nullptr) return false;
+    if (h->grouped) {
+        HashMapProbe probe;
+        if (checkDuplicates) {
+            for (bool ok = HashMapProbeFirst(h, hash, &probe); ok; ok = HashMapProbeNext(h, &probe)) {
+                if (!h->KeyComparer(key, probe.Key)) continue;
+                if (!canReplace) return false;
+
+                writeValue(probe.Key, 0, key, h->KeyByteSize);
+                writeValue(probe.Value, 0, value, h->ValueByteSize);
+                return true;
+            }
+        }
+        return GroupedInsert(h, hash, key, value);
+    }
+
     // Check to see if we need to grow
     if (h->countUsed >= h->growAt) {
         if (!ResizeNext(h)) return false;
     }
 
-    uint32_t safeHash = h->GetHash(key);
+    uint32_t safeHash = hash;
     if (safeHash == 0) safeHash = SAFE_HASH; // can't allow hash of zero
-    
+
+    PrepareStep(h, PREPARE_BUCKETS); // if this runs out of memory, growing will try again
+    if (h->oldBuckets != nullptr) {
+        MigrateStep(h, MIGRATE_BUCKETS);
+
+        // a key that hasn't been moved yet is replaced where it is
+        HashMapProbe probe;
+        if (checkDuplicates && FindOld(h, safeHash, key, &probe)) {
+            if (!canReplace) return false;
+
+            writeValue(probe.Key, 0, key, h->KeyByteSize);
+            writeValue(probe.Value, 0, value, h->ValueByteSize);
+            return true;
+        }
+    }
+
     // Write the entry into the hashmap
-    auto entry = HashMapAllocEntry(h);
+    auto entry = h->scratch;
     if (entry == nullptr) return false;
 
     entry->hash = safeHash;
     writeValue(KeyPtr(entry), 0, key, h->KeyByteSize);
     writeValue(ValuePtr(h, entry), 0, value, h->ValueByteSize);
 
-    auto OK = PutInternal(h, entry, canReplace, true);
+    return PutInternal(h, entry, canReplace, checkDuplicates);
+}
+
+bool HashMapPut(HashMap* h, void* key, void* value, bool canReplace) {
+    if (h == nullptr) return false;
+    return PutWithHash(h, h->GetHash(key), key, value, canReplace, true);
+}
 
-    HashMapFreeEntry(h, entry);
-    return OK;
+bool HashMapPutHashed(HashMap* h, uint32_t hash, void* key, void* value) {
+    return PutWithHash(h, hash, key, value, false, false);
 }
 
 Vector *HashMapAllEntries(HashMap* h) {
-    auto result = VectorAllocateArena(h->memory, sizeof(HashMap_KVP));
+    auto result = VectorAllocateArenaFlat(h->memory, sizeof(HashMap_KVP), h->countUsed);
+    if (h->grouped) {
+        for (uint32_t i = 0; i < h->count; i++) {
+            if (h->ctrl[i] & 0x80) continue; // empty or deleted
+
+            auto slot = SlotPtr(h, i);
+            auto kvp = HashMap_KVP { slot, slot + h->KeyByteSize };
+            VectorPush(result, &kvp);
+        }
+        return result;
+    }
     if (!VectorIsValid(h->buckets)) return result;
 
-    for (uint32_t i = 0; i < h->count; i++) {
-        // Read and validate entry
-        auto ent = (HashMap_Entry*)VectorGet(h->buckets, (int)i);
-        if (ent->hash == 0) continue;
+    // walk the buckets a chunk at a time
+    auto entrySize = VectorElementSize(h->buckets);
+    VectorSpan span;
+    for (bool ok = VectorSpanFirst(h->buckets, 0, &span); ok; ok = VectorSpanNext(h->buckets, &span)) {
+        auto ent = (HashMap_Entry*)span.Data;
+        for (uint32_t i = 0; i < span.Count; i++, ent = (HashMap_Entry*)byteOffset(ent, entrySize)) {
+            if (ent->hash == 0) continue;
+
+            // Add Key-Value pair to output
+            auto kvp = HashMap_KVP { KeyPtr(ent), ValuePtr(h, ent) };
+            VectorPush(result, &kvp);
+        }
+    }
 
-        // Look up pointers to the data
-        auto keyPtr = KeyPtr(ent);
-        auto valuePtr = ValuePtr(h, ent);
+    // entries not yet moved by an incremental resize
+    if (h->oldBuckets == nullptr || h->migrateNext >= h->oldCount) return result;
+    for (bool ok = VectorSpanFirst(h->oldBuckets, h->migrateNext, &span); ok; ok = VectorSpanNext(h->oldBuckets, &span)) {
+        auto ent = (HashMap_Entry*)span.Data;
+        for (uint32_t i = 0; i < span.Count; i++, ent = (HashMap_Entry*)byteOffset(ent, entrySize)) {
+            if (ent->hash == 0 || OldEntryGone(h, span.Index + i)) continue;
 
-        // Add Key-Value pair to output
-        auto kvp = HashMap_KVP { keyPtr, valuePtr };
-        VectorPush(result, &kvp);
+            auto kvp = HashMap_KVP { KeyPtr(ent), ValuePtr(h, ent) };
+            VectorPush(result, &kvp);
+        }
     }
     return result;
 }
 
-bool HashMapRemove(HashMap* h, void* key) {
-    uint32_t index;
-    if (!Find(h, key, &index, nullptr)) return false;
+bool RemoveAt(HashMap* h, uint32_t index) {
+    if (h->grouped) return GroupedRemoveAt(h, index);
 
-    for (uint32_t i = 0; i < h->count; i++) {
-        auto curIndex = (index + i) & h->countMod;
-        auto nextIndex = (index + i + 1) & h->countMod;
+    auto hole = (HashMap_Entry*)VectorGet(h->buckets, (int)index);
+    if (hole == nullptr) return false; // internal failure
+    auto entrySize = VectorElementSize(h->buckets);
 
-        auto res = (HashMap_Entry*)VectorGet(h->buckets, (int)nextIndex);
-        if (res == nullptr) return false; // internal failure
+    // Backward-shift: pull the rest of the run back one bucket, until an empty bucket or an entry that is already home.
+    // This keeps probe runs as short as if the removed key had never been added, with no tombstones.
+    for (uint32_t i = 1; i < h->count; i++) {
+        auto nextIndex = (index + i) & h->countMod;
+        auto next = (HashMap_Entry*)VectorGet(h->buckets, (int)nextIndex);
+        if (next == nullptr) return false; // internal failure
 
-        if ((res->hash == 0) || (DistanceToInitIndex(h, nextIndex, res) == 0))
-        {
-            auto empty = HashMap_Entry();
-            VectorSet(h->buckets, (int)curIndex, &empty, nullptr);
+        if ((next->hash == 0) || (DistanceToInitIndex(h, nextIndex, next) == 0)) break;
 
-            if (--(h->countUsed) == h->shrinkAt) Resize(h, h->shrinkAt, true);
+        copyBytes(hole, next, entrySize);
+        hole = next;
+    }
+    hole->hash = 0; // only the hash marks a slot as used
 
-            return true;
+    // don't shrink during an incremental resize
+    if (--(h->countUsed) == h->shrinkAt && h->oldBuckets == nullptr) Resize(h, h->shrinkAt, true);
+    return true;
+}
+
+// Remove an entry found in the old buckets of an incremental resize. It is only marked, so the old buckets can still be probed.
+bool RemoveOld(HashMap* h, uint32_t index) {
+    if (h->oldBuckets == nullptr || index >= h->oldCount || OldEntryGone(h, index)) return false;
+    h->oldRemoved[index >> 3] |= (uint8_t)(1 << (index & 7));
+    h->countUsed--;
+    return true;
+}
+
+bool HashMapRemoveProbe(HashMap* h, HashMapProbe* probe) {
+    if (h == nullptr || probe == nullptr) return false;
+    auto ok = (probe->_table != 0) ? RemoveOld(h, probe->_index) : RemoveAt(h, probe->_index);
+    MigrateStep(h, MIGRATE_BUCKETS); // after the remove, as it moves entries
+    PrepareStep(h, PREPARE_BUCKETS);
+    return ok;
+}
+
+bool HashMapRemove(HashMap* h, void* key) {
+    HashMapProbe probe;
+    if (!Find(h, key, &probe)) return false;
+    return HashMapRemoveProbe(h, &probe);
+}
+
+// Distance in groups from the first group probed for an entry's key to the one it is in
+inline uint32_t GroupedDistance(HashMap* h, uint32_t index) {
+    auto mixed = GroupedMix(h->GetHash(SlotPtr(h, index)));
+    auto target = index & ~(GROUP_WIDTH - 1);
+    uint32_t step = 0;
+    while (GroupedStart(h, mixed, step) != target && step < h->count / GROUP_WIDTH) step++;
+    return step;
+}
+
+uint32_t HashMapProbeLengths(HashMap* h, uint32_t* histogram, uint32_t histogramSize) {
+    if (h == nullptr || histogram == nullptr || histogramSize < 1) return 0;
+    for (uint32_t i = 0; i < histogramSize; i++) histogram[i] = 0;
+
+    uint32_t longest = 0;
+    for (uint32_t i = 0; i < h->count; i++) {
+        uint32_t distance;
+        if (h->grouped) {
+            if (h->ctrl[i] & 0x80) continue; // empty or deleted
+            distance = GroupedDistance(h, i);
+        } else {
+            auto entry = (HashMap_Entry*)VectorGet(h->buckets, (int)i);
+            if (entry == nullptr || entry->hash == 0) continue;
+            distance = DistanceToInitIndex(h, i, entry);
         }
 
-        VectorSwap(h->buckets, curIndex, nextIndex);
+        if (distance > longest) longest = distance;
+        histogram[(distance < histogramSize) ? distance : histogramSize - 1]++;
     }
-
-    return false;
+    return longest;
 }
 
 void HashMapClear(HashMap * h) {
@@ -23,6 +23,19 @@ typedef HashMap* HashMapPtr;
 HashMap* HashMapAllocate(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key));
 // Create a new hash map with an initial size, pinned to a specific arena
 HashMap* HashMapAllocateArena(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key));
+// Create a new hash map with grouped storage. This is used through the same functions as other hash maps.
+// Keys and values are held in one flat block, with a control byte per slot that is checked 16 at a time,
+// so lookups in large maps touch less memory and compare fewer keys.
+// Removed entries leave a marker until the map grows or is purged.
+HashMap* HashMapAllocateGrouped(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key));
+// Create a new hash map with grouped storage, pinned to a specific arena. See `HashMapAllocateGrouped`
+HashMap* HashMapAllocateArenaGrouped(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key));
+// Create a new hash map that resizes incrementally. This is used through the same functions as other hash maps.
+// When it grows, entries move to the new buckets a few at a time on each put and remove, so no single call
+// rehashes the whole map. Lookups check both sets of buckets until the move is done.
+HashMap* HashMapAllocateIncremental(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key));
+// Create a new incrementally resized hash map, pinned to a specific arena. See `HashMapAllocateIncremental`
+HashMap* HashMapAllocateArenaIncremental(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key));
 
 // Deallocate internal storage of the hash-map. Does not deallocate the keys or values
 void HashMapDeallocate(HashMap *h);
@@ -43,11 +56,41 @@ void HashMapClear(HashMap *h);
 // Return count of entries stored in the hash-map
 unsigned int HashMapCount(HashMap *h);
 
+// A candidate entry in the hash map, for finding keys without the map's compare function. See `HashMapProbeFirst`
+typedef struct HashMapProbe {
+    // Pointer to the key of the candidate entry
+    void* Key;
+    // Pointer to the value of the candidate entry
+    void* Value;
+    // Probe state (internal)
+    uint32_t _hash;
+    uint32_t _index;
+    uint32_t _step;
+    uint32_t _table;
+} HashMapProbe;
+
+// Find the first entry with the given hash. Returns false if there are none.
+// Entries only match on hash: the caller compares keys, and calls `HashMapProbeNext` if they differ.
+// In grouped maps, entries match on 7 bits of a mix of the hash, so keys differ more often.
+// The probe is invalidated by any change to the map.
+bool HashMapProbeFirst(HashMap *h, uint32_t hash, HashMapProbe* probe);
+// Move to the next entry with the same hash. Returns false when there are no more.
+bool HashMapProbeNext(HashMap *h, HashMapProbe* probe);
+// Add a key/value pair with a hash from the caller, without checking for an existing key.
+// The hash must match what the map's hash function would give.
+bool HashMapPutHashed(HashMap *h, uint32_t hash, void* key, void* value);
+// Remove the entry found by a probe
+bool HashMapRemoveProbe(HashMap *h, HashMapProbe* probe);
+
 // Resize the hash map and its internal buffers to suit the currently held data
-// Note: The hash map doesn't clean up after key removal/replacement until it is cleared or resized
-// If you are doing lots or remove and replace, call this occasionally to prevent memory growth
+// Robin-hood maps shift entries back on removal, so this only trims their size. Grouped maps leave a removed-slot
+// marker for each removal until they are cleared or resized; after many removals, call this to clear the markers.
 void HashMapPurge(HashMap *h);
 
+// Count entries by their distance from where their hash first places them: in buckets, or in groups for grouped maps.
+// `histogram[d]` gets the count at distance `d`, and the last element also counts anything further. Returns the largest distance.
+uint32_t HashMapProbeLengths(HashMap *h, uint32_t* histogram, uint32_t histogramSize);
+
 
 // Some common compare and hash functions.
 bool         HashMapStringKeyCompare(void* key_A, void* key_B);
@@ -71,11 +114,31 @@ unsigned int HashMapIntKeyHash(void* key);
 #define RegisterHashMapFor(keyType, valueType, hashFuncPtr, compareFuncPtr, nameSpace) \
     inline HashMap* nameSpace##Allocate_##keyType##_##valueType(unsigned int size){ return HashMapAllocate(size, sizeof(keyType), sizeof(valueType), compareFuncPtr, hashFuncPtr); } \
     inline HashMap* nameSpace##AllocateArena_##keyType##_##valueType(unsigned int size, Arena* a){ return HashMapAllocateArena(a, size, sizeof(keyType), sizeof(valueType), compareFuncPtr, hashFuncPtr); } \
+    inline HashMap* nameSpace##AllocateArenaGrouped_##keyType##_##valueType(unsigned int size, Arena* a){ return HashMapAllocateArenaGrouped(a, size, sizeof(keyType), sizeof(valueType), compareFuncPtr, hashFuncPtr); } \
+    inline HashMap* nameSpace##AllocateArenaIncremental_##keyType##_##valueType(unsigned int size, Arena* a){ return HashMapAllocateArenaIncremental(a, size, sizeof(keyType), sizeof(valueType), compareFuncPtr, hashFuncPtr); } \
     inline bool nameSpace##Get##_##keyType##_##valueType(HashMap *h, keyType key, valueType** outValue){return HashMapGet(h, &key, (void**)(outValue));}\
     inline bool nameSpace##Put##_##keyType##_##valueType(HashMap *h, keyType key, valueType value, bool replace){return HashMapPut(h, &key, &value, replace); }\
     inline bool nameSpace##Remove##_##keyType##_##valueType(HashMap *h, keyType key){ return HashMapRemove(h, &key); }\
     typedef struct nameSpace##_KVP_##keyType##_##valueType { keyType* Key; valueType* Value; } nameSpace##_KVP_##keyType##_##valueType ; \
 
 
+#ifdef ARENA_TAGGED_CALLS
+// Create hash maps, recording the given call site for the allocations made (see `ArenaSiteEnter`)
+HashMap* HashMapAllocateTagged(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key), const char* site);
+HashMap* HashMapAllocateArenaTagged(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key), const char* site);
+HashMap* HashMapAllocateGroupedTagged(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key), const char* site);
+HashMap* HashMapAllocateArenaGroupedTagged(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key), const char* site);
+HashMap* HashMapAllocateIncrementalTagged(unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key), const char* site);
+HashMap* HashMapAllocateArenaIncrementalTagged(Arena* a, unsigned int size, int keyByteSize, int valueByteSize, bool(*keyComparerFunc)(void* key_A, void* key_B), unsigned int(*getHashFunc)(void* key), const char* site);
+
+// Attribute hash map creation to the calling source line, rather than to lines inside HashMap.cpp
+#define HashMapAllocate(size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc) HashMapAllocateTagged((size), (keyByteSize), (valueByteSize), (keyComparerFunc), (getHashFunc), ARENA_CALL_SITE)
+#define HashMapAllocateArena(a, size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc) HashMapAllocateArenaTagged((a), (size), (keyByteSize), (valueByteSize), (keyComparerFunc), (getHashFunc), ARENA_CALL_SITE)
+#define HashMapAllocateGrouped(size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc) HashMapAllocateGroupedTagged((size), (keyByteSize), (valueByteSize), (keyComparerFunc), (getHashFunc), ARENA_CALL_SITE)
+#define HashMapAllocateArenaGrouped(a, size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc) HashMapAllocateArenaGroupedTagged((a), (size), (keyByteSize), (valueByteSize), (keyComparerFunc), (getHashFunc), ARENA_CALL_SITE)
+#define HashMapAllocateIncremental(size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc) HashMapAllocateIncrementalTagged((size), (keyByteSize), (valueByteSize), (keyComparerFunc), (getHashFunc), ARENA_CALL_SITE)
+#define HashMapAllocateArenaIncremental(a, size, keyByteSize, valueByteSize, keyComparerFunc, getHashFunc) HashMapAllocateArenaIncrementalTagged((a), (size), (keyByteSize), (valueByteSize), (keyComparerFunc), (getHashFunc), ARENA_CALL_SITE)
+#endif
+
 #endif
 #pragma clang diagnostic pop
\ No newline at end of file
@@ -128,6 +128,11 @@ bool HeapDeleteMin(Heap * H, void* element) {
     return MinElement;
 }
 
+Vector* HeapStorage(Heap* H) {
+    if (H == nullptr) return nullptr;
+    return H->Elements;
+}
+
 void* HeapPeekMin(Heap* H) {
     if (!HeapIsEmpty(H)) return byteOffset(VectorGet(H->Elements, 1), sizeof(int));
 
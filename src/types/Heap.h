@@ -7,7 +7,7 @@
 #ifndef heap_h
 #define heap_h
 
-#include "ArenaAllocator.h"
+#include "Vector.h"
 
 // A generic heap based on the vector container
 typedef struct Heap Heap;
@@ -33,6 +33,9 @@ bool HeapTryFindMin(Heap* H, void * found);
 bool HeapTryFindNext(Heap* H, void * found);
 // Returns true if heap has no elements
 bool HeapIsEmpty(Heap* H);
+// The vector holding the heap. Each entry is an int priority followed by the element data.
+// Entry zero is a reserved minimum, so the heap proper starts at index 1. For typed access, see `TypedHeap`
+Vector* HeapStorage(Heap* H);
 
 
 // Macros to create type-specific versions of the methods above.
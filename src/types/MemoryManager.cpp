@@ -5,135 +5,240 @@
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "OCUnusedGlobalDeclarationInspection"
-#ifdef ARENA_DEBUG
+#if defined(ARENA_DEBUG) || defined(ARENA_ACCOUNTING)
 #include <iostream>
 #endif
 
-static volatile Vector* MEMORY_STACK = nullptr;
-static volatile int LOCK = 0;
+// Each thread has its own stack and pool, so there's no locking
+static thread_local Vector* MEMORY_STACK = nullptr;
+static thread_local Vector* ARENA_POOL = nullptr; // popped arenas, ready to be reused
+static thread_local uint32_t FRAME_COUNT = 0; // frames seen by `MMFrameEnd`, for accounting warm-up
+
+// Usage of arenas that have been popped, so totals don't go backwards
+static thread_local uint32_t POPPED_ALLOCATIONS = 0;
+static thread_local size_t POPPED_BYTES = 0;
+static thread_local size_t PEAK_BYTES = 0; // high-water mark across the whole stack
+
+// Allocation totals at `MMFrameStart`, and the difference at `MMFrameEnd`
+static thread_local uint32_t FRAME_START_ALLOCATIONS = 0;
+static thread_local size_t FRAME_START_BYTES = 0;
+static thread_local uint32_t LAST_FRAME_ALLOCATIONS = 0;
+static thread_local size_t LAST_FRAME_BYTES = 0;
 
 typedef Arena* ArenaPtr;
 
 RegisterVectorStatics(Vec)
 RegisterVectorFor(ArenaPtr, Vec)
 
-// Ensure the memory manager is ready. It starts with an empty stack
+// Take a pooled arena of the given size, or make a new one
+Arena* PoolTake(size_t arenaMemory) {
+    auto* pool = ARENA_POOL;
+    int count = VecLength(pool);
+    for (int i = count - 1; i >= 0; i--) {
+        ArenaPtr a = *VecGet_ArenaPtr(pool, i);
+        if (ArenaGetSize(a) != arenaMemory) continue;
+
+        // fill the gap with the last entry
+        ArenaPtr last = nullptr;
+        VecPop_ArenaPtr(pool, &last);
+        if (i < count - 1) VecSet_ArenaPtr(pool, i, last, nullptr);
+        return a;
+    }
+    return NewArena(arenaMemory);
+}
+
+// Sum of bytes allocated in all the stack's arenas, optionally taking `top` at its peak rather than its current use
+size_t StackAllocatedBytes(Arena* top) {
+    size_t total = 0;
+    auto* vec = MEMORY_STACK;
+    int count = VecLength(vec);
+    for (int i = 0; i < count; i++) {
+        ArenaPtr a = *VecGet_ArenaPtr(vec, i);
+        size_t bytes = 0;
+        if (a == top) ArenaGetUsage(a, &bytes, nullptr, nullptr);
+        else ArenaGetState(a, &bytes, nullptr, nullptr, nullptr, nullptr, nullptr);
+        total += bytes;
+    }
+    return total;
+}
+
+// Total allocations made on this thread's stack, including popped arenas
+void StackAllocationTotals(uint32_t* allocations, size_t* bytes) {
+    uint32_t count = POPPED_ALLOCATIONS;
+    size_t total = POPPED_BYTES;
+    auto* vec = MEMORY_STACK;
+    int length = VecLength(vec);
+    for (int i = 0; i < length; i++) {
+        uint32_t arenaCount = 0;
+        size_t arenaBytes = 0;
+        ArenaGetUsage(*VecGet_ArenaPtr(vec, i), nullptr, &arenaCount, &arenaBytes);
+        count += arenaCount;
+        total += arenaBytes;
+    }
+    *allocations = count;
+    *bytes = total;
+}
+
+// Fold an arena's usage into the thread totals before it leaves the stack. It must still be on top.
+void RecordPoppedUsage(Arena* a) {
+    // lower arenas are usually untouched while a higher one is in use, so this is close to the true peak
+    auto peak = StackAllocatedBytes(a);
+    if (peak > PEAK_BYTES) PEAK_BYTES = peak;
+
+    uint32_t count = 0;
+    size_t bytes = 0;
+    ArenaGetUsage(a, nullptr, &count, &bytes);
+    POPPED_ALLOCATIONS += count;
+    POPPED_BYTES += bytes;
+}
+
+// Release everything in an arena, and keep it for reuse if there's room in the pool.
+// Pooled arenas go back to single threaded and untraced, so the next owner gets a plain arena.
+void PoolReturn(Arena* a) {
+    auto* pool = ARENA_POOL;
+    if (VecLength(pool) >= MM_ARENA_POOL_LIMIT) {
+        DropArena(&a);
+        return;
+    }
+    ArenaSetConcurrent(a, false);
+    TraceArena(a, false);
+    ArenaReset(a);
+    if (!VecPush_ArenaPtr(pool, a)) DropArena(&a);
+}
+
+// Ensure the memory manager is ready for the calling thread. It starts with an empty stack
 void StartManagedMemory() {
-    if (LOCK != 0) return; // weak protection, yes.
     if (MEMORY_STACK != nullptr) return;
-    LOCK = 1;
-
-    MEMORY_STACK = VecAllocateArena_ArenaPtr(NewArena((128 KILOBYTES)));
 
-    LOCK = 0;
+    auto managementArena = NewArena((128 KILOBYTES));
+    if (managementArena == nullptr) return;
+    MEMORY_STACK = VecAllocateArena_ArenaPtr(managementArena);
+    ARENA_POOL = VecAllocateArena_ArenaPtr(managementArena);
+    POPPED_ALLOCATIONS = 0;
+    POPPED_BYTES = 0;
+    PEAK_BYTES = 0;
 }
-// Close all arenas and return to stdlib memory
+// Close all of the calling thread's arenas and return to stdlib memory
 void ShutdownManagedMemory() {
-    if (LOCK != 0) return;
     if (MEMORY_STACK == nullptr) return;
 
-    auto* vec = (Vector*)MEMORY_STACK;
+    auto* vec = MEMORY_STACK;
+    auto managementArena = VectorArena(vec);
     ArenaPtr a = nullptr;
     while (VecPop_ArenaPtr(vec, &a)) {
         DropArena(&a);
     }
-    VecDeallocate(vec);
+    auto* pool = ARENA_POOL;
+    while (VecPop_ArenaPtr(pool, &a)) {
+        DropArena(&a);
+    }
+    ARENA_POOL = nullptr;
     MEMORY_STACK = nullptr;
-
-    LOCK = 0;
+    DropArena(&managementArena); // takes the stack and pool vectors with it
 }
 
 // Start a new arena, keeping memory and state of any existing ones
 bool MMPush(size_t arenaMemory) {
     if (MEMORY_STACK == nullptr) return false;
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "LoopDoesntUseConditionVariableInspection"
-    while (LOCK != 0) {}
-#pragma clang diagnostic pop
-    LOCK = 1;
 
-    auto* vec = (Vector*)MEMORY_STACK;
-    auto a = NewArena(arenaMemory);
+    auto* vec = MEMORY_STACK;
+    auto a = PoolTake(arenaMemory);
     bool result = false;
     if (a != nullptr) {
         result = VecPush_ArenaPtr(vec, a);
-        if (!result) DropArena(&a);
+        if (!result) PoolReturn(a);
     }
-
-    LOCK = 0;
     return result;
 }
 
 // Deallocate the most recent arena, restoring the previous
 void MMPop() {
     if (MEMORY_STACK == nullptr) return;
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "LoopDoesntUseConditionVariableInspection"
-    while (LOCK != 0) {}
-#pragma clang diagnostic pop
-    LOCK = 1;
 
-    auto* vec = (Vector*)MEMORY_STACK;
-    ArenaPtr a = nullptr;
+    auto* vec = MEMORY_STACK;
+    ArenaPtr a = MMCurrent();
+    if (a != nullptr) RecordPoppedUsage(a);
     if (VecPop_ArenaPtr(vec, &a)) {
-        DropArena(&a);
+        PoolReturn(a);
     }
-
-    LOCK = 0;
 }
 
 // Deallocate the most recent arena, copying a data item to the next one down (or permanent memory if at the bottom of the stack)
 void* MMPopReturn(void* ptr, size_t size) {
     if (MEMORY_STACK == nullptr) return nullptr;
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "LoopDoesntUseConditionVariableInspection"
-    while (LOCK != 0) {}
-#pragma clang diagnostic pop
-    LOCK = 1;
 
     void* result;
-    auto* vec = (Vector*)MEMORY_STACK;
-    ArenaPtr a = nullptr;
+    auto* vec = MEMORY_STACK;
+    ArenaPtr a = MMCurrent();
+    ArenaPtr next = nullptr;
+    if (a != nullptr) RecordPoppedUsage(a);
     if (VecPop_ArenaPtr(vec, &a)) {
-        if (VecPeek_ArenaPtr(vec, &a)) { // there is another arena. Copy there
-            result = CopyToArena(ptr, size, a);
+        if (VecPeek_ArenaPtr(vec, &next)) { // there is another arena. Copy there
+            result = CopyToArena(ptr, size, next);
         } else { // no more arenas. Dump in regular memory
             result = MakePermanent(ptr, size);
         }
-        DropArena(&a);
+        PoolReturn(a);
     } else { // nothing to pop. Raise null to signal stack underflow
         result = nullptr;
     }
-
-    LOCK = 0;
     return result;
 }
 
-// Return the current arena, or nullptr if none pushed
+// Return the current arena of the calling thread, or nullptr if none pushed
 // TODO: if nothing pushed, push a new small arena
 Arena* MMCurrent() {
     if (MEMORY_STACK == nullptr) return nullptr;
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "LoopDoesntUseConditionVariableInspection"
-    while (LOCK != 0) {}
-#pragma clang diagnostic pop
-    LOCK = 1;
 
-    auto* vec = (Vector*)MEMORY_STACK;
     ArenaPtr result = nullptr;
-    VecPeek_ArenaPtr(vec, &result);
-
-    LOCK = 0;
+    VecPeek_ArenaPtr(MEMORY_STACK, &result);
     return result;
 }
 
+// Read totals across every arena on the calling thread's stack
+void MMGetState(size_t* allocatedBytes, size_t* unallocatedBytes, size_t* peakBytes, int* arenaCount, int* totalReferenceCount) {
+    size_t allocated = 0;
+    size_t unallocated = 0;
+    int references = 0;
+    int count = 0;
+
+    auto* vec = MEMORY_STACK;
+    if (vec != nullptr) {
+        count = VecLength(vec);
+        for (int i = 0; i < count; i++) {
+            size_t arenaAllocated = 0, arenaUnallocated = 0;
+            int arenaReferences = 0;
+            ArenaGetState(*VecGet_ArenaPtr(vec, i), &arenaAllocated, &arenaUnallocated, nullptr, nullptr, &arenaReferences, nullptr);
+            allocated += arenaAllocated;
+            unallocated += arenaUnallocated;
+            references += arenaReferences;
+        }
+        if (count > 0) { // the top arena may have been higher since the last pop
+            auto peak = StackAllocatedBytes(MMCurrent());
+            if (peak > PEAK_BYTES) PEAK_BYTES = peak;
+        }
+    }
+
+    if (allocatedBytes != nullptr) *allocatedBytes = allocated;
+    if (unallocatedBytes != nullptr) *unallocatedBytes = unallocated;
+    if (peakBytes != nullptr) *peakBytes = PEAK_BYTES;
+    if (arenaCount != nullptr) *arenaCount = count;
+    if (totalReferenceCount != nullptr) *totalReferenceCount = references;
+}
+
+// Read allocations made by the calling thread during the last frame
+void MMGetAllocationRate(uint32_t* allocationsPerFrame, size_t* bytesPerFrame) {
+    if (allocationsPerFrame != nullptr) *allocationsPerFrame = LAST_FRAME_ALLOCATIONS;
+    if (bytesPerFrame != nullptr) *bytesPerFrame = LAST_FRAME_BYTES;
+}
+
 // Allocate memory array, cleared to zeros
 void* mcalloc(int count, size_t size) {
     ArenaPtr a = MMCurrent();
     if (a != nullptr) {
         return ArenaAllocateAndClear(a, count*size);
     } else {
-        return calloc(count, size);
+        return ArenaSystemAllocateAndClear(count*size);
     }
 }
 
@@ -143,7 +248,7 @@ void mfree(void* ptr) {
     // we might not be freeing from the current arena, so this can get complex
     ArenaPtr a = MMCurrent();
     if (a == nullptr) { // no arenas. stdlib free
-        free(ptr);
+        ArenaSystemFree(ptr);
         return;
     }
     if (ArenaContainsPointer(a, ptr)) { // in the most recent arena
@@ -154,13 +259,7 @@ void mfree(void* ptr) {
     // otherwise, scan through all the arenas until we find it
     // it might be simpler to leak the memory and let the arena get cleaned up whenever
 
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "LoopDoesntUseConditionVariableInspection"
-    while (LOCK != 0) {}
-#pragma clang diagnostic pop
-    LOCK = 1;
-
-    auto* vec = (Vector*)MEMORY_STACK;
+    auto* vec = MEMORY_STACK;
     int count = VecLength(vec);
     for (int i = 0; i < count; i++) {
         ArenaPtr af = *VecGet_ArenaPtr(vec, i);
@@ -175,7 +274,30 @@ void mfree(void* ptr) {
 #ifdef ARENA_DEBUG
     std::cout << "mfree failed. Memory leaked.\n";
 #endif
+}
+
+// Mark the start of a frame for allocation rate and accounting
+void MMFrameStart() {
+    ArenaAccountingReset();
+    StackAllocationTotals(&FRAME_START_ALLOCATIONS, &FRAME_START_BYTES);
+}
 
-    LOCK = 0;
+// Mark the end of a frame. Complain if we used the system allocator after warm-up
+bool MMFrameEnd() {
+    uint32_t allocations = 0;
+    size_t bytes = 0;
+    StackAllocationTotals(&allocations, &bytes);
+    LAST_FRAME_ALLOCATIONS = allocations - FRAME_START_ALLOCATIONS; // totals wrap, differences don't care
+    LAST_FRAME_BYTES = bytes - FRAME_START_BYTES;
+
+    FRAME_COUNT++;
+    if (FRAME_COUNT <= MM_WARMUP_FRAMES) return true;
+    if (ArenaAccountingSystemCalls() < 1) return true;
+
+#ifdef ARENA_ACCOUNTING
+    std::cout << "Frame " << FRAME_COUNT << " used the system allocator after warm-up.\n";
+    ArenaAccountingReport();
+#endif
+    return false;
 }
 #pragma clang diagnostic pop
\ No newline at end of file
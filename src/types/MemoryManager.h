@@ -13,7 +13,14 @@
 
     Uses the most recently pushed Arena.
     Uses the stdlib versions if no arenas have been pushed, or if not set up.
-    When an arena is popped from the manager, it is deallocated
+
+    Each thread has its own stack of arenas, so `MMCurrent` never returns another thread's arena
+    and no locks are taken. Each thread that wants managed memory must call `StartManagedMemory`,
+    and `ShutdownManagedMemory` before it exits. To hand data to another thread, copy it into
+    an arena that thread owns with `CopyToArena` (or share a concurrent arena, see `ArenaSetConcurrent`).
+    When an arena is popped from the manager, all its allocations are released.
+    The arena itself is reset and kept in a pool, so pushing the same size again
+    (such as a per-frame arena) does not go back to the system allocator.
 */
 
 /*
@@ -29,8 +36,10 @@
     Return values can either be copied out of the closing arena into a different one,
     or be written as produced to another arena.
 
-    At the moment, the maximum allocated chunk size inside an arena is 64K. Use one of the
-    container classes to exceed this.
+    Allocations up to 64K are packed into zones. Bigger ones take a run of whole zones.
+    Small fixed-size objects that are created and destroyed often (container headers,
+    vector chunks, hash map entries) use the arena's slab free lists, so they are reused
+    individually rather than waiting for a whole zone to empty.
 
     General layout:
 
@@ -47,11 +56,14 @@
      .
 */
 
-// Ensure the memory manager is ready. It starts with an empty stack
+// Ensure the memory manager is ready for the calling thread. It starts with an empty stack
 void StartManagedMemory();
-// Close all arenas and return to stdlib memory
+// Close all of the calling thread's arenas and return to stdlib memory
 void ShutdownManagedMemory();
 
+// Maximum number of popped arenas kept for reuse. Extra arenas are deallocated
+#define MM_ARENA_POOL_LIMIT 4
+
 // Start a new arena, keeping memory and state of any existing ones
 bool MMPush(size_t arenaMemory);
 
@@ -62,8 +74,27 @@ void MMPop();
 // NOTE: THIS IS A SHALLOW COPY!
 void* MMPopReturn(void* ptr, size_t size);
 
-// Return the current arena, or NULL if none pushed
+// Return the calling thread's current arena, or NULL if none pushed
 Arena* MMCurrent();
 
+// Read totals across every arena on the calling thread's stack. Pass `NULL` for anything you're not interested in.
+// `peakBytes` is the highest total allocated seen, including arenas that have since been popped.
+// This does not scan zones, so is cheap enough to call every frame.
+void MMGetState(size_t* allocatedBytes, size_t* unallocatedBytes, size_t* peakBytes, int* arenaCount, int* totalReferenceCount);
+
+// Read the number of arena allocations, and bytes requested, by the calling thread during the last frame.
+// Frames are marked by `MMFrameStart` and `MMFrameEnd`. Allocations that fell back to the system allocator are not counted.
+void MMGetAllocationRate(uint32_t* allocationsPerFrame, size_t* bytesPerFrame);
+
+// Number of frames that may use the system allocator (while things warm up) before `MMFrameEnd` complains
+#define MM_WARMUP_FRAMES 8
+
+// Mark the start of a frame on the calling thread, for allocation rate and for accounting if ARENA_ACCOUNTING is defined
+void MMFrameStart();
+
+// Mark the end of a frame for allocation rate and accounting.
+// Returns false, and writes a report to stdout, if a frame after warm-up touched the system allocator
+bool MMFrameEnd();
+
 #endif
 #pragma clang diagnostic pop
\ No newline at end of file
@@ -3,8 +3,142 @@
 #ifndef RawData_h
 #define RawData_h
 
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAWDATA_SSE2 1
+#include <emmintrin.h>
+#endif
+
 // A bunch of inline helper methods for dealing with anonymous data types
 
+// Block copy, swap and compare work a 16 byte block at a time (SSE2 where available),
+// then finish with 8, 4 and 1 byte steps. Element sizes of 4, 8 and 16 get a single move.
+// Fixed size `memcpy` calls compile to a plain (unaligned) load or store, with no library call.
+
+inline void copy4(void* dst, const void* src) { memcpy(dst, src, 4); }
+inline void copy8(void* dst, const void* src) { memcpy(dst, src, 8); }
+inline void copy16(void* dst, const void* src) {
+#ifdef RAWDATA_SSE2
+    _mm_storeu_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)src));
+#else
+    uint64_t lo, hi;
+    memcpy(&lo, src, 8);
+    memcpy(&hi, (const char*)src + 8, 8);
+    memcpy(dst, &lo, 8);
+    memcpy((char*)dst + 8, &hi, 8);
+#endif
+}
+
+// Copy `length` bytes from `src` to `dst`. The blocks must not overlap: use `moveBytes` if they might.
+inline void copyBytes(void* dst, const void* src, size_t length) {
+    auto d = (char*)dst;
+    auto s = (const char*)src;
+    switch (length) {
+        case 4: copy4(d, s); return;
+        case 8: copy8(d, s); return;
+        case 16: copy16(d, s); return;
+        default: break;
+    }
+
+    for (; length >= 16; length -= 16, d += 16, s += 16) copy16(d, s);
+    if (length >= 8) { copy8(d, s); d += 8; s += 8; length -= 8; }
+    if (length >= 4) { copy4(d, s); d += 4; s += 4; length -= 4; }
+    for (; length > 0; length--) *(d++) = *(s++);
+}
+
+// Copy `length` bytes between blocks that may overlap
+inline void moveBytes(void* dst, const void* src, size_t length) {
+    memmove(dst, src, length);
+}
+
+template<typename T>
+inline void swapWord(char* a, char* b) {
+    T x, y;
+    memcpy(&x, a, sizeof(T));
+    memcpy(&y, b, sizeof(T));
+    memcpy(a, &y, sizeof(T));
+    memcpy(b, &x, sizeof(T));
+}
+inline void swap16(char* a, char* b) {
+#ifdef RAWDATA_SSE2
+    auto x = _mm_loadu_si128((const __m128i*)a);
+    auto y = _mm_loadu_si128((const __m128i*)b);
+    _mm_storeu_si128((__m128i*)a, y);
+    _mm_storeu_si128((__m128i*)b, x);
+#else
+    swapWord<uint64_t>(a, b);
+    swapWord<uint64_t>(a + 8, b + 8);
+#endif
+}
+
+// Exchange `length` bytes between two blocks that don't overlap
+inline void swapBytes(void* a, void* b, size_t length) {
+    auto p = (char*)a;
+    auto q = (char*)b;
+    switch (length) {
+        case 4: swapWord<uint32_t>(p, q); return;
+        case 8: swapWord<uint64_t>(p, q); return;
+        case 16: swap16(p, q); return;
+        default: break;
+    }
+
+    for (; length >= 16; length -= 16, p += 16, q += 16) swap16(p, q);
+    if (length >= 8) { swapWord<uint64_t>(p, q); p += 8; q += 8; length -= 8; }
+    if (length >= 4) { swapWord<uint32_t>(p, q); p += 4; q += 4; length -= 4; }
+    for (; length > 0; length--, p++, q++) {
+        const char t = *p;
+        *p = *q;
+        *q = t;
+    }
+}
+
+template<typename T>
+inline bool wordEqual(const char* a, const char* b) {
+    T x, y;
+    memcpy(&x, a, sizeof(T));
+    memcpy(&y, b, sizeof(T));
+    return x == y;
+}
+inline bool equal16(const char* a, const char* b) {
+#ifdef RAWDATA_SSE2
+    auto eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b));
+    return _mm_movemask_epi8(eq) == 0xFFFF;
+#else
+    return wordEqual<uint64_t>(a, b) && wordEqual<uint64_t>(a + 8, b + 8);
+#endif
+}
+
+// True if the first `length` bytes of the two blocks are the same
+inline bool bytesEqual(const void* a, const void* b, size_t length) {
+    auto p = (const char*)a;
+    auto q = (const char*)b;
+    switch (length) {
+        case 4: return wordEqual<uint32_t>(p, q);
+        case 8: return wordEqual<uint64_t>(p, q);
+        case 16: return equal16(p, q);
+        default: break;
+    }
+
+    for (; length >= 16; length -= 16, p += 16, q += 16) {
+        if (!equal16(p, q)) return false;
+    }
+    if (length >= 8) {
+        if (!wordEqual<uint64_t>(p, q)) return false;
+        p += 8; q += 8; length -= 8;
+    }
+    if (length >= 4) {
+        if (!wordEqual<uint32_t>(p, q)) return false;
+        p += 4; q += 4; length -= 4;
+    }
+    for (; length > 0; length--) {
+        if (*(p++) != *(q++)) return false;
+    }
+    return true;
+}
+
+
 inline int readInt(void* ptr) {
     return *((int*)ptr);
 }
@@ -12,24 +146,11 @@ inline void writeInt(void *ptr, int data) {
     *((int*)ptr) = data;
 }
 inline void writeIntPrefixValue(void *dst, int priority, void* data, int length) {
-    char* src = (char*)data;
-    int* priorityPtr = (int*)dst;
-    char* elemPtr = (char*)dst;
-    elemPtr += sizeof(int);
-
-    *priorityPtr = priority;
-    for (int i = 0; i < length; i++) {
-        *(elemPtr++) = *(src++);
-    }
+    *((int*)dst) = priority;
+    copyBytes((char*)dst + sizeof(int), data, (size_t)length);
 }
 inline void readIntPrefixValue(void *dest, void* vecEntry, int length) {
-    char* dst = (char*)dest;
-    char* src = (char*)vecEntry;
-    src += sizeof(int);
-
-    for (int i = 0; i < length; i++) {
-        *(dst++) = *(src++);
-    }
+    copyBytes(dest, (char*)vecEntry + sizeof(int), (size_t)length);
 }
 inline void * byteOffset(void *ptr, size_t byteOffset) {
     auto x = (size_t)ptr;
@@ -68,54 +189,19 @@ inline void writePtr(void *ptr, size_t byteOffset, void* data) {
     *(size_t*)x = (size_t)data;
 }
 inline void writeValue(void *ptr, size_t byteOffset, void* data, int length) {
-    char* dst = (char*)ptr;
-    dst += byteOffset;
-    char* src = (char*)data;
-
-    for (int i = 0; i < length; i++) {
-        *(dst++) = *(src++);
-    }
+    copyBytes((char*)ptr + byteOffset, data, (size_t)length);
 }
 inline void writeValue(void *ptr, size_t byteOffset, void* data, uint32_t length) {
-    char* dst = (char*)ptr;
-    dst += byteOffset;
-    char* src = (char*)data;
-
-    for (uint32_t i = 0; i < length; i++) {
-        *(dst++) = *(src++);
-    }
+    copyBytes((char*)ptr + byteOffset, data, length);
 }
 inline void copyAnonArray(void *dstPtr, int dstIndex, void* srcPtr, int srcIndex, size_t length) {
-    char* dst = (char*)dstPtr;
-    dst += dstIndex * length;
-    char* src = (char*)srcPtr;
-    src += srcIndex * length;
-
-    for (size_t i = 0; i < length; i++) {
-        *(dst++) = *(src++);
-    }
+    copyBytes((char*)dstPtr + (dstIndex * length), (char*)srcPtr + (srcIndex * length), length);
 }
 inline void swapMem(void * const a, void * const b, int n) {
-    auto* p = (unsigned char*)a;
-    auto* q = (unsigned char*)b;
-    unsigned char* const sentry = (unsigned char*)a + n;
-
-    for (; p < sentry; ++p, ++q) {
-        const unsigned char t = *p;
-        *p = *q;
-        *q = t;
-    }
+    swapBytes(a, b, (size_t)n);
 }
 inline void swapMem(void * const a, void * const b, uint32_t n) {
-    auto* p = (unsigned char*)a;
-    auto* q = (unsigned char*)b;
-    unsigned char* const sentry = (unsigned char*)a + n;
-
-    for (; p < sentry; ++p, ++q) {
-        const unsigned char t = *p;
-        *p = *q;
-        *q = t;
-    }
+    swapBytes(a, b, n);
 }
 
 inline uint32_t NextPow2(uint32_t c) {
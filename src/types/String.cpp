@@ -1,8 +1,19 @@
 #include "String.h"
 #include "MemoryManager.h"
+#include "RawData.h"
 
 #include <cstdarg>
 
+#ifdef ARENA_TAGGED_CALLS
+// the real functions are defined here, the call-site macros are only for users
+#undef StringEmpty
+#undef StringNew
+#undef StringNewFormat
+#undef StringEmptyInArena
+#undef StringNewInArena
+#undef StringFind
+#endif
+
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "OCUnusedGlobalDeclarationInspection"
 typedef struct String {
@@ -14,6 +25,9 @@ typedef struct String {
 RegisterVectorStatics(V)
 RegisterVectorFor(char, V)
 
+// Room for characters in a new string before it has to grow
+const unsigned int STRING_INITIAL_CAPACITY = 16;
+
 
 inline ArenaPtr FindArena(VectorPtr vec) {
     auto arena = VectorArena(vec);
@@ -22,13 +36,13 @@ inline ArenaPtr FindArena(VectorPtr vec) {
 }
 
 String * StringEmpty() {
-    auto vec = VAllocate_char();
+    auto vec = VAllocateArenaFlat_char(MMCurrent(), STRING_INITIAL_CAPACITY);
     if (!VectorIsValid(vec)) return nullptr;
 
     auto arena = FindArena(vec);
 	if (arena == nullptr) return nullptr;
 
-    auto str = (String*)ArenaAllocateAndClear(arena, sizeof(String));
+    auto str = (String*)ArenaSlabAllocateAndClear(arena, sizeof(String));
     str->chars = vec;
     str->hashval = 0;
     str->isProxy = false;
@@ -39,10 +53,10 @@ String * StringEmpty() {
 // Create an empty string in a specific memory arena
 String *StringEmptyInArena(Arena* a) {
     if (a == nullptr) return nullptr;
-    auto vec = VAllocateArena_char(a);
+    auto vec = VAllocateArenaFlat_char(a, STRING_INITIAL_CAPACITY);
     if (!VectorIsValid(vec)) return nullptr;
 
-    auto str = (String*)ArenaAllocateAndClear(a, sizeof(String));
+    auto str = (String*)ArenaSlabAllocateAndClear(a, sizeof(String));
     str->chars = vec;
     str->hashval = 0;
     str->isProxy = false;
@@ -56,7 +70,7 @@ String* StringProxy(String* original) {
     auto arena = FindArena(original->chars);
 	if (arena == nullptr) return nullptr;
 
-    auto str = (String*)ArenaAllocateAndClear(arena, sizeof(String)); // put the proxy in the same memory as the original
+    auto str = (String*)ArenaSlabAllocateAndClear(arena, sizeof(String)); // put the proxy in the same memory as the original
     str->chars = original->chars;
     str->hashval = 0;
     str->isProxy = true;
@@ -78,7 +92,7 @@ void StringDeallocate(String *str) {
     auto arena = FindArena(str->chars);
     if (!str->isProxy && VectorIsValid(str->chars)) VectorDeallocate(str->chars);
 
-    ArenaDereference(arena, str);
+    ArenaSlabRelease(arena, str, sizeof(String));
 }
 
 bool StringIsValid(String *str) {
@@ -221,12 +235,7 @@ void StringAppendDouble(String *str, double value) {
 
 void StringAppend(String *first, String *second) {
     if (first == nullptr || second == nullptr) return;
-    unsigned int len = VLength(second->chars);
-    for (unsigned int i = 0; i < len; i++) {
-        auto oc = VGet_char(second->chars, i);
-        if (oc == nullptr) break; // Shouldn't happen?
-        VPush_char(first->chars, *oc);
-    }
+    VectorAppendVector(first->chars, second->chars);
     first->hashval = 0;
 }
 
@@ -245,10 +254,9 @@ String* StringClone(String *str) {
 
 void StringAppend(String *first, const char *second) {
     if (first == nullptr || second == nullptr) return;
-    while (*second != 0) {
-        VPush_char(first->chars, *second);
-        second++;
-    }
+    uint32_t len = 0;
+    while (second[len] != 0) len++;
+    VPushMany_char(first->chars, (char*)second, len);
     first->hashval = 0;
 }
 
@@ -320,6 +328,19 @@ String * StringNewFormat(const char* fmt, ...) {
     return str;
 }
 
+#ifdef ARENA_TAGGED_CALLS
+String * StringNewFormatTagged(const char* site, const char* fmt, ...) {
+    auto outer = ArenaSiteEnter(site);
+    va_list args;
+    va_start(args, fmt);
+    auto str = StringEmpty();
+    vStringAppendFormat(str, fmt, args);
+    va_end(args);
+    ArenaSiteLeave(outer);
+    return str;
+}
+#endif
+
 
 void StringNL(String *str) {
     VPush_char(str->chars, '\n');
@@ -393,9 +414,8 @@ String *StringChop(String* str, int startIdx, int length) {
 char *StringToCStr(String *str, Arena* a) {
     auto len = StringLength(str);
     auto result = (char*)ArenaAllocate(a, 1 + (sizeof(char) * len)); // need extra byte for '\0'
-    for (unsigned int i = 0; i < len; i++) {
-        result[i] = *VGet_char(str->chars, (char)i);
-    }
+    if (result == nullptr) return nullptr;
+    VCopyRange_char(str->chars, 0, len, result);
     result[len] = 0;
     return result;
 }
@@ -405,18 +425,13 @@ char *SubstringToCStr(String *str, int start, Arena* a) {
     if (start < 0) { // from end
         start += len;
     }
-    auto s = start;
-    if (len > s) { len -= s; }
+    auto s = start < 0 ? 0 : start;
+    len = (len > s) ? len - s : 0;
     if (a == nullptr) a = MMCurrent();
 
     auto result = (char*)ArenaAllocate(a, 1 + (sizeof(char) * len)); // need extra byte for '\0'
-    for (int i = 0; i < len; i++) {
-        char *cp = VGet_char(str->chars, (char)(i + s));
-        if (cp == nullptr) {
-            break;
-        }
-        result[i] = *cp;
-    }
+    if (result == nullptr) return nullptr;
+    VCopyRange_char(str->chars, (uint32_t)s, (uint32_t)len, result);
     result[len] = 0;
     return result;
 }
@@ -532,12 +547,25 @@ bool StringAreEqual(String* a, String* b) {
     if (b == nullptr || b->chars == nullptr || !VectorIsValid(b->chars)) return false;
     uint32_t len = StringLength(a);
     if (len != StringLength(b)) return false;
-    for (uint32_t i = 0; i < len; i++) {
-        auto ca = VGet_char(a->chars, (int)i);
-        auto cb = VGet_char(b->chars, (int)i);
-        if (*ca != *cb) return false;
-    }
-    return true;
+    if (len < 1) return true;
+
+    // walk both strings a span at a time, comparing the overlap of the current spans
+    VectorSpan sa, sb;
+    bool okA = VectorSpanFirst(a->chars, 0, &sa), okB = VectorSpanFirst(b->chars, 0, &sb);
+    uint32_t offA = 0, offB = 0;
+    while (okA && okB && len > 0) {
+        uint32_t n = sa.Count - offA;
+        if (sb.Count - offB < n) n = sb.Count - offB;
+        if (len < n) n = len;
+        if (!bytesEqual((char*)sa.Data + offA, (char*)sb.Data + offB, n)) return false;
+
+        len -= n;
+        offA += n;
+        offB += n;
+        if (offA >= sa.Count) { okA = VectorSpanNext(a->chars, &sa); offA = 0; }
+        if (offB >= sb.Count) { okB = VectorSpanNext(b->chars, &sb); offB = 0; }
+    }
+    return len == 0;
 }
 bool StringAreEqual(String* a, const char* b) {
     if (a == nullptr) return false;
@@ -651,6 +679,64 @@ bool StringFind(String* haystack, char needle, unsigned int start, unsigned int*
     return false;
 }
 
+#ifdef ARENA_TAGGED_CALLS
+String *StringEmptyTagged(const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = StringEmpty();
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+String *StringNewTagged(const char *str, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = StringNew(str);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+String *StringNewTagged(char c, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = StringNew(c);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+String *StringEmptyInArenaTagged(Arena* a, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = StringEmptyInArena(a);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+String *StringNewInArenaTagged(const char *str, Arena* a, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = StringNewInArena(str, a);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+bool StringFindTagged(String* haystack, String* needle, unsigned int start, unsigned int* outPosition, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = StringFind(haystack, needle, start, outPosition);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+bool StringFindTagged(String* haystack, const char * needle, unsigned int start, unsigned int* outPosition, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = StringFind(haystack, needle, start, outPosition);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+bool StringFindTagged(String* haystack, char needle, unsigned int start, unsigned int* outPosition, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = StringFind(haystack, needle, start, outPosition);
+    ArenaSiteLeave(outer);
+    return result;
+}
+#endif
+
 
 // Append part of a source string into the end of the destination
 void StringAppendSubstr(String* dest, String* src, int srcStart, int srcLength) {
@@ -129,6 +129,28 @@ bool StringTryParse_double(String *str, double *dest);
 //'\x01'=(String*); '\x02'=int as dec; '\x03'=int as hex; '\x04'=char; '\x05'=C string (const char*); '\x06'=bool; '\x07'=byte as hex
 void vStringAppendFormat(String *str, const char* fmt, va_list args);
 
+#ifdef ARENA_TAGGED_CALLS
+// Create strings, recording the given call site for the allocations made (see `ArenaSiteEnter`)
+String *StringEmptyTagged(const char* site);
+String *StringNewTagged(const char *str, const char* site);
+String *StringNewTagged(char c, const char* site);
+String *StringNewFormatTagged(const char* site, const char* fmt, ...);
+String *StringEmptyInArenaTagged(Arena* a, const char* site);
+String *StringNewInArenaTagged(const char *str, Arena* a, const char* site);
+// Search strings, recording the given call site for any temporary allocations
+bool StringFindTagged(String* haystack, String* needle, unsigned int start, unsigned int* outPosition, const char* site);
+bool StringFindTagged(String* haystack, const char * needle, unsigned int start, unsigned int* outPosition, const char* site);
+bool StringFindTagged(String* haystack, char needle, unsigned int start, unsigned int* outPosition, const char* site);
+
+// Attribute string allocations to the calling source line, rather than to lines inside String.cpp
+#define StringEmpty() StringEmptyTagged(ARENA_CALL_SITE)
+#define StringNew(str) StringNewTagged((str), ARENA_CALL_SITE)
+#define StringNewFormat(...) StringNewFormatTagged(ARENA_CALL_SITE, __VA_ARGS__)
+#define StringEmptyInArena(a) StringEmptyInArenaTagged((a), ARENA_CALL_SITE)
+#define StringNewInArena(str, a) StringNewInArenaTagged((str), (a), ARENA_CALL_SITE)
+#define StringFind(haystack, needle, start, outPosition) StringFindTagged((haystack), (needle), (start), (outPosition), ARENA_CALL_SITE)
+#endif
+
 #endif
 
 #pragma clang diagnostic pop
\ No newline at end of file
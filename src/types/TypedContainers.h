@@ -0,0 +1,302 @@
+#pragma once
+
+#ifndef typed_containers_h
+#define typed_containers_h
+
+#include "Vector.h"
+#include "VectorSort.h"
+#include "HashMap.h"
+#include "Heap.h"
+
+#include <cstring>
+#include <type_traits>
+
+// Typed templates over the `Vector`, `HashMap` and `Heap` containers.
+// These use the same storage as the C functions, and can be mixed with them (see the `Raw` members),
+// but element sizes are known at compile time, so copies are plain moves and compare/hash functions are inlined.
+//
+// Element types are moved around as raw bytes by the containers, so must be trivially copyable.
+// Like the C versions, these are handles: copying one doesn't copy the container, and `Deallocate` must be called.
+
+// Key bits for `TypedHash`
+template<typename K>
+inline uint64_t TypedHashBits(K* key) { return (uint64_t)(uintptr_t)key; }
+template<typename K>
+inline uint64_t TypedHashBits(K key) { return (uint64_t)key; }
+
+// Default hash for integer, enum and pointer keys
+template<typename K>
+struct TypedHash {
+    inline uint32_t operator()(const K& key) const {
+        static_assert(std::is_integral<K>::value || std::is_enum<K>::value || std::is_pointer<K>::value,
+                      "TypedHash only handles integer, enum and pointer keys. Supply a hash type for other keys");
+        auto x = TypedHashBits(key); // 64-bit mix, so nearby keys spread over the buckets
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        return (uint32_t)x;
+    }
+};
+
+// Default key equality, using `==`
+template<typename K>
+struct TypedEqual {
+    inline bool operator()(const K& a, const K& b) const { return a == b; }
+};
+
+// Read or write a value that might not be aligned in the container's storage
+template<typename T>
+inline T TypedLoad(void* ptr) {
+    T result;
+    std::memcpy(&result, ptr, sizeof(T));
+    return result;
+}
+template<typename T>
+inline void TypedStore(void* ptr, const T& value) {
+    std::memcpy(ptr, &value, sizeof(T));
+}
+
+/******************************************************************************************/
+
+// Vector of `T`. See Vector.h
+// Element storage is only aligned to the element size, so elements are copied in and out with `TypedLoad` and `TypedStore`.
+template<typename T>
+struct TypedVector {
+    static_assert(std::is_trivially_copyable<T>::value, "Vector elements must be trivially copyable");
+
+    Vector* Raw;
+
+    static inline TypedVector Wrap(Vector* v) { return TypedVector{v}; }
+    static inline TypedVector Allocate(Arena* a) { return Wrap(VectorAllocateArena(a, sizeof(T))); }
+    static inline TypedVector AllocateAligned(Arena* a) { return Wrap(VectorAllocateArenaAligned(a, sizeof(T))); }
+    static inline TypedVector AllocateFlat(Arena* a, unsigned int capacity) { return Wrap(VectorAllocateArenaFlat(a, sizeof(T), capacity)); }
+    static inline TypedVector AllocateDeque(Arena* a) { return Wrap(VectorAllocateArenaDeque(a, sizeof(T))); }
+    static inline TypedVector AllocateSmall(Arena* a, unsigned int inlineCapacity) { return Wrap(VectorAllocateArenaSmall(a, sizeof(T), inlineCapacity)); }
+
+    inline bool IsValid() { return VectorIsValid(Raw) && VectorElementSize(Raw) == sizeof(T); }
+    inline void Deallocate() { VectorDeallocate(Raw); Raw = nullptr; }
+    inline void Clear() { VectorClear(Raw); }
+    inline uint32_t Length() { return VectorLength(Raw); }
+
+    // Push a copy of `value` to the end of the vector
+    inline bool Push(const T& value) {
+        auto slot = VectorPushSlot(Raw);
+        if (slot == nullptr) return false;
+        TypedStore<T>(slot, value);
+        return true;
+    }
+    // Push a copy of `value` to the start of the vector
+    inline bool PushFront(const T& value) { return VectorPushFront(Raw, (void*)&value); }
+    // Push `count` elements from an array to the end of the vector
+    inline bool PushMany(const T* values, uint32_t count) { return VectorPushMany(Raw, (void*)values, count); }
+
+    // Pointer to an element, or null if out of range.
+    // It may not be aligned for `T`, so access it with `TypedLoad` and `TypedStore` rather than dereferencing it.
+    inline T* Get(int index) { return (T*)VectorGet(Raw, index); }
+    // Overwrite an existing element
+    inline bool Set(int index, const T& value) {
+        auto ptr = VectorGet(Raw, index);
+        if (ptr == nullptr) return false;
+        TypedStore<T>(ptr, value);
+        return true;
+    }
+    inline bool Swap(uint32_t index1, uint32_t index2) {
+        auto a = VectorGet(Raw, (int)index1), b = VectorGet(Raw, (int)index2);
+        if (a == nullptr || b == nullptr) return false;
+        auto tmp = TypedLoad<T>(a);
+        TypedStore<T>(a, TypedLoad<T>(b));
+        TypedStore<T>(b, tmp);
+        return true;
+    }
+
+    // Copy the last element into `target` (if not null) and remove it
+    inline bool Pop(T* target) {
+        auto length = Length();
+        if (length < 1) return false;
+        if (target != nullptr) *target = TypedLoad<T>(VectorGet(Raw, (int)length - 1));
+        return VectorPop(Raw, nullptr);
+    }
+    // Copy the last element into `target` without removing it
+    inline bool Peek(T* target) {
+        auto length = Length();
+        if (length < 1 || target == nullptr) return false;
+        *target = TypedLoad<T>(VectorGet(Raw, (int)length - 1));
+        return true;
+    }
+    // Copy the first element into `target` (if not null) and remove it
+    inline bool Dequeue(T* target) {
+        if (Length() < 1) return false;
+        if (target != nullptr) *target = TypedLoad<T>(VectorGet(Raw, 0));
+        return VectorDequeue(Raw, nullptr);
+    }
+
+    // Call `func(T* element, uint32_t index)` for each element in order, a span at a time.
+    // Spans that aren't aligned for `T` are visited through a copy, which is written back after each call.
+    template<typename TFunc>
+    inline void ForEach(TFunc func) {
+        VectorSpan span;
+        for (bool ok = VectorSpanFirst(Raw, 0, &span); ok; ok = VectorSpanNext(Raw, &span)) {
+            if ((size_t)span.Data % alignof(T) == 0) {
+                auto data = (T*)span.Data;
+                for (uint32_t i = 0; i < span.Count; i++) func(data + i, span.Index + i);
+                continue;
+            }
+            auto bytes = (char*)span.Data;
+            for (uint32_t i = 0; i < span.Count; i++) {
+                auto value = TypedLoad<T>(bytes + ((size_t)i * sizeof(T)));
+                func(&value, span.Index + i);
+                TypedStore<T>(bytes + ((size_t)i * sizeof(T)), value);
+            }
+        }
+    }
+
+    // Sort with an inlined compare, `int compare(T* A, T* B)`. See `VectorSortInline`
+    // Elements that aren't aligned for `T` are compared through copies.
+    template<typename TCompare>
+    inline bool Sort(TCompare compare, int plan = VECTOR_SORT_AUTO) {
+        return VectorSortInline<T>(Raw, [&compare](T* a, T* b) {
+            if (((size_t)a | (size_t)b) % alignof(T) == 0) return compare(a, b);
+            auto copyA = TypedLoad<T>(a), copyB = TypedLoad<T>(b);
+            return compare(&copyA, &copyB);
+        }, plan);
+    }
+};
+
+/******************************************************************************************/
+
+// Hash map from `K` to `V`. See HashMap.h
+// `THash` and `TEqual` are types with `uint32_t operator()(const K&)` and `bool operator()(const K&, const K&)`.
+// They are also used through function pointers when the map is used by the C functions.
+template<typename K, typename V, typename THash = TypedHash<K>, typename TEqual = TypedEqual<K>>
+struct TypedHashMap {
+    static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value, "Keys and values must be trivially copyable");
+
+    HashMap* Raw;
+
+    static bool KeyCompare(void* a, void* b) { return TEqual()(TypedLoad<K>(a), TypedLoad<K>(b)); }
+    static unsigned int KeyHash(void* key) { return THash()(TypedLoad<K>(key)); }
+
+    static inline TypedHashMap Allocate(Arena* a, unsigned int size) {
+        return TypedHashMap{HashMapAllocateArena(a, size, sizeof(K), sizeof(V), KeyCompare, KeyHash)};
+    }
+    static inline TypedHashMap AllocateGrouped(Arena* a, unsigned int size) {
+        return TypedHashMap{HashMapAllocateArenaGrouped(a, size, sizeof(K), sizeof(V), KeyCompare, KeyHash)};
+    }
+    static inline TypedHashMap AllocateIncremental(Arena* a, unsigned int size) {
+        return TypedHashMap{HashMapAllocateArenaIncremental(a, size, sizeof(K), sizeof(V), KeyCompare, KeyHash)};
+    }
+
+    inline bool IsValid() { return HashMapIsValid(Raw); }
+    inline void Deallocate() { HashMapDeallocate(Raw); Raw = nullptr; }
+    inline void Clear() { HashMapClear(Raw); }
+    inline unsigned int Count() { return HashMapCount(Raw); }
+
+    // Find the entry for a key. Returns false if not found.
+    inline bool Find(const K& key, HashMapProbe* probe) {
+        TEqual equal;
+        for (bool ok = HashMapProbeFirst(Raw, THash()(key), probe); ok; ok = HashMapProbeNext(Raw, probe)) {
+            if (equal(TypedLoad<K>(probe->Key), key)) return true;
+        }
+        return false;
+    }
+
+    // Pointer to the value for a key, or null if not found. The value may not be aligned for `V`.
+    inline V* Get(const K& key) {
+        HashMapProbe probe;
+        return Find(key, &probe) ? (V*)probe.Value : nullptr;
+    }
+    // Copy the value for a key into `outValue`. Returns false if not found.
+    inline bool TryGet(const K& key, V* outValue) {
+        HashMapProbe probe;
+        if (!Find(key, &probe)) return false;
+        if (outValue != nullptr) *outValue = TypedLoad<V>(probe.Value);
+        return true;
+    }
+    // Add a key/value pair. If `canReplace` is true, an existing value for the key is overwritten. If false, it survives.
+    inline bool Put(const K& key, const V& value, bool canReplace) {
+        HashMapProbe probe;
+        if (Find(key, &probe)) {
+            if (!canReplace) return false;
+            TypedStore<V>(probe.Value, value);
+            return true;
+        }
+        return HashMapPutHashed(Raw, THash()(key), (void*)&key, (void*)&value);
+    }
+    // Remove the entry for a key, if it exists
+    inline bool Remove(const K& key) {
+        HashMapProbe probe;
+        if (!Find(key, &probe)) return false;
+        return HashMapRemoveProbe(Raw, &probe);
+    }
+};
+
+/******************************************************************************************/
+
+// Min-heap of `T`, ordered by an int priority. See Heap.h
+template<typename T>
+struct TypedHeap {
+    static_assert(std::is_trivially_copyable<T>::value, "Heap elements must be trivially copyable");
+    static const uint32_t EntrySize = sizeof(int) + sizeof(T); // entries are packed [priority][element]
+
+    Heap* Raw;
+
+    static inline TypedHeap Allocate(Arena* a) { return TypedHeap{HeapAllocate(a, sizeof(T))}; }
+
+    inline void Deallocate() { HeapDeallocate(Raw); Raw = nullptr; }
+    inline void Clear() { HeapClear(Raw); }
+    inline bool IsEmpty() { return HeapIsEmpty(Raw); }
+
+    static inline int Priority(Vector* v, uint32_t index) { return TypedLoad<int>(VectorGet(v, (int)index)); }
+    static inline void Move(Vector* v, uint32_t to, uint32_t from) { std::memcpy(VectorGet(v, (int)to), VectorGet(v, (int)from), EntrySize); }
+
+    // Add an element ( O(log n) )
+    inline bool Insert(int priority, const T& element) {
+        auto v = HeapStorage(Raw);
+        if (VectorPushSlot(v) == nullptr) return false;
+
+        // move parents down until we find our place. Entry zero stops the walk.
+        auto i = VectorLength(v) - 1;
+        for (; Priority(v, i >> 1) > priority; i >>= 1) Move(v, i, i >> 1);
+
+        auto entry = (char*)VectorGet(v, (int)i);
+        TypedStore<int>(entry, priority);
+        TypedStore<T>(entry + sizeof(int), element);
+        return true;
+    }
+
+    // Remove the minimum element, copying it into `element` if not null ( O(log n) )
+    inline bool DeleteMin(T* element) {
+        if (IsEmpty()) return false;
+        auto v = HeapStorage(Raw);
+
+        if (element != nullptr) *element = TypedLoad<T>((char*)VectorGet(v, 1) + sizeof(int));
+
+        char last[EntrySize];
+        std::memcpy(last, VectorGet(v, (int)VectorLength(v) - 1), EntrySize);
+        VectorPop(v, nullptr);
+        auto endPriority = TypedLoad<int>(last);
+        auto size = VectorLength(v) - 1;
+
+        // move smaller children up until we find a place for the last entry
+        uint32_t i, child;
+        for (i = 1; i * 2 <= size; i = child) {
+            child = i * 2;
+            if (child != size && Priority(v, child) > Priority(v, child + 1)) child++;
+
+            if (endPriority > Priority(v, child)) Move(v, i, child);
+            else break;
+        }
+
+        if (i <= size) std::memcpy(VectorGet(v, (int)i), last, EntrySize);
+        return true;
+    }
+
+    // Copy the minimum element into `element`. Returns false if empty ( O(1) )
+    inline bool TryFindMin(T* element) {
+        if (IsEmpty() || element == nullptr) return false;
+        *element = TypedLoad<T>((char*)VectorGet(HeapStorage(Raw), 1) + sizeof(int));
+        return true;
+    }
+};
+
+#endif
@@ -2,8 +2,23 @@
 #include "MemoryManager.h"
 
 #include "RawData.h"
+#include "VectorSort.h"
 
 #include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <condition_variable>
+#include <system_error>
+
+#ifdef ARENA_TAGGED_CALLS
+// the real functions are defined here, the call-site macros are only for users
+#undef VectorAllocate
+#undef VectorAllocateArena
+#undef VectorAllocateArenaAligned
+#undef VectorAllocateArenaFlat
+#undef VectorAllocateArenaSmall
+#undef VectorAllocateArenaDeque
+#endif
 
 typedef struct Vector {
     bool IsValid; // if this is false, creation failed
@@ -20,6 +35,8 @@ typedef struct Vector {
     uint32_t ElementByteSize;
     // Size of an allocated chunk (should be `ElemsPerChunk` * `ElementByteSize`)
     uint16_t ChunkBytes;
+    // Alignment of the element data in each chunk, in bytes. Zero if not aligned.
+    uint16_t ChunkAlignment;
 
     // dynamic parts
 
@@ -38,6 +55,24 @@ typedef struct Vector {
 
     // Pointer to skip table
     void* _skipTable;
+
+    // Flat storage: if set, all elements are in one block and there are no chunks.
+    // Element `i` is at `_flatData + (_baseOffset + i) * ElementByteSize`
+    bool _flat;
+    // Start of the flat block (aligned to `ChunkAlignment` if set)
+    char* _flatData;
+    // Number of elements the flat block can hold
+    uint32_t _flatCapacity;
+
+    // Deque mode: each chunk also links back to the one before it, and emptied chunks are kept for reuse
+    bool _deque;
+    // Chain of emptied chunks, waiting for reuse (deque mode only)
+    char* _spareChunks;
+
+    // Bytes of element storage after the header (zero if none). Used as the first flat block.
+    uint32_t _inlineBytes;
+    // If set, outgrowing the flat block moves the elements into chunks, instead of a bigger block
+    bool _spillToChunks;
 } Vector;
 
 
@@ -69,13 +104,34 @@ const int TARGET_ELEMS_PER_CHUNK = 128;
 // This limits the memory growth of larger arrays. If it's bigger than an arena, everything will fail.
 const long SKIP_TABLE_SIZE_LIMIT = 2048;
 
+// Alignment of chunk data for `VectorAllocateArenaAligned`
+const int CACHE_LINE_SIZE = 64;
+
+// Largest block a flat vector will grow to before switching to chunks. A capacity given up front may be larger.
+// Blocks over ARENA_SIZE take runs of whole zones, which get harder to find as the arena fills.
+const uint32_t FLAT_SIZE_LIMIT = 4 * 1048576;
+
+// Smallest capacity of a flat block
+const uint32_t FLAT_MIN_CAPACITY = 8;
+
+// Flat blocks up to this many bytes are kept in the vector header, saving an allocation
+const uint32_t FLAT_INLINE_LIMIT = 64;
+
+// Largest inline block for small vectors (see `VectorAllocateArenaSmall`). Bigger ones get a separate block.
+const uint32_t SMALL_INLINE_LIMIT = 256;
+
+// Options for `VectorAllocateInternal`
+#define VECTOR_DEQUE 1 // chunks link back, and emptied chunks are recycled
+#define VECTOR_SMALL 2 // flat storage in the header, which spills straight into chunks
+
 /*
  * Structure of the element chunk:
  *
  * [Ptr to next chunk, or -1]    <- sizeof(void*)
  * [Chunk value (if set)]        <- sizeof(Element)
  * . . .
- * [Chunk value]                 <- ... up to ChunkBytes
+ * [Chunk value]                 <- ...
+ * [Ptr to previous chunk]       <- deque mode only. Up to ChunkBytes
  *
  */
 
@@ -108,11 +164,60 @@ inline void* VecAlloc(Vector *v, size_t size) {
     return ArenaAllocate(v->_arena,size);
 }
 
+// allocate zeroed chunk memory. If the vector is aligned, the pointer is placed so the element data is aligned.
+// Unaligned chunks come from the arena's slab allocator, so chunks freed by one vector can be reused by the next.
+inline void* VecChunkAlloc(Vector *v) {
+    if (v->_arena == nullptr) return nullptr;
+    if (v->ChunkAlignment == 0) return ArenaSlabAllocateAndClear(v->_arena, v->ChunkBytes); // clear to avoid garbage data in the chunks
+
+    // pad the front so that the element data (after the next pointer) lands on the alignment
+    auto raw = ArenaAllocateAligned(v->_arena, v->ChunkBytes + v->ChunkAlignment - PTR_SIZE, v->ChunkAlignment);
+    if (raw == nullptr) return nullptr;
+    auto ptr = (char*)byteOffset(raw, v->ChunkAlignment - PTR_SIZE);
+    for (int i = 0; i < v->ChunkBytes; i++) {
+        ptr[i] = 0;
+    }
+    return ptr;
+}
+
+// release chunk memory from `VecChunkAlloc`
+inline void VecChunkFree(Vector *v, void* ptr) {
+    if (v->ChunkAlignment == 0) ArenaSlabRelease(v->_arena, ptr, v->ChunkBytes);
+    else VecFree(v, ptr);
+}
+
+// Back link of a chunk in deque mode
+inline char* PrevChunk(Vector *v, void* chunk) {
+    return (char*)readPtr(chunk, PTR_SIZE + (v->ElemsPerChunk * v->ElementByteSize));
+}
+inline void SetPrevChunk(Vector *v, void* chunk, void* prev) {
+    writePtr(chunk, PTR_SIZE + (v->ElemsPerChunk * v->ElementByteSize), prev);
+}
+
+// get chunk memory, reusing a spare chunk if we have one. Reused chunks are not cleared.
+inline void* TakeChunk(Vector *v) {
+    if (v->_spareChunks == nullptr) return VecChunkAlloc(v);
+    auto ptr = v->_spareChunks;
+    v->_spareChunks = (char*)readPtr(ptr, 0);
+    return ptr;
+}
+
+// release chunk memory, or keep it for reuse in deque mode
+inline void DropChunk(Vector *v, void* ptr) {
+    if (!v->_deque) {
+        VecChunkFree(v, ptr);
+        return;
+    }
+    writePtr(ptr, 0, v->_spareChunks);
+    v->_spareChunks = (char*)ptr;
+}
+
 // add a new chunk at the end of the chain
 void *NewChunk(Vector *v) {
-    auto ptr = VecCAlloc(v, 1, v->ChunkBytes); // calloc to avoid garbage data in the chunks
+    auto ptr = TakeChunk(v);
     if (ptr == nullptr) return nullptr;
 
+    if (v->_deque) SetPrevChunk(v, ptr, v->_endChunkPtr);
     ((size_t*)ptr)[0] = 0; // set the continuation pointer of the new chunk to invalid
     if (v->_endChunkPtr != nullptr) ((size_t*)v->_endChunkPtr)[0] = (size_t)ptr;  // update the continuation pointer of the old end chunk
     v->_endChunkPtr = (char*)ptr; // update the end chunk pointer
@@ -176,7 +281,17 @@ bool FindNearestChunk(Vector *v, uint32_t targetIndex, void **chunkPtr, unsigned
 
         var baseAddr = byteOffset(v->_skipTable, (SKIP_ELEM_SIZE * lower)); // pointer to skip table entry
         startChunkIdx = readUint(baseAddr, 0);
+        // entries are not evenly spread after pushing to the front, so the guess can overshoot
+        while (startChunkIdx > targetChunkIdx && lower > 0) {
+            lower--;
+            baseAddr = byteOffset(v->_skipTable, (SKIP_ELEM_SIZE * lower));
+            startChunkIdx = readUint(baseAddr, 0);
+        }
         chunkHeadPtr = readPtr(baseAddr, INDEX_SIZE);
+        if (startChunkIdx > targetChunkIdx) { // no usable entry
+            startChunkIdx = 0;
+            chunkHeadPtr = v->_baseChunkTable;
+        }
     }
 
     var walk = targetChunkIdx - startChunkIdx;
@@ -217,8 +332,7 @@ inline void RebuildSkipTable(Vector *v)
     auto entries = (chunkTotal < SKIP_TABLE_SIZE_LIMIT) ? chunkTotal : SKIP_TABLE_SIZE_LIMIT;
 
     // General case: not every chunk will fit in the skip table
-    // Find representative chunks using the existing table.
-    // (finding will be a combination of search and scan)
+    // Find representative chunks with one walk down the chain, as the targets only move forward.
     auto newTablePtr = VecAlloc(v, SKIP_ELEM_SIZE * entries);
     if (newTablePtr == nullptr) { v->_rebuilding = false; return; } // live with the old one
 
@@ -227,14 +341,14 @@ inline void RebuildSkipTable(Vector *v)
 
     auto target = 0ul;
     auto newSkipEntries = 0;
-    bool found;
-    void *chunkPtr;
-    unsigned int chunkIndex;
+    void *chunkPtr = v->_baseChunkTable;
+    unsigned int chunkIndex = 0;
 
     for (uint i = 0; i < entries; i++) {
-        found = FindNearestChunk(v, target, &chunkPtr, &chunkIndex);
+        auto targetChunkIdx = (unsigned int)((target + v->_baseOffset) >> v->ElemChunkLog2);
+        for (; chunkPtr != nullptr && chunkIndex < targetChunkIdx; chunkIndex++) chunkPtr = readPtr(chunkPtr, 0);
 
-        if (!found || chunkPtr == nullptr) { // total fail
+        if (chunkPtr == nullptr) { // total fail
             VecFree(v,newTablePtr);
             v->_rebuilding = false;
             return;
@@ -273,6 +387,8 @@ inline void * PtrOfElem(Vector *v, uint32_t index) {
     while (index < 0) { index += (int)(v->_elementCount); } // allow negative index syntax
     if (index >= v->_elementCount) return nullptr;
 
+    if (v->_flat) return v->_flatData + ((size_t)(v->_baseOffset + index) * v->ElementByteSize);
+
     var entryIdx = (index + v->_baseOffset) % v->ElemsPerChunk;
 
 	/* */
@@ -293,6 +409,102 @@ inline void * PtrOfElem(Vector *v, uint32_t index) {
 }
 
 
+// The block of element storage after the vector header, or null if there isn't one
+inline char* InlineData(Vector *v) {
+    return (v->_inlineBytes > 0) ? (char*)(v + 1) : nullptr;
+}
+
+// release a flat block, unless it's the one in the vector header
+inline void FlatFree(Vector *v, char* data) {
+    if (data == nullptr || data == InlineData(v)) return;
+    VecFree(v, data);
+}
+
+// allocate a flat block for `capacity` elements. Not cleared.
+inline char* FlatAlloc(Vector *v, uint32_t capacity) {
+    if (v->_arena == nullptr) return nullptr;
+    size_t bytes = (size_t)capacity * v->ElementByteSize;
+    if (v->ChunkAlignment == 0) return (char*)ArenaAllocate(v->_arena, bytes);
+    return (char*)ArenaAllocateAligned(v->_arena, bytes, v->ChunkAlignment);
+}
+
+// Move a flat vector's elements into a chain of chunks.
+// Returns false if we ran out of memory, in which case the vector is still flat and valid, just full.
+bool ChunkifyFlat(Vector *v) {
+    auto esz = v->ElementByteSize;
+    auto count = v->_elementCount;
+    auto src = v->_flatData + ((size_t)v->_baseOffset * esz);
+
+    // Fill the whole chain before switching over, so a failure leaves the flat block untouched
+    char* first = nullptr;
+    char* last = nullptr;
+    uint32_t copied = 0;
+    do {
+        auto chunk = (char*)TakeChunk(v);
+        if (chunk == nullptr) {
+            while (first != nullptr) {
+                auto next = (char*)readPtr(first, 0);
+                DropChunk(v, first);
+                first = next;
+            }
+            return false;
+        }
+        writePtr(chunk, 0, nullptr);
+        if (v->_deque) SetPrevChunk(v, chunk, last);
+        if (last != nullptr) writePtr(last, 0, chunk);
+        else first = chunk;
+        last = chunk;
+
+        auto n = count - copied;
+        if (n > v->ElemsPerChunk) n = v->ElemsPerChunk;
+        copyBytes(chunk + PTR_SIZE, src + ((size_t)copied * esz), (size_t)n * esz);
+        copied += n;
+    } while (copied < count);
+
+    FlatFree(v, v->_flatData);
+    v->_flat = false;
+    v->_flatData = nullptr;
+    v->_flatCapacity = 0;
+    v->_baseChunkTable = first;
+    v->_endChunkPtr = last;
+    v->_baseOffset = 0;
+    v->_skipTableDirty = true;
+    return true;
+}
+
+// Make room in a flat vector for at least `minCapacity` elements from the base offset.
+// Switches to chunks if the block would be too big, or can't be allocated. Returns false if out of memory.
+bool FlatReserve(Vector *v, uint32_t minCapacity) {
+    if (minCapacity <= v->_flatCapacity - v->_baseOffset) return true;
+
+    // slide dequeued space back to the start if that's enough
+    auto esz = v->ElementByteSize;
+    if (minCapacity <= v->_flatCapacity && v->_baseOffset > 0) {
+        moveBytes(v->_flatData, v->_flatData + ((size_t)v->_baseOffset * esz), (size_t)v->_elementCount * esz);
+        v->_baseOffset = 0;
+        return true;
+    }
+
+    if (v->_spillToChunks && v->_flatData != nullptr) return ChunkifyFlat(v); // small vector outgrown
+
+    auto newCapacity = v->_flatCapacity * 2;
+    if (newCapacity < minCapacity) newCapacity = minCapacity;
+    if (newCapacity < FLAT_MIN_CAPACITY) newCapacity = FLAT_MIN_CAPACITY;
+    if (v->_flatData != nullptr && (size_t)newCapacity * esz > FLAT_SIZE_LIMIT) return ChunkifyFlat(v); // a first block can be any size
+
+    auto newData = FlatAlloc(v, newCapacity);
+    if (newData == nullptr) return ChunkifyFlat(v);
+
+    if (v->_flatData != nullptr) {
+        copyAnonArray(newData, 0, v->_flatData + ((size_t)v->_baseOffset * esz), 0, (size_t)v->_elementCount * esz);
+        FlatFree(v, v->_flatData);
+    }
+    v->_flatData = newData;
+    v->_flatCapacity = newCapacity;
+    v->_baseOffset = 0;
+    return true;
+}
+
 uint32_t Log2(uint32_t i) {
     uint32_t r = 0;
 
@@ -303,17 +515,31 @@ uint32_t Log2(uint32_t i) {
     return r - 1;
 }
 
-// Create a new dynamic vector with the given element size (must be fixed per vector) in a specific memory arena
-Vector *VectorAllocateArena(Arena* a, size_t elementSize) {
+// Create a vector, with chunk data aligned to `chunkAlignment` bytes (or zero for no alignment).
+// If `flatCapacity` is not zero, the vector starts in flat storage with that many elements of space.
+// Small flat blocks are stored in the header. `flags` are `VECTOR_DEQUE` and `VECTOR_SMALL`.
+Vector *VectorAllocateInternal(Arena* a, size_t elementSize, uint16_t chunkAlignment, uint32_t flatCapacity, uint32_t flags) {
     if (a == nullptr) return nullptr;
-    auto result = (Vector*)ArenaAllocateAndClear(a, sizeof(Vector));
+    bool deque = (flags & VECTOR_DEQUE) != 0;
+    bool small = (flags & VECTOR_SMALL) != 0;
+
+    size_t inlineBytes = (size_t)flatCapacity * elementSize;
+    if (inlineBytes > (small ? SMALL_INLINE_LIMIT : FLAT_INLINE_LIMIT)) inlineBytes = 0;
+    if (chunkAlignment > 0) inlineBytes = 0; // the header isn't aligned
+
+    auto result = (Vector*)ArenaSlabAllocateAndClear(a, sizeof(Vector) + inlineBytes);
     if (result == nullptr) return nullptr;
+    result->_inlineBytes = (uint32_t)inlineBytes;
+    result->_spillToChunks = small;
 
     result->_arena = a;
     result->ElementByteSize = elementSize;
+    result->ChunkAlignment = chunkAlignment;
 
     // Work out how many elements can fit in an arena
     auto spaceForElements = ARENA_SIZE - PTR_SIZE; // need pointer space
+    if (chunkAlignment > 0) spaceForElements = ARENA_SIZE - chunkAlignment; // and padding to get aligned
+    if (deque) spaceForElements -= PTR_SIZE; // and the back link
     result->ElemsPerChunk = (int)(spaceForElements / result->ElementByteSize);
 
     if (result->ElemsPerChunk <= 1) {
@@ -329,6 +555,9 @@ Vector *VectorAllocateArena(Arena* a, size_t elementSize) {
     result->ElemChunkLog2 = Log2(result->ElemsPerChunk);
 
     result->ChunkBytes = (unsigned short)(PTR_SIZE + (result->ElemsPerChunk * result->ElementByteSize));
+    if (deque) result->ChunkBytes += PTR_SIZE;
+    result->_deque = deque;
+    result->_spareChunks = nullptr;
 
     // Make a table, which can store a few chunks, and can have a next-chunk-table pointer
     // Each chunk can hold a few elements.
@@ -336,6 +565,21 @@ Vector *VectorAllocateArena(Arena* a, size_t elementSize) {
     result->_skipTable = nullptr;
     result->_endChunkPtr = nullptr;
     result->_baseChunkTable = nullptr;
+    result->_elementCount = 0;
+    result->_baseOffset = 0;
+
+    if (flatCapacity > 0) { // we still worked out the chunk sizes, in case we have to switch later
+        result->_flat = true;
+        if (inlineBytes > 0) {
+            result->_flatData = InlineData(result);
+            result->_flatCapacity = flatCapacity;
+        } else if (!FlatReserve(result, flatCapacity)) {
+            result->IsValid = false;
+            return result;
+        }
+        result->IsValid = true;
+        return result;
+    }
 
     auto baseTable = NewChunk(result);
 
@@ -353,10 +597,86 @@ Vector *VectorAllocateArena(Arena* a, size_t elementSize) {
     return result;
 }
 
+// Create a new dynamic vector with the given element size (must be fixed per vector) in a specific memory arena
+Vector *VectorAllocateArena(Arena* a, size_t elementSize) {
+    return VectorAllocateInternal(a, elementSize, 0, 0, 0);
+}
+
+// Create a new dynamic vector where each chunk of elements starts on a cache line
+Vector *VectorAllocateArenaAligned(Arena* a, size_t elementSize) {
+    return VectorAllocateInternal(a, elementSize, CACHE_LINE_SIZE, 0, 0);
+}
+
+// Create a new vector with all elements in one block, with room for `capacity` elements before it has to grow
+Vector *VectorAllocateArenaFlat(Arena* a, size_t elementSize, unsigned int capacity) {
+    if (capacity < FLAT_MIN_CAPACITY) capacity = FLAT_MIN_CAPACITY;
+    return VectorAllocateInternal(a, elementSize, 0, capacity, 0);
+}
+
+// Create a new vector in a specific memory arena, with the first few elements stored in the header
+Vector *VectorAllocateArenaSmall(Arena* a, size_t elementSize, unsigned int inlineCapacity) {
+    if (inlineCapacity < 1) inlineCapacity = 1;
+    return VectorAllocateInternal(a, elementSize, 0, inlineCapacity, VECTOR_SMALL);
+}
+
+// Create a new vector for use as a queue or deque, which recycles its chunks
+Vector *VectorAllocateArenaDeque(Arena* a, size_t elementSize) {
+    return VectorAllocateInternal(a, elementSize, 0, 0, VECTOR_DEQUE);
+}
+
+bool VectorIsFlat(Vector *v) {
+    if (v == nullptr) return false;
+    return v->_flat;
+}
+
 Vector *VectorAllocate(size_t elementSize) {
     return VectorAllocateArena(MMCurrent(), elementSize);
 }
 
+#ifdef ARENA_TAGGED_CALLS
+Vector *VectorAllocateTagged(size_t elementSize, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = VectorAllocate(elementSize);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+Vector *VectorAllocateArenaTagged(Arena* a, size_t elementSize, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = VectorAllocateArena(a, elementSize);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+Vector *VectorAllocateArenaAlignedTagged(Arena* a, size_t elementSize, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = VectorAllocateArenaAligned(a, elementSize);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+Vector *VectorAllocateArenaFlatTagged(Arena* a, size_t elementSize, unsigned int capacity, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = VectorAllocateArenaFlat(a, elementSize, capacity);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+Vector *VectorAllocateArenaSmallTagged(Arena* a, size_t elementSize, unsigned int inlineCapacity, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = VectorAllocateArenaSmall(a, elementSize, inlineCapacity);
+    ArenaSiteLeave(outer);
+    return result;
+}
+
+Vector *VectorAllocateArenaDequeTagged(Arena* a, size_t elementSize, const char* site) {
+    auto outer = ArenaSiteEnter(site);
+    auto result = VectorAllocateArenaDeque(a, elementSize);
+    ArenaSiteLeave(outer);
+    return result;
+}
+#endif
+
 bool VectorIsValid(Vector *v) {
     if (v == nullptr) return false;
     return v->IsValid;
@@ -369,6 +689,7 @@ void VectorClear(Vector *v) {
     v->_elementCount = 0;
     v->_baseOffset = 0;
     v->_skipEntries = 0;
+    if (v->_flat) return; // keep the block for reuse
 
     // empty out the skip table, if present
     if (v->_skipTable != nullptr) {
@@ -384,7 +705,7 @@ void VectorClear(Vector *v) {
     while (current != nullptr) {
         var next = readPtr(current, 0);
         writePtr(current, 0, nullptr); // just in case we have a loop
-        VecFree(v, current);
+        DropChunk(v, current);
         current = next;
     }
 }
@@ -394,6 +715,9 @@ void VectorDeallocate(Vector *v) {
     v->IsValid = false;
     if (v->_skipTable != nullptr) VecFree(v, v->_skipTable);
     v->_skipTable = nullptr;
+    FlatFree(v, v->_flatData);
+    v->_flatData = nullptr;
+    v->_flatCapacity = 0;
     // Walk through the chunk chain, removing until we hit an invalid pointer
     var current = v->_baseChunkTable;
     while (true) {
@@ -401,19 +725,24 @@ void VectorDeallocate(Vector *v) {
 
         var next = readPtr(current, 0);
         writePtr(current, 0, nullptr); // just in case we have a loop
-        VecFree(v, current);
+        VecChunkFree(v, current);
 
         if (current == v->_endChunkPtr) break; // sentinel
         current = (char*)next;
     }
     v->_baseChunkTable = nullptr;
     v->_endChunkPtr = nullptr;
+    while (v->_spareChunks != nullptr) {
+        auto spare = v->_spareChunks;
+        v->_spareChunks = (char*)readPtr(spare, 0);
+        VecChunkFree(v, spare);
+    }
     v->_elementCount = 0;
     v->ElementByteSize = 0;
     v->ElemsPerChunk = 0;
 
     auto a = v->_arena;
-	ArenaDereference(a, v);
+	ArenaSlabRelease(a, v, sizeof(Vector) + v->_inlineBytes);
 }
 
 unsigned int VectorLength(Vector *v) {
@@ -422,7 +751,22 @@ unsigned int VectorLength(Vector *v) {
 }
 
 bool VectorPush(Vector *v, void* value) {
-    if (v == nullptr) return false;
+    auto slot = VectorPushSlot(v);
+    if (slot == nullptr) return false;
+    writeValue(slot, 0, value, v->ElementByteSize);
+    return true;
+}
+
+void* VectorPushSlot(Vector *v) {
+    if (v == nullptr) return nullptr;
+    if (v->_flat) {
+        if (!FlatReserve(v, v->_elementCount + 1)) return nullptr;
+        if (v->_flat) { // might have switched to chunks
+            auto slot = v->_flatData + ((size_t)(v->_baseOffset + v->_elementCount) * v->ElementByteSize);
+            v->_elementCount++;
+            return slot;
+        }
+    }
     var entryIdx = (v->_elementCount + v->_baseOffset) % v->ElemsPerChunk;
 
     void *chunkPtr = nullptr;
@@ -432,18 +776,70 @@ bool VectorPush(Vector *v, void* value) {
         var ok = NewChunk(v);
         if (ok == nullptr) {
             v->IsValid = false;
-            return false;
+            return nullptr;
         }
-        writeValue(v->_endChunkPtr, PTR_SIZE, value, v->ElementByteSize);
         v->_elementCount++;
-        return true;
+        return byteOffset(v->_endChunkPtr, PTR_SIZE);
     }
-    if (chunkPtr == nullptr) return false;
+    if (chunkPtr == nullptr) return nullptr;
 
-    // Writing value into existing chunk
-    writeValue(chunkPtr, PTR_SIZE + (v->ElementByteSize * entryIdx), value, v->ElementByteSize);
+    // Slot in existing chunk
     v->_elementCount++;
+    return byteOffset(chunkPtr, PTR_SIZE + (v->ElementByteSize * entryIdx));
+}
+
+bool VectorPushFront(Vector *v, void* value) {
+    if (v == nullptr || !v->IsValid) return false;
+    var esz = v->ElementByteSize;
 
+    if (v->_flat) {
+        if (v->_baseOffset < 1) {
+            if (!FlatReserve(v, v->_elementCount + 1)) return false;
+        }
+        if (v->_flat && v->_baseOffset < 1) {
+            // no space at the front: move everything up to leave a gap, so the next few are cheap
+            uint gap = (v->_flatCapacity - v->_elementCount) / 2;
+            if (gap < 1) gap = 1;
+            size_t shift = (size_t)gap * esz;
+            moveBytes(v->_flatData + shift, v->_flatData, (size_t)v->_elementCount * esz);
+            v->_baseOffset = gap;
+        }
+        if (v->_flat) { // might have switched to chunks
+            v->_baseOffset--;
+            writeValue(v->_flatData, (size_t)v->_baseOffset * esz, value, esz);
+            v->_elementCount++;
+            return true;
+        }
+    }
+
+    if (v->_elementCount < 1 && v->_baseOffset < 1) return VectorPush(v, value);
+
+    if (v->_baseOffset < 1) { // need a new chunk before the first one
+        auto chunk = (char*)TakeChunk(v);
+        if (chunk == nullptr) return false;
+
+        writePtr(chunk, 0, v->_baseChunkTable);
+        if (v->_deque) {
+            SetPrevChunk(v, chunk, nullptr);
+            SetPrevChunk(v, v->_baseChunkTable, chunk);
+        }
+        v->_baseChunkTable = chunk;
+        v->_baseOffset = v->ElemsPerChunk;
+
+        // every chunk moved up one place. Point the first entry at the new base.
+        for (uint i = 0; i < v->_skipEntries; i++) {
+            auto entry = byteOffset(v->_skipTable, SKIP_ELEM_SIZE * i);
+            writeUint(entry, 0, readUint(entry, 0) + 1);
+        }
+        if (v->_skipEntries > 0) {
+            writeUint(v->_skipTable, 0, 0);
+            writePtr(v->_skipTable, INDEX_SIZE, chunk);
+        }
+    }
+
+    v->_baseOffset--;
+    writeValue(v->_baseChunkTable, PTR_SIZE + (v->_baseOffset * esz), value, esz);
+    v->_elementCount++;
     return true;
 }
 
@@ -458,8 +854,6 @@ void VectorFreeCache(Vector* v, void* cache) {
 
 void* VectorCacheRange(Vector* v, uint32_t* lowIndex, uint32_t* highIndex) {
     if (v == nullptr || v->_elementCount < 1) return nullptr;
-    uint32_t chunkIndex = 0;
-    void* chunkPtr = nullptr;
 
     // force to range, and update
     if ((*lowIndex) < 0) *lowIndex = 0;
@@ -467,37 +861,135 @@ void* VectorCacheRange(Vector* v, uint32_t* lowIndex, uint32_t* highIndex) {
 
     auto requiredElems = ((*highIndex) - (*lowIndex)) + 1;
 
-    // get offsets for optimisations
-    auto maxIdx = v->ElemsPerChunk;
-    uint32_t index = ((*lowIndex) + v->_baseOffset) % v->ElemsPerChunk;
-   
-    // find first chunk
-    if (!FindNearestChunk(v, *lowIndex, &chunkPtr, &chunkIndex)) return nullptr;
+    // make memory for our range, and copy it across
+    auto block = VecAlloc(v, (size_t)v->ElementByteSize * requiredElems);
+    if (block == nullptr) return nullptr;
+    if (!VectorCopyRange(v, *lowIndex, requiredElems, block)) {
+        VecFree(v, block);
+        return nullptr;
+    }
+    return block;
+}
+
+bool VectorSpanFirst(Vector* v, uint32_t startIndex, VectorSpan* span) {
+    if (v == nullptr || span == nullptr || startIndex >= v->_elementCount) return false;
+
+    span->Index = startIndex;
+    if (v->_flat) { // one span holds everything
+        span->_chunk = nullptr;
+        span->Data = PtrOfElem(v, startIndex);
+        span->Count = v->_elementCount - startIndex;
+        return true;
+    }
+
+    void *chunkPtr = nullptr;
+    uint32_t chunkIndex = 0;
+    if (!FindNearestChunk(v, startIndex, &chunkPtr, &chunkIndex)) return false;
+
+    uint32_t entryIdx = (startIndex + v->_baseOffset) & (v->ElemsPerChunk - 1);
+    uint32_t inChunk = v->ElemsPerChunk - entryIdx;
+    uint32_t remaining = v->_elementCount - startIndex;
+
+    span->_chunk = chunkPtr;
+    span->Data = byteOffset(chunkPtr, PTR_SIZE + (v->ElementByteSize * entryIdx));
+    span->Count = (remaining < inChunk) ? remaining : inChunk;
+    return true;
+}
+
+bool VectorSpanNext(Vector* v, VectorSpan* span) {
+    if (v == nullptr || span == nullptr || span->_chunk == nullptr) return false;
+
+    auto nextIndex = span->Index + span->Count;
+    if (nextIndex >= v->_elementCount) return false;
+
+    auto chunkPtr = readPtr(span->_chunk, 0);
+    if (chunkPtr == nullptr) return false;
+
+    uint32_t remaining = v->_elementCount - nextIndex;
+    span->_chunk = chunkPtr;
+    span->Index = nextIndex;
+    span->Data = byteOffset(chunkPtr, PTR_SIZE);
+    span->Count = (remaining < v->ElemsPerChunk) ? remaining : v->ElemsPerChunk;
+    return true;
+}
+
+uint32_t VectorSpanLimit(Vector* v) {
+    if (v == nullptr) return 0;
+    return v->_flat ? v->_flatCapacity : v->ElemsPerChunk;
+}
+
+bool VectorPushMany(Vector* v, void* values, uint32_t count) {
+    if (v == nullptr || (values == nullptr && count > 0)) return false;
+    if (count < 1) return true;
 
-    // make memory for our chunk
     auto esz = v->ElementByteSize;
-    auto block = VecAlloc(v, esz * requiredElems);
-    if (block == nullptr) return nullptr;
+    if (v->_flat) {
+        if (!FlatReserve(v, v->_elementCount + count)) return false;
+        if (v->_flat) { // might have switched to chunks
+            writeValue(v->_flatData, (size_t)(v->_baseOffset + v->_elementCount) * esz, values, count * esz);
+            v->_elementCount += count;
+            return true;
+        }
+    }
 
-    // now, scan along (switching chunk as required) until full
-    auto dst = block;
-    auto src = byteOffset(chunkPtr, PTR_SIZE + (esz * index));
-    while (requiredElems > 0) {
-        writeValue(dst, 0, src, esz);
-        dst = byteOffset(dst, esz);
-
-        requiredElems--;
-        index++;
-        if (index >= maxIdx) { // move to next chunk
-            index = 0;
-            chunkPtr = readPtr(chunkPtr, 0);
-            src = byteOffset(chunkPtr, PTR_SIZE);
-        } else { // next element in same chunk
-            src = byteOffset(src, esz);
+    // fill the end chunk, then add new chunks as needed
+    auto src = (char*)values;
+    while (count > 0) {
+        uint32_t realEnd = v->_elementCount + v->_baseOffset;
+        uint32_t entryIdx = realEnd & (v->ElemsPerChunk - 1);
+        if (entryIdx == 0 && realEnd > 0) { // end chunk is full
+            if (NewChunk(v) == nullptr) {
+                v->IsValid = false;
+                return false;
+            }
         }
+
+        uint32_t space = v->ElemsPerChunk - entryIdx;
+        uint32_t n = (count < space) ? count : space;
+        writeValue(v->_endChunkPtr, PTR_SIZE + (esz * entryIdx), src, n * esz);
+
+        v->_elementCount += n;
+        src += (size_t)n * esz;
+        count -= n;
     }
+    return true;
+}
 
-    return block;
+bool VectorCopyRange(Vector* v, uint32_t startIndex, uint32_t count, void* target) {
+    if (v == nullptr || target == nullptr) return false;
+    if (count < 1) return true;
+    if (startIndex >= v->_elementCount || count > v->_elementCount - startIndex) return false;
+
+    auto esz = v->ElementByteSize;
+    auto dst = (char*)target;
+    VectorSpan span;
+    for (bool ok = VectorSpanFirst(v, startIndex, &span); ok && count > 0; ok = VectorSpanNext(v, &span)) {
+        uint32_t n = (count < span.Count) ? count : span.Count;
+        writeValue(dst, 0, span.Data, n * esz);
+        dst += (size_t)n * esz;
+        count -= n;
+    }
+    return count == 0;
+}
+
+bool VectorAppendVector(Vector* v, Vector* source) {
+    if (v == nullptr || source == nullptr) return false;
+    if (v->ElementByteSize != source->ElementByteSize) return false;
+
+    // take the length first, as `source` may be `v`
+    uint32_t remaining = source->_elementCount;
+    if (remaining < 1) return true;
+
+    // make room up front, so a flat block doesn't move while we read from it
+    if (v->_flat && !FlatReserve(v, v->_elementCount + remaining)) return false;
+
+    VectorSpan span;
+    for (bool ok = VectorSpanFirst(source, 0, &span); ok && remaining > 0; ok = VectorSpanNext(source, &span)) {
+        uint32_t n = (remaining < span.Count) ? remaining : span.Count;
+        if (!VectorPushMany(v, span.Data, n)) return false;
+        remaining -= n;
+    }
+    return remaining == 0;
 }
 
 bool VectorCopy(Vector * v, unsigned int index, void * outValue)
@@ -515,6 +1007,13 @@ bool VectorDequeue(Vector * v, void * outValue) {
     if (!v->IsValid) return false;
     if (v->_elementCount < 1) return false;
 
+    if (v->_flat) {
+        if (outValue != nullptr) writeValue(outValue, 0, PtrOfElem(v, 0), v->ElementByteSize);
+        v->_elementCount--;
+        v->_baseOffset = (v->_elementCount < 1) ? 0 : v->_baseOffset + 1;
+        return true;
+    }
+
     // read the element at index `_baseOffset`, then increment `_baseOffset`.
     if (outValue != nullptr) {
         auto ptr = byteOffset(v->_baseChunkTable, PTR_SIZE + (v->_baseOffset * v->ElementByteSize));
@@ -527,7 +1026,7 @@ bool VectorDequeue(Vector * v, void * outValue) {
     if (v->_baseOffset < v->ElemsPerChunk) return true;
 
     // If `_baseOffset` is equal to chunk length, deallocate the first chunk.
-    // When we we deallocate a chunk, copy a truncated version of the skip table
+    // When we we deallocate a chunk, renumber the skip table
     // if we're on the last chunk, don't deallocate, but just reset the base offset.
 
     v->_baseOffset = 0;
@@ -538,27 +1037,21 @@ bool VectorDequeue(Vector * v, void * outValue) {
     // Advance the base and free the old
     auto oldChunk = v->_baseChunkTable;
     v->_baseChunkTable = (char*)nextChunk;
-    VecFree(v, oldChunk);
+    if (v->_deque) SetPrevChunk(v, nextChunk, nullptr);
+    DropChunk(v, oldChunk);
 
     if (v->_skipTable == nullptr) return true; // don't need to fix the table
 
-    // Make a truncated version of the skip table
-    v->_skipEntries--;
-    if (v->_skipEntries < 4) { // no point having a table
-        VecFree(v, v->_skipTable);
-        v->_skipEntries = 0;
-        v->_skipTable = nullptr;
-        return true;
-    }
-    // Copy of the skip table with first element gone
-    uint length = SKIP_ELEM_SIZE * v->_skipEntries;
-    auto newTablePtr = (char*)VecAlloc(v, length);
-    auto oldTablePtr = (char*)v->_skipTable;
-    for (uint i = 0; i < length; i++) {
-        newTablePtr[i] = oldTablePtr[i + SKIP_ELEM_SIZE];
+    // Renumber the table in place to match the new base. Entries for the old chunk move to the new one.
+    for (uint i = 0; i < v->_skipEntries; i++) {
+        auto entry = byteOffset(v->_skipTable, SKIP_ELEM_SIZE * i);
+        auto chunkIdx = readUint(entry, 0);
+        if (chunkIdx < 1) {
+            writePtr(entry, INDEX_SIZE, nextChunk);
+        } else {
+            writeUint(entry, 0, chunkIdx - 1);
+        }
     }
-    v->_skipTable = newTablePtr;
-    VecFree(v, oldTablePtr);
 
     return true;
 }
@@ -566,6 +1059,13 @@ bool VectorDequeue(Vector * v, void * outValue) {
 bool VectorPop(Vector *v, void *target) {
     if (v == nullptr || v->_elementCount == 0) return false;
 
+    if (v->_flat) {
+        if (target != nullptr) writeValue(target, 0, PtrOfElem(v, v->_elementCount - 1), v->ElementByteSize);
+        v->_elementCount--;
+        if (v->_elementCount < 1) v->_baseOffset = 0;
+        return true;
+    }
+
     var index = v->_elementCount - 1;
     var entryIdx = (index + v->_baseOffset) % v->ElemsPerChunk;
 
@@ -581,13 +1081,18 @@ bool VectorPop(Vector *v, void *target) {
         // need to dealloc end chunk
         void *prevChunkPtr = nullptr;
         uint deadChunkIdx = 0;
-        if (!FindNearestChunk(v, index - 1, &prevChunkPtr, &deadChunkIdx)
-            || prevChunkPtr == v->_endChunkPtr) {
+        if (v->_deque) { // deque chunks link back, so no search needed
+            prevChunkPtr = PrevChunk(v, v->_endChunkPtr);
+            deadChunkIdx = (index - 1 + v->_baseOffset) / v->ElemsPerChunk;
+        } else if (!FindNearestChunk(v, index - 1, &prevChunkPtr, &deadChunkIdx)) {
+            prevChunkPtr = nullptr;
+        }
+        if (prevChunkPtr == nullptr || prevChunkPtr == v->_endChunkPtr) {
             // damaged references!
             v->IsValid = false;
             return false;
         }
-        VecFree(v, v->_endChunkPtr);
+        DropChunk(v, v->_endChunkPtr);
         v->_endChunkPtr = (char*)prevChunkPtr;
         writePtr(prevChunkPtr, 0, nullptr); // remove the 'next' pointer from the new end chunk
 
@@ -610,6 +1115,11 @@ bool VectorPop(Vector *v, void *target) {
 bool VectorPeek(Vector *v, void* target) {
     if (v->_elementCount == 0) return false;
 
+    if (v->_flat) {
+        if (target != nullptr) writeValue(target, 0, PtrOfElem(v, v->_elementCount - 1), v->ElementByteSize);
+        return true;
+    }
+
     var index = v->_elementCount - 1;
     var entryIdx = (index + v->_baseOffset) % v->ElemsPerChunk;
 
@@ -636,10 +1146,22 @@ bool VectorSet(Vector *v, int index, void* element, void* prevValue) {
 }
 
 bool VectorPreallocate(Vector *v, unsigned int length) {
+    if (v->_flat) {
+        if (length <= v->_elementCount) return true;
+        if (!FlatReserve(v, length)) return false;
+    }
+    if (v->_flat) { // clear the new elements
+        auto esz = v->ElementByteSize;
+        auto start = v->_flatData + ((size_t)(v->_baseOffset + v->_elementCount) * esz);
+        memset(start, 0, (size_t)(length - v->_elementCount) * esz);
+        v->_elementCount = length;
+        return true;
+    }
+
     var remain = length - v->_elementCount;
     if (remain < 1) return true;
 
-    var newChunkIdx = length / v->ElemsPerChunk;
+    var newChunkIdx = (length + v->_baseOffset - 1) / v->ElemsPerChunk; // chunk holding the last element
 
     // Walk through the chunk chain, adding where needed
     var chunkHeadPtr = v->_baseChunkTable;
@@ -654,58 +1176,49 @@ bool VectorPreallocate(Vector *v, unsigned int length) {
         chunkHeadPtr = (char*)nextChunkPtr;
     }
 
+    var oldCount = v->_elementCount;
     v->_elementCount = length;
 
     RebuildSkipTable(v); // make sure we're up to date
 
+    // clear the new elements, as reused chunks and popped slots hold old data
+    VectorSpan span;
+    if (VectorSpanFirst(v, oldCount, &span)) {
+        do {
+            memset(span.Data, 0, (size_t)span.Count * v->ElementByteSize);
+        } while (VectorSpanNext(v, &span));
+    }
+
     return true;
 }
 
 
-inline bool VectorSwapInternal(Vector *v, unsigned int index1, unsigned int index2, void* tmp, int bytes) {
+inline bool VectorSwapInternal(Vector *v, unsigned int index1, unsigned int index2) {
     var A = PtrOfElem(v, index1);
     var B = PtrOfElem(v, index2);
 
     if (A == nullptr || B == nullptr) return false;
-
-    writeValue(tmp, 0, A, bytes); // tmp = A
-    writeValue(A, 0, B, bytes); // A = B
-    writeValue(B, 0, tmp, bytes); // B = tmp
+    if (A != B) swapMem(A, B, v->ElementByteSize); // swapped in place, a word at a time
 
     return true;
 }
 
 bool VectorSwap(Vector *v, unsigned int index1, unsigned int index2) {
     if (v == nullptr) return false;
-
-    var bytes = v->ElementByteSize;
-    var tmp = VecAlloc(v, bytes);
-    if (tmp == nullptr) return false;
-
-    VectorSwapInternal(v, index1, index2, tmp, (int)bytes);
-
-    VecFree(v, tmp);
-
-    return true;
+    return VectorSwapInternal(v, index1, index2);
 }
 
 bool VectorReverse(Vector *v) {
     // we could probably optimise this quite a lot
     if (v == nullptr) return false;
 
-    auto bytes = v->ElementByteSize;
-    auto tmp = VecAlloc(v, bytes);
-    if (tmp == nullptr) return false;
-
     auto end = v->_elementCount;
     auto halfLength = end / 2;
     for (uint32_t i = 0; i < halfLength; i++) {
         end--;
-        VectorSwapInternal(v, i, end, tmp, (int)bytes);
+        VectorSwapInternal(v, i, end);
     }
 
-    VecFree(v, tmp);
-
     return true;
 }
 
@@ -751,74 +1264,99 @@ void* IterativeMergeSort(void* arr1, void* arr2, int n, int elemSize, int(*compa
 }
 
 void VectorSort(Vector *v, int(*compareFunc)(void*, void*)) {
-    // Available Plans:
-
-    // A - normal merge: (extra space ~N + chunkSize)
-    // 1. in each chunk, run the simple array-based merge-sort
-    // 2. merge-sort between pairs of chunks
-    // 3. keep merging pairs into longer chains until all sorted
-    //
-    // B - tide-front (insertion sort) (extra space ~N)
-    // 1. in each chunk, run the simple array-based sort
-    // 2. build a 'tide' array, one element per chunk
-    // 3. pick the lowest element in the array, and replace with next element from that chunk
-    // 4. repeat until all empty
-    //
-    // C - compare-exchange (extra space ~chunkSize)
-    // 1. each chunk merged
-    // 2. we pick a chunk and merge it in turn with each other chunk (so one has values always smaller than other)
-    // 3. repeat until sorted (see notebook)
-    //
-    // D - empty and re-fill (extra space ~2N) -- the optimised nature of push/pop might make this quite good.
-    // 1. make 2 arrays big enough for the vector
-    // 2. empty the vector into one of them (can do this as first part of sort [2-pairs])
-    // 3. sort normally
-    // 4. push back into vector
-    //
-    // E - proxy sort (extra space ~N)
-    // 1. Change the compare function to a 'make-ordinal'
-    // 2. Write a proxy array of current position and ordinal
-    // 3. Sort that
-    // 4. swap elements in the vector to match
-
-    // Going to start with 'D' as a base-line
-
-    // Allocate the temporary structures
-    uint32_t n = VectorLength(v);
-    auto size = v->ElementByteSize;
-    void* arr1 = VecAlloc(v, (n+1) * size); // extra space for swapping
-    if (arr1 == nullptr) return;
-    void* arr2 = VecAlloc(v, n * size);
-    if (arr2 == nullptr) { VecFree(v, arr1); return; }
-
-    // write into array in pairs, doing the scale=1 merge
-    uint32_t i = 0;
+    VectorSortWithPlan(v, compareFunc, VECTOR_SORT_AUTO);
+}
+
+bool VectorSortWithPlan(Vector *v, int(*compareFunc)(void*, void*), int plan) {
+    if (v == nullptr || compareFunc == nullptr) return false;
+    VectorSortAnyOps ops = { v->ElementByteSize, compareFunc };
+    return VectorSortWithOps(v, ops, plan);
+}
+
+// Worker threads shared by parallel sorts. They are started as sorts first need them, then sleep between sorts.
+// The pool is never freed and its threads are detached, so nothing has to be joined at exit.
+typedef struct SortPool {
+    std::mutex busy; // held by the sort using the workers
+    std::mutex lock; // guards everything below
+    std::condition_variable wake; // signalled when a round starts
+    std::condition_variable done; // signalled when the last worker of a round finishes
+    int started; // threads running, not counting the callers
+    int round; // bumped to start each round
+    int workers; // workers in this round, including the caller
+    int running; // pool threads still working on this round
+    void (*task)(void* context, int worker);
+    void* context;
+} SortPool;
+
+static SortPool* GetSortPool() {
+    static SortPool* pool = new SortPool();
+    return pool;
+}
+
+static void SortPoolThread(SortPool* p, int worker, int seen) { // `seen` is the round when the thread was started
+    std::unique_lock<std::mutex> guard(p->lock);
     while (true) {
-        void* a = byteOffset(arr1, i * size);
-        void* b = byteOffset(arr1, (i+1) * size);
-        bool _a = VectorDequeue(v, a);
-        bool _b = VectorDequeue(v, b);
-
-        if (_a && _b) { // wrote 2: compare and swap if required
-            if (compareFunc(a, b) > 0) swapMem(a, b, size);
-        } else { // empty vector
-            break;
+        p->wake.wait(guard, [p, seen]() { return p->round != seen; });
+        seen = p->round;
+        if (worker >= p->workers) continue; // not needed this round
+
+        auto task = p->task;
+        auto context = p->context;
+        guard.unlock();
+        task(context, worker);
+        guard.lock();
+        if (--p->running == 0) p->done.notify_one();
+    }
+}
+
+int VectorSortPoolAcquire(int workers) {
+    auto p = GetSortPool();
+    if (!p->busy.try_lock()) return 1; // another sort has the workers
+
+    if (workers > VECTOR_SORT_MAX_THREADS) workers = VECTOR_SORT_MAX_THREADS;
+    {
+        std::lock_guard<std::mutex> guard(p->lock);
+        while (p->started + 1 < workers) {
+            try {
+                std::thread(SortPoolThread, p, p->started + 1, p->round).detach();
+            } catch (const std::system_error&) {
+                break; // use the threads we have
+            }
+            p->started++;
         }
-        i += 2;
+        if (p->started + 1 < workers) workers = p->started + 1;
     }
 
-    // do the sort
-    auto result = IterativeMergeSort(arr1, arr2, (int)n, (int)size, compareFunc);
+    if (workers < 2) p->busy.unlock();
+    return workers;
+}
 
-    // push the result back into the vector
-    for (i = 0; i < n; i++) {
-        void* src = byteOffset(result, i * size);
-        VectorPush(v, src);
+void VectorSortPoolRun(int workers, void (*task)(void* context, int worker), void* context) {
+    auto p = GetSortPool();
+    {
+        std::lock_guard<std::mutex> guard(p->lock);
+        p->task = task;
+        p->context = context;
+        p->workers = workers;
+        p->running = workers - 1;
+        p->round++;
     }
+    p->wake.notify_all();
+
+    task(context, 0);
 
-    // clean up
-    VecFree(v, arr1);
-    VecFree(v, arr2);
+    std::unique_lock<std::mutex> guard(p->lock);
+    p->done.wait(guard, [p]() { return p->running == 0; });
+}
+
+void VectorSortPoolRelease() {
+    GetSortPool()->busy.unlock();
+}
+
+bool VectorSortParallel(Vector *v, int(*compareFunc)(void*, void*), int threads) {
+    if (v == nullptr || compareFunc == nullptr) return false;
+    VectorSortAnyOps ops = { v->ElementByteSize, compareFunc };
+    return VectorSortParallelWithOps(v, ops, threads);
 }
 
 Arena* VectorArena(Vector *v) {
@@ -827,23 +1365,21 @@ Arena* VectorArena(Vector *v) {
 
 // Clone a vector into a new arena
 Vector* VectorClone(Vector* source, Arena* a) {
-    // this could be optimised, but we need to relocate all pointers properly if we do.
     if (source == nullptr) return nullptr;
     if (a == nullptr) a = MMCurrent();
 
     auto len = VectorLength(source);
     auto elemSize = VectorElementSize(source);
-    auto result = VectorAllocateArena(a, elemSize);
-    VectorPreallocate(result, len);
-    for (size_t i = 0; i < len; i++) {
-        var src = PtrOfElem(source, i);
-        if (src == nullptr) continue;
-
-        var dst = PtrOfElem(result, i);
-        if (dst == nullptr) continue;
-
-        writeValue(dst, 0, src, elemSize);
+    uint32_t flatCapacity = source->_flat ? ((len < FLAT_MIN_CAPACITY) ? FLAT_MIN_CAPACITY : len) : 0;
+    uint32_t flags = source->_deque ? VECTOR_DEQUE : 0;
+    if (source->_spillToChunks) { // keep the same inline space
+        flags |= VECTOR_SMALL;
+        flatCapacity = source->_flat ? source->_flatCapacity : 0;
     }
+    auto result = VectorAllocateInternal(a, elemSize, source->ChunkAlignment, flatCapacity, flags);
+    if (!VectorIsValid(result)) return result;
+
+    VectorAppendVector(result, source);
     return result;
 }
 
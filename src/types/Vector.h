@@ -15,7 +15,26 @@ typedef Vector* VectorPtr;
 Vector *VectorAllocate(size_t elementSize);
 // Create a new dynamic vector with the given element size (must be fixed per vector) in a specific memory arena
 Vector *VectorAllocateArena(Arena* a, size_t elementSize);
-// Clone a vector into a new arena
+// Create a new dynamic vector in a specific memory arena, where the elements of each chunk start on a cache line (64 bytes).
+// Elements are only all aligned if the element size is a multiple of the alignment.
+Vector *VectorAllocateArenaAligned(Arena* a, size_t elementSize);
+// Create a new vector in a specific memory arena, with all elements in one block so indexing is direct.
+// Use this when the size is known, or expected to stay small. `capacity` is the number of elements to make room for.
+// Growing past the capacity moves the block, so pointers from `VectorGet` are invalidated by any push.
+// Vectors that grow very large (or can't find a bigger block) switch to normal chunked storage.
+// The starting capacity is taken as one block whatever its size, if the arena has room for it.
+Vector *VectorAllocateArenaFlat(Arena* a, size_t elementSize, unsigned int capacity);
+// Create a new vector in a specific memory arena, for holding a few elements.
+// The first `inlineCapacity` elements are stored in the vector header (up to 256 bytes), with no chunks or skip table.
+// Growing past that moves the elements into normal chunked storage.
+Vector *VectorAllocateArenaSmall(Arena* a, size_t elementSize, unsigned int inlineCapacity);
+// Returns true if the vector is using flat storage (see `VectorAllocateArenaFlat`)
+bool VectorIsFlat(Vector *v);
+// Create a new vector in a specific memory arena, for use as a queue or double-ended queue.
+// Chunks link both ways, so `VectorPop` doesn't need to search, and emptied chunks are kept
+// to be reused by later pushes at either end. Memory is only released by `VectorDeallocate`.
+Vector *VectorAllocateArenaDeque(Arena* a, size_t elementSize);
+// Clone a vector into a new arena. Chunk alignment is kept.
 Vector* VectorClone(Vector* source, Arena* a);
 // Check the vector is correctly allocated
 bool VectorIsValid(Vector *v);
@@ -27,6 +46,11 @@ void VectorDeallocate(Vector *v);
 unsigned int VectorLength(Vector *v);
 // Push a new value to the end of the vector
 bool VectorPush(Vector *v, void* value);
+// Add an element to the end of the vector, and return a pointer to it. The caller must write the element.
+// Returns null if the vector could not grow. The pointer is invalidated like the result of `VectorGet`.
+void* VectorPushSlot(Vector *v);
+// Push a new value to the start of the vector. All existing elements move up one index.
+bool VectorPushFront(Vector *v, void* value);
 // Get a pointer to an element in the vector. This is an in-place pointer -- no copy is made
 void* VectorGet(Vector *v, int index);
 // Copy data from an element in the vector to a pointer
@@ -50,8 +74,24 @@ bool VectorReverse(Vector *v);
 
 // Sort the vector in-place using the given compare function.
 // Compare should return 0 if the two values are equal, negative if A should be before B, and positive if B should be before A.
+// For a compare function that can be inlined, see `VectorSortInline` in VectorSort.h
 void VectorSort(Vector *v, int(*compareFunc)(void* A, void* B));
 
+// Sort plans for `VectorSortWithPlan`. See VectorSort.h for details
+#define VECTOR_SORT_AUTO     0 // pick a plan for the vector size
+#define VECTOR_SORT_MERGE    1 // sort each chunk, then merge pairs of runs. Stable. Extra space ~N + chunk
+#define VECTOR_SORT_TIDE     2 // sort each chunk, then merge all runs at once. Extra space ~N
+#define VECTOR_SORT_COPY_OUT 3 // copy into a flat array and sort there. Extra space ~2N, in one block
+#define VECTOR_SORT_PROXY    4 // sort pointers to the elements, then copy them in order. Extra space ~N + 2N pointers
+
+// Sort the vector using a specific plan. If there isn't memory for that plan, `VECTOR_SORT_MERGE` is used.
+// Returns false if the vector could not be sorted.
+bool VectorSortWithPlan(Vector *v, int(*compareFunc)(void* A, void* B), int plan);
+
+// Sort the vector using up to `threads` threads (or zero for one per core). The compare function is called from all of them at once.
+// Short vectors are sorted on the calling thread. Returns false if the vector could not be sorted.
+bool VectorSortParallel(Vector *v, int(*compareFunc)(void* A, void* B), int threads);
+
 // Read a range of the vector into a contiguous array
 // this is for optimising multiple local accesses in algorithms.
 // `lowIndex` and `highIndex` will be updated to the actual range returned
@@ -59,6 +99,34 @@ void* VectorCacheRange(Vector* v, uint32_t* lowIndex, uint32_t* highIndex);
 // Free cache memory
 void VectorFreeCache(Vector* v, void* cache);
 
+// A run of elements that are next to each other in memory.
+// Used to walk a vector without looking up each element: see `VectorSpanFirst` and `VectorSpanNext`
+typedef struct VectorSpan {
+    // Pointer to the first element of the span
+    void* Data;
+    // Vector index of the first element of the span
+    uint32_t Index;
+    // Number of elements in the span
+    uint32_t Count;
+    // Chunk holding the span (internal)
+    void* _chunk;
+} VectorSpan;
+
+// Get the span from element `startIndex` to the end of its chunk. Returns false if the index is out of range.
+// Spans are invalidated by anything that changes the vector length.
+bool VectorSpanFirst(Vector* v, uint32_t startIndex, VectorSpan* span);
+// Move to the span after this one. Returns false at the end of the vector.
+bool VectorSpanNext(Vector* v, VectorSpan* span);
+// The most elements a span in this vector can have
+uint32_t VectorSpanLimit(Vector* v);
+
+// Push `count` elements from a contiguous array to the end of the vector
+bool VectorPushMany(Vector* v, void* values, uint32_t count);
+// Copy `count` elements starting at `startIndex` into a contiguous array. Returns false if the range is out of bounds.
+bool VectorCopyRange(Vector* v, uint32_t startIndex, uint32_t count, void* target);
+// Push a copy of every element in `source` to the end of `v`. Element sizes must match. `source` can be `v`.
+bool VectorAppendVector(Vector* v, Vector* source);
+
 // Size of vector elements, in bytes
 uint32_t VectorElementSize(Vector *v);
 
@@ -85,12 +153,18 @@ void* IterativeMergeSort(void* arr1, void* arr2, int n, int elemSize, int(*compa
     inline bool nameSpace##Swap(Vector *v, unsigned int index1, unsigned int index2){ return VectorSwap(v, index1, index2); }\
     inline void nameSpace##FreeCache(Vector *v, void *c) { VectorFreeCache(v, c); }\
     inline void nameSpace##Clear(Vector *v) { VectorClear(v); }\
+    inline bool nameSpace##Append(Vector *v, Vector *source) { return VectorAppendVector(v, source); }\
 
 // These must be registered for each type, as they are type variant
 #define RegisterVectorFor(typeName, nameSpace) \
     inline Vector* nameSpace##Allocate_##typeName(){ return VectorAllocate(sizeof(typeName)); } \
     inline Vector* nameSpace##AllocateArena_##typeName(Arena* a){ return VectorAllocateArena(a, sizeof(typeName)); } \
+    inline Vector* nameSpace##AllocateArenaAligned_##typeName(Arena* a){ return VectorAllocateArenaAligned(a, sizeof(typeName)); } \
+    inline Vector* nameSpace##AllocateArenaFlat_##typeName(Arena* a, unsigned int capacity){ return VectorAllocateArenaFlat(a, sizeof(typeName), capacity); } \
+    inline Vector* nameSpace##AllocateArenaDeque_##typeName(Arena* a){ return VectorAllocateArenaDeque(a, sizeof(typeName)); } \
+    inline Vector* nameSpace##AllocateArenaSmall_##typeName(Arena* a, unsigned int inlineCapacity){ return VectorAllocateArenaSmall(a, sizeof(typeName), inlineCapacity); } \
     inline bool nameSpace##Push_##typeName(Vector *v, typeName value){ return VectorPush(v, (void*)&value); } \
+    inline bool nameSpace##PushFront_##typeName(Vector *v, typeName value){ return VectorPushFront(v, (void*)&value); } \
     inline typeName * nameSpace##Get_##typeName(Vector *v, int index){ return (typeName*)VectorGet(v, index); } \
     inline bool nameSpace##Copy_##typeName(Vector *v, unsigned int idx, typeName *target){ return VectorCopy(v, idx, (void*) target); } \
     inline bool nameSpace##Pop_##typeName(Vector *v, typeName *target){ return VectorPop(v, (void*) target); } \
@@ -99,8 +173,27 @@ void* IterativeMergeSort(void* arr1, void* arr2, int n, int elemSize, int(*compa
     inline bool nameSpace##Dequeue_##typeName(Vector *v, typeName* outValue) { return VectorDequeue(v, (void*)outValue);}\
     inline void nameSpace##Sort_##typeName(Vector *v, int(*compareFunc)(typeName* A, typeName* B)) {VectorSort(v, (int(*)(void* A, void* B))compareFunc);}\
     inline typeName* nameSpace##CacheRange_##typeName(Vector* v, uint32_t* lowIndex, uint32_t* highIndex) {return (typeName*)VectorCacheRange(v, lowIndex, highIndex);}\
-
-
+    inline bool nameSpace##PushMany_##typeName(Vector *v, typeName* values, uint32_t count){ return VectorPushMany(v, (void*)values, count); } \
+    inline bool nameSpace##CopyRange_##typeName(Vector *v, uint32_t startIndex, uint32_t count, typeName* target){ return VectorCopyRange(v, startIndex, count, (void*)target); } \
+
+
+#ifdef ARENA_TAGGED_CALLS
+// Create vectors, recording the given call site for the allocations made (see `ArenaSiteEnter`)
+Vector *VectorAllocateTagged(size_t elementSize, const char* site);
+Vector *VectorAllocateArenaTagged(Arena* a, size_t elementSize, const char* site);
+Vector *VectorAllocateArenaAlignedTagged(Arena* a, size_t elementSize, const char* site);
+Vector *VectorAllocateArenaFlatTagged(Arena* a, size_t elementSize, unsigned int capacity, const char* site);
+Vector *VectorAllocateArenaSmallTagged(Arena* a, size_t elementSize, unsigned int inlineCapacity, const char* site);
+Vector *VectorAllocateArenaDequeTagged(Arena* a, size_t elementSize, const char* site);
+
+// Attribute vector creation to the calling source line, rather than to lines inside Vector.cpp
+#define VectorAllocate(elementSize) VectorAllocateTagged((elementSize), ARENA_CALL_SITE)
+#define VectorAllocateArena(a, elementSize) VectorAllocateArenaTagged((a), (elementSize), ARENA_CALL_SITE)
+#define VectorAllocateArenaAligned(a, elementSize) VectorAllocateArenaAlignedTagged((a), (elementSize), ARENA_CALL_SITE)
+#define VectorAllocateArenaFlat(a, elementSize, capacity) VectorAllocateArenaFlatTagged((a), (elementSize), (capacity), ARENA_CALL_SITE)
+#define VectorAllocateArenaSmall(a, elementSize, inlineCapacity) VectorAllocateArenaSmallTagged((a), (elementSize), (inlineCapacity), ARENA_CALL_SITE)
+#define VectorAllocateArenaDeque(a, elementSize) VectorAllocateArenaDequeTagged((a), (elementSize), ARENA_CALL_SITE)
+#endif
 
 #endif
 
@@ -0,0 +1,711 @@
+#pragma once
+
+#ifndef vector_sort_h
+#define vector_sort_h
+
+#include "Vector.h"
+#include "RawData.h"
+
+#include <thread>
+#include <atomic>
+
+// Sorting for `Vector`, as templates so the compare function can be inlined.
+// Use `VectorSortInline<T>(v, compare)` with a function or lambda like `int compare(T* A, T* B)`.
+// `VectorSort` and `VectorSortWithPlan` run the same code through a compare function pointer.
+//
+// Plans (see `VECTOR_SORT_...` in Vector.h):
+//
+// A - merge (extra space ~N + chunkSize)
+// 1. copy into a scratch vector, and sort each chunk there with a chunk-sized array
+// 2. merge pairs of runs between the two vectors
+// 3. keep merging pairs into longer runs until all sorted
+//
+// B - tide-front (extra space ~N)
+// 1. copy into a scratch vector, and sort each chunk there
+// 2. build a 'tide' heap, with the head element of each chunk
+// 3. write out the lowest element in the heap, and replace with next element from that chunk
+// 4. repeat until all empty
+//
+// C - compare-exchange (extra space ~chunkSize) -- not implemented
+//
+// D - copy out (extra space ~2N, in one block)
+// 1. copy the vector into a flat array
+// 2. sort normally
+// 3. copy back into the vector
+//
+// E - proxy sort (extra space ~N + 2N pointers)
+// 1. copy into a scratch vector
+// 2. write a proxy array of pointers to the elements, and sort that
+// 3. copy elements back into the vector in proxy order
+
+// Compare through a function pointer, and copy with the vector's element size
+typedef struct VectorSortAnyOps {
+    uint32_t Size;
+    int(*Compare)(void* A, void* B);
+
+    inline bool Less(void* a, void* b) { return Compare(a, b) < 0; }
+    inline void Copy(void* dst, void* src) { writeValue(dst, 0, src, Size); }
+} VectorSortAnyOps;
+
+// Compare with an inlined function, and copy by type
+template<typename T, typename TCompare>
+struct VectorSortTypedOps {
+    static const uint32_t Size = sizeof(T);
+    TCompare Compare;
+
+    inline bool Less(void* a, void* b) { return Compare((T*)a, (T*)b) < 0; }
+    inline void Copy(void* dst, void* src) { memcpy(dst, src, sizeof(T)); } // elements may not be aligned for `T`
+};
+
+// Compare pointers to elements, for the proxy sort
+template<typename TOps>
+struct VectorSortProxyOps {
+    static const uint32_t Size = sizeof(char*);
+    TOps* Inner;
+
+    inline bool Less(void* a, void* b) { return Inner->Less(*(char**)a, *(char**)b); }
+    inline void Copy(void* dst, void* src) { *(char**)dst = *(char**)src; }
+};
+
+// Walks the elements of a vector, a span at a time
+typedef struct VectorSortCursor {
+    VectorSpan Span;
+    char* Ptr;     // current element
+    char* SpanEnd; // end of the current span
+} VectorSortCursor;
+
+inline bool VectorSortCursorStart(VectorSortCursor* c, Vector* v, uint32_t index, uint32_t size) {
+    if (!VectorSpanFirst(v, index, &c->Span)) {
+        c->Ptr = c->SpanEnd = nullptr;
+        return false;
+    }
+    c->Ptr = (char*)c->Span.Data;
+    c->SpanEnd = c->Ptr + ((size_t)c->Span.Count * size);
+    return true;
+}
+
+// Number of elements left in the cursor's current span
+inline uint32_t VectorSortCursorAvailable(VectorSortCursor* c, uint32_t size) {
+    return (uint32_t)((size_t)(c->SpanEnd - c->Ptr) / size);
+}
+
+// Move to the next span if the cursor has reached the end of this one
+inline void VectorSortCursorSettle(VectorSortCursor* c, Vector* v, uint32_t size) {
+    if (c->Ptr < c->SpanEnd) return;
+    if (!VectorSpanNext(v, &c->Span)) {
+        c->Ptr = c->SpanEnd = nullptr;
+        return;
+    }
+    c->Ptr = (char*)c->Span.Data;
+    c->SpanEnd = c->Ptr + ((size_t)c->Span.Count * size);
+}
+
+// Move the cursor forward by `count` elements, a span at a time
+inline void VectorSortCursorSkip(VectorSortCursor* c, Vector* v, uint32_t count, uint32_t size) {
+    while (count > 0 && c->Ptr != nullptr) {
+        uint32_t avail = VectorSortCursorAvailable(c, size);
+        if (count < avail) {
+            c->Ptr += (size_t)count * size;
+            return;
+        }
+        count -= avail;
+        c->Ptr = c->SpanEnd;
+        VectorSortCursorSettle(c, v, size);
+    }
+}
+
+inline void VectorSortCursorNext(VectorSortCursor* c, Vector* v, uint32_t size) {
+    c->Ptr += size;
+    if (c->Ptr < c->SpanEnd) return;
+    if (!VectorSpanNext(v, &c->Span)) {
+        c->Ptr = c->SpanEnd = nullptr;
+        return;
+    }
+    c->Ptr = (char*)c->Span.Data;
+    c->SpanEnd = c->Ptr + ((size_t)c->Span.Count * size);
+}
+
+// Merge two sorted arrays into `out`. Equal elements keep their order.
+template<typename TOps>
+inline void VectorSortMergeArrays(char* l, uint32_t ln, char* r, uint32_t rn, char* out, TOps& ops) {
+    auto size = ops.Size;
+    auto lEnd = l + ((size_t)ln * size);
+    auto rEnd = r + ((size_t)rn * size);
+    while (l < lEnd && r < rEnd) {
+        if (ops.Less(r, l)) { ops.Copy(out, r); r += size; }
+        else { ops.Copy(out, l); l += size; }
+        out += size;
+    }
+    while (l < lEnd) { ops.Copy(out, l); l += size; out += size; }
+    while (r < rEnd) { ops.Copy(out, r); r += size; out += size; }
+}
+
+// Sort `n` elements in place. `scratch` must have space for `n` elements.
+// Short groups get an insertion sort, then groups are merged back and forth between the two arrays.
+template<typename TOps>
+void VectorSortArray(char* data, uint32_t n, char* scratch, TOps& ops) {
+    const uint32_t groupSize = 8;
+    auto size = ops.Size;
+    if (n < 2) return;
+
+    for (uint32_t group = 0; group < n; group += groupSize) {
+        uint32_t end = (group + groupSize < n) ? group + groupSize : n;
+        for (uint32_t i = group + 1; i < end; i++) {
+            if (!ops.Less(data + ((size_t)i * size), data + ((size_t)(i - 1) * size))) continue;
+            ops.Copy(scratch, data + ((size_t)i * size)); // scratch is free until the merges
+            uint32_t j = i;
+            do {
+                ops.Copy(data + ((size_t)j * size), data + ((size_t)(j - 1) * size));
+                j--;
+            } while (j > group && ops.Less(scratch, data + ((size_t)(j - 1) * size)));
+            ops.Copy(data + ((size_t)j * size), scratch);
+        }
+    }
+
+    auto A = data;
+    auto B = scratch;
+    for (uint32_t stride = groupSize; stride < n; stride <<= 1u) {
+        for (uint32_t left = 0; left < n; left += stride << 1u) {
+            uint32_t right = (left + stride < n) ? left + stride : n;
+            uint32_t end = (right + stride < n) ? right + stride : n;
+            VectorSortMergeArrays(A + ((size_t)left * size), right - left, A + ((size_t)right * size), end - right, B + ((size_t)left * size), ops);
+        }
+        auto swp = A; A = B; B = swp;
+    }
+
+    if (A != data) writeValue(data, 0, A, (uint32_t)(n * size));
+}
+
+// Sort each span of the vector in place. Writes the index where each span starts into `bounds`,
+// with the length at the end. Returns the number of spans.
+template<typename TOps>
+uint32_t VectorSortSpans(Vector* v, char* scratch, uint32_t* bounds, TOps& ops) {
+    uint32_t count = 0;
+    VectorSpan span;
+    for (bool ok = VectorSpanFirst(v, 0, &span); ok; ok = VectorSpanNext(v, &span)) {
+        VectorSortArray((char*)span.Data, span.Count, scratch, ops);
+        if (bounds != nullptr) bounds[count] = span.Index;
+        count++;
+    }
+    if (bounds != nullptr) bounds[count] = VectorLength(v);
+    return count;
+}
+
+// Count the spans in a vector
+inline uint32_t VectorSortSpanCount(Vector* v) {
+    uint32_t count = 0;
+    VectorSpan span;
+    for (bool ok = VectorSpanFirst(v, 0, &span); ok; ok = VectorSpanNext(v, &span)) count++;
+    return count;
+}
+
+// Make a scratch vector holding a copy of `v`, so runs can be sorted and merged between the two
+inline Vector* VectorSortScratch(Vector* v) {
+    auto scratch = VectorAllocateArena(VectorArena(v), VectorElementSize(v));
+    if (!VectorIsValid(scratch)) return nullptr;
+    if (!VectorAppendVector(scratch, v)) {
+        VectorDeallocate(scratch);
+        return nullptr;
+    }
+    return scratch;
+}
+
+// Temporary memory for the sort plans
+inline void* VectorSortAlloc(Vector* v, size_t bytes) {
+    return ArenaAllocate(VectorArena(v), bytes);
+}
+inline void VectorSortFree(Vector* v, void* ptr) {
+    ArenaDereference(VectorArena(v), ptr);
+}
+
+// Sort a flat vector where it is
+template<typename TOps>
+bool VectorSortFlat(Vector* v, TOps& ops) {
+    VectorSpan span;
+    if (!VectorSpanFirst(v, 0, &span)) return true;
+
+    auto scratch = (char*)VectorSortAlloc(v, (size_t)span.Count * ops.Size);
+    if (scratch == nullptr) return false;
+    VectorSortArray((char*)span.Data, span.Count, scratch, ops);
+    VectorSortFree(v, scratch);
+    return true;
+}
+
+// Plan D: copy out to a flat array, sort, and copy back
+template<typename TOps>
+bool VectorSortCopyOut(Vector* v, TOps& ops) {
+    auto n = VectorLength(v);
+    auto size = ops.Size;
+    auto data = (char*)VectorSortAlloc(v, (size_t)n * size * 2);
+    if (data == nullptr) return false;
+    auto scratch = data + ((size_t)n * size);
+
+    VectorCopyRange(v, 0, n, data);
+    VectorSortArray(data, n, scratch, ops);
+
+    VectorSpan span;
+    for (bool ok = VectorSpanFirst(v, 0, &span); ok; ok = VectorSpanNext(v, &span)) {
+        writeValue(span.Data, 0, data + ((size_t)span.Index * size), (uint32_t)(span.Count * size));
+    }
+
+    VectorSortFree(v, data);
+    return true;
+}
+
+// Merge two sorted runs of `src`, `ln` elements from `l` and `rn` from `r`, writing to `out` in `dst`.
+// `r` must start where the `l` run ends. Afterwards `r` and `out` are at the end of the merged run.
+template<typename TOps>
+void VectorSortMergeRuns(Vector* src, Vector* dst, VectorSortCursor& l, VectorSortCursor& r, VectorSortCursor& out, uint32_t ln, uint32_t rn, TOps& ops) {
+    auto size = ops.Size;
+
+    while (ln > 0 && rn > 0) {
+        // merge as far as we can without any cursor leaving its span
+        uint32_t steps = VectorSortCursorAvailable(&out, size);
+        uint32_t avail = VectorSortCursorAvailable(&l, size);
+        if (avail > ln) avail = ln;
+        if (avail < steps) steps = avail;
+        avail = VectorSortCursorAvailable(&r, size);
+        if (avail > rn) avail = rn;
+        if (avail < steps) steps = avail;
+
+        auto lp = l.Ptr;
+        auto rp = r.Ptr;
+        auto op = out.Ptr;
+        for (uint32_t i = 0; i < steps; i++) {
+            if (ops.Less(rp, lp)) { ops.Copy(op, rp); rp += size; }
+            else { ops.Copy(op, lp); lp += size; }
+            op += size;
+        }
+        ln -= (uint32_t)((size_t)(lp - l.Ptr) / size);
+        rn -= (uint32_t)((size_t)(rp - r.Ptr) / size);
+        l.Ptr = lp; r.Ptr = rp; out.Ptr = op;
+        if (ln > 0) VectorSortCursorSettle(&l, src, size);
+        if (rn > 0) VectorSortCursorSettle(&r, src, size);
+        VectorSortCursorSettle(&out, dst, size);
+    }
+
+    // copy whatever is left over
+    VectorSortCursor* rest = (ln > 0) ? &l : &r;
+    uint32_t remaining = (ln > 0) ? ln : rn;
+    while (remaining > 0) {
+        uint32_t steps = VectorSortCursorAvailable(&out, size);
+        uint32_t avail = VectorSortCursorAvailable(rest, size);
+        if (avail < steps) steps = avail;
+        if (remaining < steps) steps = remaining;
+
+        writeValue(out.Ptr, 0, rest->Ptr, (uint32_t)(steps * size));
+        out.Ptr += (size_t)steps * size;
+        rest->Ptr += (size_t)steps * size;
+        remaining -= steps;
+        if (remaining > 0) VectorSortCursorSettle(rest, src, size);
+        VectorSortCursorSettle(&out, dst, size);
+    }
+}
+
+// Plan A: sort chunks, then merge pairs of runs until there is only one
+template<typename TOps>
+bool VectorSortMerge(Vector* v, TOps& ops) {
+    auto work = VectorSortScratch(v);
+    if (work == nullptr) return false;
+
+    auto spanCount = VectorSortSpanCount(work);
+    auto bounds = (uint32_t*)VectorSortAlloc(v, sizeof(uint32_t) * (spanCount + 1));
+    auto scratch = (char*)VectorSortAlloc(v, (size_t)VectorSpanLimit(work) * ops.Size);
+    if (bounds == nullptr || scratch == nullptr) {
+        if (bounds != nullptr) VectorSortFree(v, bounds);
+        if (scratch != nullptr) VectorSortFree(v, scratch);
+        VectorDeallocate(work);
+        return false;
+    }
+    uint32_t runs = VectorSortSpans(work, scratch, bounds, ops);
+    VectorSortFree(v, scratch);
+
+    // merge back and forth, halving the run count each time
+    auto src = work;
+    auto dst = v;
+    while (runs > 1) {
+        // cursors carry on from one pair to the next, so we only look up the start of the vectors
+        VectorSortCursor l, r, out;
+        VectorSortCursorStart(&out, dst, 0, ops.Size);
+        VectorSortCursorStart(&r, src, 0, ops.Size);
+
+        uint32_t merged = 0;
+        for (uint32_t i = 0; i < runs; i += 2) {
+            uint32_t mid = (i + 1 < runs) ? bounds[i + 1] : bounds[runs];
+            uint32_t end = (i + 2 < runs) ? bounds[i + 2] : bounds[runs];
+
+            VectorSortCursorSettle(&r, src, ops.Size);
+            l = r;
+            VectorSortCursorSkip(&r, src, mid - bounds[i], ops.Size);
+            VectorSortMergeRuns(src, dst, l, r, out, mid - bounds[i], end - mid, ops);
+            bounds[merged++] = bounds[i];
+        }
+        bounds[merged] = bounds[runs];
+        runs = merged;
+        auto swp = src; src = dst; dst = swp;
+    }
+
+    // result is now in `src`
+    if (src != v) {
+        VectorSpan span;
+        for (bool ok = VectorSpanFirst(v, 0, &span); ok; ok = VectorSpanNext(v, &span)) {
+            VectorCopyRange(src, span.Index, span.Count, span.Data);
+        }
+    }
+
+    VectorSortFree(v, bounds);
+    VectorDeallocate(work);
+    return true;
+}
+
+// Plan B: sort chunks, then merge all of them at once through a heap of their head elements
+template<typename TOps>
+bool VectorSortTide(Vector* v, TOps& ops) {
+    auto size = ops.Size;
+    auto work = VectorSortScratch(v);
+    if (work == nullptr) return false;
+
+    auto spanCount = VectorSortSpanCount(work);
+    auto heads = (char**)VectorSortAlloc(v, sizeof(char*) * 2 * spanCount); // pairs of [next element, end of run]
+    auto heap = (uint32_t*)VectorSortAlloc(v, sizeof(uint32_t) * spanCount);
+    auto scratch = (char*)VectorSortAlloc(v, (size_t)VectorSpanLimit(work) * size);
+    if (heads == nullptr || heap == nullptr || scratch == nullptr) {
+        if (heads != nullptr) VectorSortFree(v, heads);
+        if (heap != nullptr) VectorSortFree(v, heap);
+        if (scratch != nullptr) VectorSortFree(v, scratch);
+        VectorDeallocate(work);
+        return false;
+    }
+
+    // sort each chunk, and record where its run is
+    uint32_t runs = 0;
+    VectorSpan span;
+    for (bool ok = VectorSpanFirst(work, 0, &span); ok; ok = VectorSpanNext(work, &span)) {
+        VectorSortArray((char*)span.Data, span.Count, scratch, ops);
+        heads[runs * 2] = (char*)span.Data;
+        heads[runs * 2 + 1] = (char*)span.Data + ((size_t)span.Count * size);
+        heap[runs] = runs;
+        runs++;
+    }
+    VectorSortFree(v, scratch);
+
+    // build the tide heap, lowest head element at the top
+    uint32_t heapSize = runs;
+    for (uint32_t i = heapSize / 2; i-- > 0;) {
+        uint32_t parent = i;
+        while (true) {
+            uint32_t child = parent * 2 + 1;
+            if (child >= heapSize) break;
+            if (child + 1 < heapSize && ops.Less(heads[heap[child + 1] * 2], heads[heap[child] * 2])) child++;
+            if (!ops.Less(heads[heap[child] * 2], heads[heap[parent] * 2])) break;
+            auto swp = heap[parent]; heap[parent] = heap[child]; heap[child] = swp;
+            parent = child;
+        }
+    }
+
+    // take from the top of the heap until all runs are empty
+    VectorSortCursor out;
+    VectorSortCursorStart(&out, v, 0, size);
+    while (heapSize > 0) {
+        auto run = heap[0];
+        ops.Copy(out.Ptr, heads[run * 2]);
+        VectorSortCursorNext(&out, v, size);
+
+        heads[run * 2] += size;
+        if (heads[run * 2] >= heads[run * 2 + 1]) heap[0] = heap[--heapSize]; // run is empty
+
+        uint32_t parent = 0;
+        while (true) {
+            uint32_t child = parent * 2 + 1;
+            if (child >= heapSize) break;
+            if (child + 1 < heapSize && ops.Less(heads[heap[child + 1] * 2], heads[heap[child] * 2])) child++;
+            if (!ops.Less(heads[heap[child] * 2], heads[heap[parent] * 2])) break;
+            auto swp = heap[parent]; heap[parent] = heap[child]; heap[child] = swp;
+            parent = child;
+        }
+    }
+
+    VectorSortFree(v, heads);
+    VectorSortFree(v, heap);
+    VectorDeallocate(work);
+    return true;
+}
+
+// Plan E: sort an array of pointers to the elements, then copy the elements back in that order
+template<typename TOps>
+bool VectorSortProxy(Vector* v, TOps& ops) {
+    auto size = ops.Size;
+    auto n = VectorLength(v);
+    auto work = VectorSortScratch(v);
+    if (work == nullptr) return false;
+
+    auto proxy = (char**)VectorSortAlloc(v, sizeof(char*) * 2 * (size_t)n);
+    if (proxy == nullptr) {
+        VectorDeallocate(work);
+        return false;
+    }
+
+    uint32_t i = 0;
+    VectorSpan span;
+    for (bool ok = VectorSpanFirst(work, 0, &span); ok; ok = VectorSpanNext(work, &span)) {
+        auto ptr = (char*)span.Data;
+        for (uint32_t j = 0; j < span.Count; j++, ptr += size) proxy[i++] = ptr;
+    }
+
+    VectorSortProxyOps<TOps> proxyOps = { &ops };
+    VectorSortArray((char*)proxy, n, (char*)(proxy + n), proxyOps);
+
+    VectorSortCursor out;
+    VectorSortCursorStart(&out, v, 0, size);
+    for (i = 0; i < n; i++) {
+        ops.Copy(out.Ptr, proxy[i]);
+        VectorSortCursorNext(&out, v, size);
+    }
+
+    VectorSortFree(v, proxy);
+    VectorDeallocate(work);
+    return true;
+}
+
+// Elements bigger than this are sorted by proxy, as moving pointers is cheaper than moving elements
+const uint32_t VECTOR_SORT_PROXY_SIZE = 32;
+
+// Choose a plan for `VECTOR_SORT_AUTO`, based on the sort benchmark in demo.cpp
+inline int VectorSortPickPlan(Vector* v) {
+    if (VectorIsFlat(v)) return VECTOR_SORT_COPY_OUT; // sorts in place
+    if (VectorElementSize(v) > VECTOR_SORT_PROXY_SIZE) return VECTOR_SORT_PROXY;
+    return VECTOR_SORT_MERGE; // as fast as copy-out for small elements, without needing one big block
+}
+
+// Sort with the given plan, falling back to plan A if there isn't space for the chosen one
+template<typename TOps>
+bool VectorSortWithOps(Vector* v, TOps& ops, int plan) {
+    if (!VectorIsValid(v)) return false;
+    auto n = VectorLength(v);
+    if (n < 2) return true;
+
+    if (plan == VECTOR_SORT_AUTO) plan = VectorSortPickPlan(v);
+
+    bool ok;
+    switch (plan) {
+        case VECTOR_SORT_COPY_OUT: ok = VectorIsFlat(v) ? VectorSortFlat(v, ops) : VectorSortCopyOut(v, ops); break;
+        case VECTOR_SORT_TIDE: ok = VectorSortTide(v, ops); break;
+        case VECTOR_SORT_PROXY: ok = VectorSortProxy(v, ops); break;
+        default: return VectorSortMerge(v, ops);
+    }
+    return ok || VectorSortMerge(v, ops);
+}
+
+// Sort a vector of `T` with a compare function (or lambda) `int compare(T* A, T* B)` that can be inlined.
+// Compare should return 0 if the two values are equal, negative if A should be before B, and positive if B should be before A.
+template<typename T, typename TCompare>
+bool VectorSortInline(Vector* v, TCompare compare, int plan = VECTOR_SORT_AUTO) {
+    if (VectorElementSize(v) != sizeof(T)) return false;
+    VectorSortTypedOps<T, TCompare> ops = { compare };
+    return VectorSortWithOps(v, ops, plan);
+}
+
+// Below this many elements, parallel sorts use the normal single-threaded sort
+const uint32_t VECTOR_SORT_PARALLEL_MIN = 65536;
+// Most threads a parallel sort will use
+const int VECTOR_SORT_MAX_THREADS = 64;
+
+// Take the shared sort workers for one parallel sort, starting them the first time they're needed.
+// Returns how many workers (including the calling thread) the sort can use. If that is less than 2,
+// the pool is busy with another sort or no threads could be started, and the caller should sort alone
+// without calling `VectorSortPoolRelease`.
+int VectorSortPoolAcquire(int workers);
+// Run `task(context, worker)` for each worker (the calling thread is worker zero), and wait for them all
+void VectorSortPoolRun(int workers, void (*task)(void* context, int worker), void* context);
+// Give the shared sort workers back after `VectorSortPoolAcquire`
+void VectorSortPoolRelease();
+
+// Run `task(worker)` for each worker on the pool, and wait for them all
+template<typename TTask>
+void VectorSortRunWorkers(int workers, TTask& task) {
+    VectorSortPoolRun(workers, [](void* context, int worker) { (*(TTask*)context)(worker); }, &task);
+}
+
+// Meeting point between the phases of a parallel sort. Waiters spin, yielding, as phases are short.
+typedef struct VectorSortBarrier {
+    std::atomic<int> waiting;
+    std::atomic<int> generation;
+    int workers;
+} VectorSortBarrier;
+
+// Wait until every worker has arrived. Writes before the wait are visible to all workers after it.
+inline void VectorSortBarrierWait(VectorSortBarrier* b) {
+    auto generation = b->generation.load(std::memory_order_acquire);
+    if (b->waiting.fetch_add(1, std::memory_order_acq_rel) + 1 == b->workers) { // last to arrive lets everyone go
+        b->waiting.store(0, std::memory_order_relaxed);
+        b->generation.fetch_add(1, std::memory_order_release);
+        return;
+    }
+    while (b->generation.load(std::memory_order_acquire) == generation) std::this_thread::yield();
+}
+
+// Copy every span of a vector into `table`. Workers use this to find elements, as lookups
+// through the vector can rebuild its skip table, which isn't safe from more than one thread.
+inline void VectorSortFillSpanTable(Vector* v, VectorSpan* table) {
+    uint32_t i = 0;
+    VectorSpan span;
+    for (bool ok = VectorSpanFirst(v, 0, &span); ok; ok = VectorSpanNext(v, &span)) table[i++] = span;
+}
+
+// Index in `table` of the span holding element `index`
+inline uint32_t VectorSortFindSpan(VectorSpan* table, uint32_t count, uint32_t index) {
+    uint32_t lo = 0, hi = count - 1;
+    while (lo < hi) {
+        uint32_t mid = hi - (hi - lo) / 2;
+        if (table[mid].Index <= index) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Pointer to element `index`, found through a span table
+inline char* VectorSortTableGet(VectorSpan* table, uint32_t count, uint32_t index, uint32_t size) {
+    auto span = table + VectorSortFindSpan(table, count, index);
+    return (char*)span->Data + ((size_t)(index - span->Index) * size);
+}
+
+// Start a cursor at element `index`, found through a span table
+inline void VectorSortCursorAt(VectorSortCursor* c, VectorSpan* table, uint32_t count, uint32_t index, uint32_t size) {
+    c->Span = table[VectorSortFindSpan(table, count, index)];
+    c->Ptr = (char*)c->Span.Data + ((size_t)(index - c->Span.Index) * size);
+    c->SpanEnd = (char*)c->Span.Data + ((size_t)c->Span.Count * size);
+}
+
+// For output position `k` of the merge of runs [start, start + ln) and [mid, mid + rn),
+// find how many of the elements before it come from the left run
+template<typename TOps>
+uint32_t VectorSortCoRank(VectorSpan* table, uint32_t count, uint32_t start, uint32_t ln, uint32_t mid, uint32_t rn, uint32_t k, TOps& ops) {
+    auto size = ops.Size;
+    uint32_t lo = (k > rn) ? k - rn : 0;
+    uint32_t hi = (k < ln) ? k : ln;
+    while (lo < hi) {
+        uint32_t i = lo + (hi - lo) / 2;
+        uint32_t j = k - i;
+        auto left = VectorSortTableGet(table, count, start + i, size);
+        auto right = VectorSortTableGet(table, count, mid + j - 1, size);
+        if (ops.Less(right, left)) hi = i; // ties take from the left, as in the merge
+        else lo = i + 1;
+    }
+    return lo;
+}
+
+// Parallel version of plan A. Each worker sorts a share of the chunks, then every merge pass is
+// split so that each worker writes an equal slice of the output.
+template<typename TOps>
+bool VectorSortParallelWithOps(Vector* v, TOps& ops, int threads) {
+    if (!VectorIsValid(v)) return false;
+    auto n = VectorLength(v);
+    if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+    if (threads > VECTOR_SORT_MAX_THREADS) threads = VECTOR_SORT_MAX_THREADS;
+    if (threads < 2 || n < VECTOR_SORT_PARALLEL_MIN) return VectorSortWithOps(v, ops, VECTOR_SORT_AUTO);
+    threads = VectorSortPoolAcquire(threads);
+    if (threads < 2) return VectorSortWithOps(v, ops, VECTOR_SORT_AUTO);
+
+    auto size = ops.Size;
+    auto work = VectorSortScratch(v);
+    if (work == nullptr) {
+        VectorSortPoolRelease();
+        return VectorSortWithOps(v, ops, VECTOR_SORT_AUTO);
+    }
+
+    uint32_t workSpans = VectorSortSpanCount(work);
+    uint32_t vecSpans = VectorSortSpanCount(v);
+    size_t scratchBytes = (size_t)VectorSpanLimit(work) * size;
+    auto tables = (VectorSpan*)VectorSortAlloc(v, sizeof(VectorSpan) * (workSpans + vecSpans));
+    auto bounds = (uint32_t*)VectorSortAlloc(v, sizeof(uint32_t) * (workSpans + 1));
+    auto scratch = (char*)VectorSortAlloc(v, scratchBytes * threads);
+    if (tables == nullptr || bounds == nullptr || scratch == nullptr) {
+        if (tables != nullptr) VectorSortFree(v, tables);
+        if (bounds != nullptr) VectorSortFree(v, bounds);
+        if (scratch != nullptr) VectorSortFree(v, scratch);
+        VectorDeallocate(work);
+        VectorSortPoolRelease();
+        return VectorSortWithOps(v, ops, VECTOR_SORT_AUTO);
+    }
+    auto workTable = tables;
+    auto vecTable = tables + workSpans;
+    VectorSortFillSpanTable(work, workTable);
+    VectorSortFillSpanTable(v, vecTable);
+    for (uint32_t i = 0; i < workSpans; i++) bounds[i] = workTable[i].Index;
+    bounds[workSpans] = n;
+
+    // Workers run the whole sort in one go, and meet at a barrier between phases
+    VectorSortBarrier barrier;
+    barrier.waiting.store(0);
+    barrier.generation.store(0);
+    barrier.workers = threads;
+
+    auto sortWorker = [&](int worker) {
+        // 1. sort chunks, with each worker taking an equal share
+        uint32_t first = (uint32_t)(((uint64_t)workSpans * worker) / threads);
+        uint32_t last = (uint32_t)(((uint64_t)workSpans * (worker + 1)) / threads);
+        for (uint32_t i = first; i < last; i++) {
+            VectorSortArray((char*)workTable[i].Data, workTable[i].Count, scratch + (scratchBytes * worker), ops);
+        }
+        VectorSortBarrierWait(&barrier);
+
+        // 2. merge pairs of runs back and forth until there is only one.
+        // After each pass the runs start at every `stride`th chunk, so workers need no shared state beyond `bounds`.
+        uint32_t outLo = (uint32_t)(((uint64_t)n * worker) / threads);
+        uint32_t outHi = (uint32_t)(((uint64_t)n * (worker + 1)) / threads);
+        auto src = work; auto srcTable = workTable; auto srcSpans = workSpans;
+        auto dst = v; auto dstTable = vecTable; auto dstSpans = vecSpans;
+        for (uint32_t stride = 1; stride < workSpans; stride *= 2) {
+            for (uint32_t i = 0; i < workSpans; i += 2 * stride) {
+                uint32_t start = bounds[i];
+                uint32_t mid = bounds[(i + stride < workSpans) ? i + stride : workSpans];
+                uint32_t end = bounds[(i + 2 * stride < workSpans) ? i + 2 * stride : workSpans];
+                if (end <= outLo) continue;
+                if (start >= outHi) break;
+
+                // the part of this merge that lands in our slice
+                uint32_t k0 = ((outLo > start) ? outLo : start) - start;
+                uint32_t k1 = ((outHi < end) ? outHi : end) - start;
+                uint32_t i0 = VectorSortCoRank(srcTable, srcSpans, start, mid - start, mid, end - mid, k0, ops);
+                uint32_t i1 = VectorSortCoRank(srcTable, srcSpans, start, mid - start, mid, end - mid, k1, ops);
+                uint32_t j0 = k0 - i0, j1 = k1 - i1;
+
+                VectorSortCursor l = {}, r = {}, out;
+                VectorSortCursorAt(&out, dstTable, dstSpans, start + k0, size);
+                if (i1 > i0) VectorSortCursorAt(&l, srcTable, srcSpans, start + i0, size);
+                if (j1 > j0) VectorSortCursorAt(&r, srcTable, srcSpans, mid + j0, size);
+                VectorSortMergeRuns(src, dst, l, r, out, i1 - i0, j1 - j0, ops);
+            }
+            VectorSortBarrierWait(&barrier);
+
+            auto swp = src; src = dst; dst = swp;
+            auto swpTable = srcTable; srcTable = dstTable; dstTable = swpTable;
+            auto swpSpans = srcSpans; srcSpans = dstSpans; dstSpans = swpSpans;
+        }
+
+        // 3. result is now in `src`. If that's the scratch vector, each worker copies its slice back
+        if (src == v || outHi <= outLo) return;
+        VectorSortCursor from, unused = {}, out;
+        VectorSortCursorAt(&from, srcTable, srcSpans, outLo, size);
+        VectorSortCursorAt(&out, dstTable, dstSpans, outLo, size);
+        VectorSortMergeRuns(src, dst, from, unused, out, outHi - outLo, 0, ops); // merge with nothing is a copy
+    };
+    VectorSortRunWorkers(threads, sortWorker);
+    VectorSortPoolRelease();
+
+    VectorSortFree(v, tables);
+    VectorSortFree(v, bounds);
+    VectorSortFree(v, scratch);
+    VectorDeallocate(work);
+    return true;
+}
+
+// Parallel sort of a vector of `T` with a compare function (or lambda) that can be inlined. See `VectorSortParallel`.
+template<typename T, typename TCompare>
+bool VectorSortParallelInline(Vector* v, TCompare compare, int threads) {
+    if (VectorElementSize(v) != sizeof(T)) return false;
+    VectorSortTypedOps<T, TCompare> ops = { compare };
+    return VectorSortParallelWithOps(v, ops, threads);
+}
+
+#endif